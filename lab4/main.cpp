@@ -7,6 +7,8 @@
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <map>
+#include <string>
 #include <vector>
 
 // Структура для вершины куба с позицией, нормалью и цветом
@@ -111,7 +113,12 @@ const char* fragmentShaderSource = R"(
 
     uniform Light uLight;
     uniform vec3 uViewPos;
-    uniform int uLightType; // 0 - точечный свет, 1 - прожектор
+
+    // Тип освещения задаётся при компиляции варианта шейдера:
+    // 0 - точечный свет, 1 - прожектор
+    #ifndef LIGHT_TYPE
+    #define LIGHT_TYPE 1
+    #endif
 
     uniform vec3 uMaterialAmbient;
     uniform vec3 uMaterialDiffuse;
@@ -135,15 +142,15 @@ const char* fragmentShaderSource = R"(
         float spec = pow(max(dot(viewDir, reflectDir), 0.0), uMaterialShininess);
         vec3 specular = uMaterialSpecular * spec * uLight.Color;
 
-        if (uLightType == 1) {
-            // Прожектор
-            float theta = dot(lightDir, normalize(-uLight.Direction));
-            float epsilon = uLight.CutOff - uLight.OuterCutOff;
-            float intensity = clamp((theta - uLight.OuterCutOff) / epsilon, 0.0, 1.0);
+    #if LIGHT_TYPE == 1
+        // Прожектор
+        float theta = dot(lightDir, normalize(-uLight.Direction));
+        float epsilon = uLight.CutOff - uLight.OuterCutOff;
+        float intensity = clamp((theta - uLight.OuterCutOff) / epsilon, 0.0, 1.0);
 
-            diffuse *= intensity;
-            specular *= intensity;
-        }
+        diffuse *= intensity;
+        specular *= intensity;
+    #endif
 
         vec3 result = ambient + diffuse + specular;
         gl_FragColor = vec4(result, VertexColor.a);
@@ -212,6 +219,115 @@ GLuint createProgram(const char* vertexSource, const char* fragmentSource)
     return program;
 }
 
+// Вставка строк #define в исходный код шейдера (после #version, если он есть)
+std::string injectDefines(const char* source, const std::string& defines)
+{
+    std::string text(source);
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start != std::string::npos && text.compare(start, 8, "#version") == 0)
+    {
+        size_t lineEnd = text.find('\n', start);
+        if (lineEnd == std::string::npos)
+        {
+            text += '\n';
+            lineEnd = text.size() - 1;
+        }
+        text.insert(lineEnd + 1, defines);
+        return text;
+    }
+    return defines + text;
+}
+
+// Кэш специализированных вариантов программы. Ключ — набор #define:
+// каждый вариант компилируется один раз при первом запросе и затем
+// только выбирается перед отрисовкой.
+class ShaderVariantCache
+{
+public:
+    ShaderVariantCache(const char* vertexSource, const char* fragmentSource)
+        : vertexSource_(vertexSource), fragmentSource_(fragmentSource)
+    {
+    }
+
+    ShaderVariantCache(const ShaderVariantCache&) = delete;
+    ShaderVariantCache& operator=(const ShaderVariantCache&) = delete;
+
+    GLuint get(const std::string& defines)
+    {
+        auto it = programs_.find(defines);
+        if (it != programs_.end())
+            return it->second;
+
+        std::string vertex = injectDefines(vertexSource_, defines);
+        std::string fragment = injectDefines(fragmentSource_, defines);
+        GLuint program = createProgram(vertex.c_str(), fragment.c_str());
+        programs_.emplace(defines, program);
+        return program;
+    }
+
+    // Удаление всех программ (вызывается, пока контекст OpenGL ещё существует)
+    void clear()
+    {
+        for (auto& entry : programs_)
+            glDeleteProgram(entry.second);
+        programs_.clear();
+    }
+
+private:
+    const char* vertexSource_;
+    const char* fragmentSource_;
+    std::map<std::string, GLuint> programs_;
+};
+
+// Местоположения атрибутов и униформов одного варианта программы
+struct PhongLocations
+{
+    GLint aPos;
+    GLint aNormal;
+    GLint aColor;
+    GLint uMVP;
+    GLint uModel;
+    GLint uNormalMatrix;
+    GLint uLightPos;
+    GLint uLightDir;
+    GLint uLightColor;
+    GLint uLightCutOff;
+    GLint uLightOuterCutOff;
+    GLint uViewPos;
+    GLint uMaterialAmbient;
+    GLint uMaterialDiffuse;
+    GLint uMaterialSpecular;
+    GLint uMaterialShininess;
+};
+
+PhongLocations getPhongLocations(GLuint program)
+{
+    PhongLocations loc;
+    loc.aPos = glGetAttribLocation(program, "aPos");
+    loc.aNormal = glGetAttribLocation(program, "aNormal");
+    loc.aColor = glGetAttribLocation(program, "aColor");
+    loc.uMVP = glGetUniformLocation(program, "uMVP");
+    loc.uModel = glGetUniformLocation(program, "uModel");
+    loc.uNormalMatrix = glGetUniformLocation(program, "uNormalMatrix");
+    loc.uLightPos = glGetUniformLocation(program, "uLight.Position");
+    loc.uLightDir = glGetUniformLocation(program, "uLight.Direction");
+    loc.uLightColor = glGetUniformLocation(program, "uLight.Color");
+    loc.uLightCutOff = glGetUniformLocation(program, "uLight.CutOff");
+    loc.uLightOuterCutOff = glGetUniformLocation(program, "uLight.OuterCutOff");
+    loc.uViewPos = glGetUniformLocation(program, "uViewPos");
+    loc.uMaterialAmbient = glGetUniformLocation(program, "uMaterialAmbient");
+    loc.uMaterialDiffuse = glGetUniformLocation(program, "uMaterialDiffuse");
+    loc.uMaterialSpecular = glGetUniformLocation(program, "uMaterialSpecular");
+    loc.uMaterialShininess = glGetUniformLocation(program, "uMaterialShininess");
+    return loc;
+}
+
+// Набор #define варианта для типа освещения
+std::string lightTypeDefines(int lightType)
+{
+    return "#define LIGHT_TYPE " + std::to_string(lightType) + "\n";
+}
+
 int main()
 {
     if (!glfwInit())
@@ -241,43 +357,17 @@ int main()
     glfwMakeContextCurrent(window);
     glfwSwapInterval(1); 
 
-    GLuint shaderProgram = createProgram(vertexShaderSource, fragmentShaderSource);
-    glUseProgram(shaderProgram);
-
-    // Получение местоположений атрибутов и униформов
-    GLint aPosLocation = glGetAttribLocation(shaderProgram, "aPos");
-    GLint aNormalLocation = glGetAttribLocation(shaderProgram, "aNormal");
-    GLint aColorLocation = glGetAttribLocation(shaderProgram, "aColor");
-    GLint uMVPLocation = glGetUniformLocation(shaderProgram, "uMVP");
-    GLint uModelLocation = glGetUniformLocation(shaderProgram, "uModel");
-    GLint uNormalMatrixLocation = glGetUniformLocation(shaderProgram, "uNormalMatrix");
-    GLint uLightPosLocation = glGetUniformLocation(shaderProgram, "uLight.Position");
-    GLint uLightDirLocation = glGetUniformLocation(shaderProgram, "uLight.Direction");
-    GLint uLightColorLocation = glGetUniformLocation(shaderProgram, "uLight.Color");
-    GLint uLightCutOffLocation = glGetUniformLocation(shaderProgram, "uLight.CutOff");
-    GLint uLightOuterCutOffLocation = glGetUniformLocation(shaderProgram, "uLight.OuterCutOff");
-    GLint uLightTypeLocation = glGetUniformLocation(shaderProgram, "uLightType");
-    GLint uViewPosLocation = glGetUniformLocation(shaderProgram, "uViewPos");
-    GLint uMaterialAmbientLocation = glGetUniformLocation(shaderProgram, "uMaterialAmbient");
-    GLint uMaterialDiffuseLocation = glGetUniformLocation(shaderProgram, "uMaterialDiffuse");
-    GLint uMaterialSpecularLocation = glGetUniformLocation(shaderProgram, "uMaterialSpecular");
-    GLint uMaterialShininessLocation = glGetUniformLocation(shaderProgram, "uMaterialShininess");
+    // Варианты программы по типу освещения (компилируются при первом выборе)
+    ShaderVariantCache phongVariants(vertexShaderSource, fragmentShaderSource);
+    int lightType = 1; // Начальное значение - прожектор
+    GLuint shaderProgram = 0;
+    PhongLocations loc;
 
     // Создание VBO для куба
     GLuint VBO;
     glGenBuffers(1, &VBO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, cubeVertices.size() * sizeof(CubeVertex), cubeVertices.data(), GL_STATIC_DRAW);
-
-    // Настройка атрибутов для куба
-    glEnableVertexAttribArray(aPosLocation);
-    glVertexAttribPointer(aPosLocation, 3, GL_FLOAT, GL_FALSE, sizeof(CubeVertex), (void*)0);
-
-    glEnableVertexAttribArray(aNormalLocation);
-    glVertexAttribPointer(aNormalLocation, 3, GL_FLOAT, GL_FALSE, sizeof(CubeVertex), (void*)(offsetof(CubeVertex, Normal)));
-
-    glEnableVertexAttribArray(aColorLocation);
-    glVertexAttribPointer(aColorLocation, 4, GL_FLOAT, GL_FALSE, sizeof(CubeVertex), (void*)(offsetof(CubeVertex, Color)));
     glEnable(GL_DEPTH_TEST);
 
     // Параметры освещения
@@ -293,18 +383,39 @@ int main()
     glm::vec3 materialSpecular(1.0f, 1.0f, 1.0f);
     float materialShininess = 32.0f;
 
-    // Передача начальных значений освещения и материала в шейдер
-    glUniform3fv(uLightPosLocation, 1, glm::value_ptr(lightPos));
-    glUniform3fv(uLightDirLocation, 1, glm::value_ptr(lightDir));
-    glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
-    glUniform1f(uLightCutOffLocation, lightCutOff);
-    glUniform1f(uLightOuterCutOffLocation, lightOuterCutOff);
-    glUniform1i(uLightTypeLocation, 1);
-    glUniform3fv(uMaterialAmbientLocation, 1, glm::value_ptr(materialAmbient));
-    glUniform3fv(uMaterialDiffuseLocation, 1, glm::value_ptr(materialDiffuse));
-    glUniform3fv(uMaterialSpecularLocation, 1, glm::value_ptr(materialSpecular));
-    glUniform1f(uMaterialShininessLocation, materialShininess);
-    int lightType = 1; // Начальное значение - прожектор
+    // Выбор варианта программы: при смене программы заново настраиваются
+    // атрибуты и передаются начальные значения освещения и материала
+    auto useVariant = [&](int type)
+    {
+        GLuint program = phongVariants.get(lightTypeDefines(type));
+        if (program == shaderProgram)
+            return;
+        shaderProgram = program;
+        glUseProgram(shaderProgram);
+        loc = getPhongLocations(shaderProgram);
+
+        // Настройка атрибутов для куба
+        glEnableVertexAttribArray(loc.aPos);
+        glVertexAttribPointer(loc.aPos, 3, GL_FLOAT, GL_FALSE, sizeof(CubeVertex), (void*)0);
+
+        glEnableVertexAttribArray(loc.aNormal);
+        glVertexAttribPointer(loc.aNormal, 3, GL_FLOAT, GL_FALSE, sizeof(CubeVertex), (void*)(offsetof(CubeVertex, Normal)));
+
+        glEnableVertexAttribArray(loc.aColor);
+        glVertexAttribPointer(loc.aColor, 4, GL_FLOAT, GL_FALSE, sizeof(CubeVertex), (void*)(offsetof(CubeVertex, Color)));
+
+        // Передача значений освещения и материала в шейдер
+        glUniform3fv(loc.uLightPos, 1, glm::value_ptr(lightPos));
+        glUniform3fv(loc.uLightDir, 1, glm::value_ptr(lightDir));
+        glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
+        glUniform1f(loc.uLightCutOff, lightCutOff);
+        glUniform1f(loc.uLightOuterCutOff, lightOuterCutOff);
+        glUniform3fv(loc.uMaterialAmbient, 1, glm::value_ptr(materialAmbient));
+        glUniform3fv(loc.uMaterialDiffuse, 1, glm::value_ptr(materialDiffuse));
+        glUniform3fv(loc.uMaterialSpecular, 1, glm::value_ptr(materialSpecular));
+        glUniform1f(loc.uMaterialShininess, materialShininess);
+    };
+    useVariant(lightType);
 
     // Параметры камеры
     float cameraOrbitAngle = 0.0f;     // Угол вращения камеры вокруг куба (в градусах)
@@ -334,8 +445,8 @@ int main()
             lightType = 1; // Прожектор
         }
 
-        // Передача типа освещения в шейдер
-        glUniform1i(uLightTypeLocation, lightType);
+        // Выбор варианта шейдера для типа освещения
+        useVariant(lightType);
 
         // Управление радиусом вращения камеры
         if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) // Уменьшение радиуса
@@ -366,37 +477,37 @@ int main()
         {
             lightColor.r += 1.0f * deltaTime;
             if (lightColor.r > 1.0f) lightColor.r = 1.0f;
-            glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
+            glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
         }
         if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS) // Уменьшение красного
         {
             lightColor.r -= 1.0f * deltaTime;
             if (lightColor.r < 0.0f) lightColor.r = 0.0f;
-            glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
+            glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
         }
         if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) // Увеличение зелёного
         {
             lightColor.g += 1.0f * deltaTime;
             if (lightColor.g > 1.0f) lightColor.g = 1.0f;
-            glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
+            glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
         }
         if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) // Уменьшение зелёного
         {
             lightColor.g -= 1.0f * deltaTime;
             if (lightColor.g < 0.0f) lightColor.g = 0.0f;
-            glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
+            glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
         }
         if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) // Увеличение синего
         {
             lightColor.b += 1.0f * deltaTime;
             if (lightColor.b > 1.0f) lightColor.b = 1.0f;
-            glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
+            glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
         }
         if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) // Уменьшение синего
         {
             lightColor.b -= 1.0f * deltaTime;
             if (lightColor.b < 0.0f) lightColor.b = 0.0f;
-            glUniform3fv(uLightColorLocation, 1, glm::value_ptr(lightColor));
+            glUniform3fv(loc.uLightColor, 1, glm::value_ptr(lightColor));
         }
 
         // Управление материалом: коэффициент бликов (shininess)
@@ -404,13 +515,13 @@ int main()
         {
             materialShininess += 50.0f * deltaTime;
             if (materialShininess > 256.0f) materialShininess = 256.0f;
-            glUniform1f(uMaterialShininessLocation, materialShininess);
+            glUniform1f(loc.uMaterialShininess, materialShininess);
         }
         if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) // Уменьшение shininess
         {
             materialShininess -= 50.0f * deltaTime;
             if (materialShininess < 1.0f) materialShininess = 1.0f;
-            glUniform1f(uMaterialShininessLocation, materialShininess);
+            glUniform1f(loc.uMaterialShininess, materialShininess);
         }
 
         // Обновление угла вращения камеры
@@ -425,8 +536,8 @@ int main()
         // Обновление позиции источника света для точечного света
         lightPos = cameraPos;
         lightDir = glm::normalize(glm::vec3(0.0f) - cameraPos); // Направление к центру
-        glUniform3fv(uLightPosLocation, 1, glm::value_ptr(lightPos));
-        glUniform3fv(uLightDirLocation, 1, glm::value_ptr(lightDir));
+        glUniform3fv(loc.uLightPos, 1, glm::value_ptr(lightPos));
+        glUniform3fv(loc.uLightDir, 1, glm::value_ptr(lightDir));
 
         // Матрица проекции (перспективная) с обновлённым FOV
         glm::mat4 projection = glm::perspective(glm::radians(fov),
@@ -449,12 +560,12 @@ int main()
         glm::mat4 mvp = projection * viewMat * model;
 
         // Передача матриц в шейдер
-        glUniformMatrix4fv(uMVPLocation, 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniformMatrix4fv(uModelLocation, 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(uNormalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+        glUniformMatrix4fv(loc.uMVP, 1, GL_FALSE, glm::value_ptr(mvp));
+        glUniformMatrix4fv(loc.uModel, 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(loc.uNormalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
         // Передача позиции камеры в шейдер
-        glUniform3fv(uViewPosLocation, 1, glm::value_ptr(cameraPos));
+        glUniform3fv(loc.uViewPos, 1, glm::value_ptr(cameraPos));
 
         // Очистка буферов
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -470,7 +581,7 @@ int main()
 
     // Очистка ресурсов
     glDeleteBuffers(1, &VBO);
-    glDeleteProgram(shaderProgram);
+    phongVariants.clear();
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -0,0 +1,104 @@
+// atlas_main.cpp
+// Офлайн-упаковка текстур в атлас (texture_atlas.h): изображения
+// декодируются параллельно (TextureLoader), атлас записывается в PNG (RGBA),
+// а рядом — таблица областей <атлас>.txt, по строке на входной файл:
+//   путь x y ширина высота u v du dv
+// где x, y, ширина, высота — в текселах без рамки, а (u, v, du, dv) —
+// значение Material::textureRegion (начало и размер области в долях атласа).
+
+#include "image_writer.h"
+#include "texture.h"
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void printUsage(const char* program) {
+    std::cerr << "Использование: " << program << " atlas.png image1.png [image2.jpg ...]"
+              << " [--padding N] [--max-size N] [--texture-cache DIR] [--no-texture-cache]" << std::endl;
+    if (!PNG_COMPRESSED)
+        std::cerr << "PNG записывается без сжатия (сборка без zlib)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string outPath;
+    std::vector<std::string> inputs;
+    int padding = ATLAS_PADDING;
+    int maxSize = ATLAS_MAX_SIZE;
+    std::string textureCacheDir = TEXTURE_CACHE_DIR;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--padding") == 0 && i + 1 < argc)
+            padding = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--max-size") == 0 && i + 1 < argc)
+            maxSize = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--texture-cache") == 0 && i + 1 < argc)
+            textureCacheDir = argv[++i];
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            textureCacheDir.clear();
+        else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return -1;
+        }
+        else if (outPath.empty())
+            outPath = argv[i];
+        else
+            inputs.push_back(argv[i]);
+    }
+    if (outPath.empty() || inputs.empty()) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    TextureLoader loader(0, false, textureCacheDir);
+    for (const std::string& path : inputs)
+        loader.request(path);
+    loader.wait();
+    std::vector<LoadedTexture> loaded;
+    loader.takeReady(loaded);
+    std::vector<Texture> textures(inputs.size());
+    for (LoadedTexture& item : loaded) { // Номера запросов идут подряд с нуля
+        if (!item.ok) {
+            std::cerr << "Не удалось загрузить текстуру " << item.path << ": " << item.error << std::endl;
+            return -1;
+        }
+        textures[item.id] = std::move(item.texture);
+    }
+
+    TextureAtlas atlas;
+    std::string error;
+    if (!packTextureAtlas(textures, padding, maxSize, atlas, error)) {
+        std::cerr << "Не удалось собрать атлас: " << error << std::endl;
+        return -1;
+    }
+
+    size_t used = 0;
+    for (const AtlasRegion& region : atlas.regions)
+        used += static_cast<size_t>(region.width) * region.height;
+    const double fill = 100.0 * used / (static_cast<double>(atlas.image.width) * atlas.image.height);
+
+    if (!writePNG(outPath.c_str(), atlas.image.width, atlas.image.height, atlas.image.rgba, 4)) {
+        std::cerr << "Не удалось записать " << outPath << std::endl;
+        return -1;
+    }
+    const std::string tablePath = outPath + ".txt";
+    std::ofstream table(tablePath);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const AtlasRegion& region = atlas.regions[i];
+        table << inputs[i] << ' ' << region.x << ' ' << region.y << ' ' << region.width << ' ' << region.height << ' '
+              << region.uv.x << ' ' << region.uv.y << ' ' << region.uv.z << ' ' << region.uv.w << '\n';
+    }
+    if (!table) {
+        std::cerr << "Не удалось записать " << tablePath << std::endl;
+        return -1;
+    }
+    std::cout << "Атлас " << atlas.image.width << "x" << atlas.image.height << ": " << inputs.size()
+              << " текстур, заполнено " << fill << "% (рамка " << padding << ")" << std::endl;
+    std::cout << "Записаны " << outPath << " и " << tablePath << std::endl;
+    return 0;
+}
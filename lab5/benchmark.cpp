@@ -0,0 +1,357 @@
+// benchmark.cpp
+// Замер производительности CPU-трассировщика на сгенерированных сценах.
+// Для каждой сцены (число сфер x коэффициент отражения) и числа потоков
+// 1, 2, 4, ..., N измеряются:
+//   - полный кадр (renderImage) — суммарные млн лучей/с;
+//   - отдельно первичные, теневые и отражённые лучи: лучи кадра заранее
+//     записываются и затем пересекаются с BVH без затенения;
+//   - кадр волновым конвейером (WavefrontRenderer, очереди переиспользуются);
+//   - кадр очередями лучей по отскокам (RayOrder::Queued и RayOrder::Binned)
+//     и отражённые лучи в порядке корзин: млн лучей/с, выборки узлов BVH и
+//     промахи модели кэша на луч (NodeFetchStats) в исходном порядке и по корзинам.
+// Результаты печатаются и записываются в JSON для сравнения между версиями.
+
+#include "raytracer.h"
+#include "wavefront.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Лучей в одной задаче пула при замере отдельных типов лучей
+const size_t RAY_BATCH_SIZE = 4096;
+
+// Теневой луч: исключаемая сфера и признак попадания в плоскость (как в traceRay)
+struct ShadowRay {
+    Ray ray;
+    int exclude;
+    bool fromPlane;
+};
+
+// Лучи одного кадра по типам
+struct RayBatches {
+    std::vector<Ray> primary;
+    std::vector<ShadowRay> shadow;
+    std::vector<Ray> reflection;
+};
+
+// Запись лучей кадра: тот же обход, что в traceRay, но вместо затенения
+// лучи сохраняются по типам
+void captureRays(const Scene& scene, const SphereBVH& bvh, const RenderSettings& settings, RayBatches& batches) {
+    const CameraBasis basis = makeCameraBasis(scene.camera, static_cast<float>(settings.width) / static_cast<float>(settings.height));
+    const int planeObject = static_cast<int>(scene.spheres.size());
+
+    for (int y = 0; y < settings.height; ++y) {
+        for (int x = 0; x < settings.width; ++x) {
+            glm::vec2 ndc = pixelToNdc(x + 0.5f, y + 0.5f, settings.width, settings.height);
+            Ray currentRay = generateRay(ndc.x, ndc.y, basis);
+            batches.primary.push_back(currentRay);
+
+            for (int depth = 0; depth < settings.maxDepth; ++depth) {
+                if (depth > 0)
+                    batches.reflection.push_back(currentRay);
+
+                float tMin = 1e20f, t;
+                int hitObject = -1;
+                bvh.intersectClosest(currentRay.origin, currentRay.direction, tMin, hitObject);
+                if (intersectPlane(currentRay, scene.floorPlane, t) && t < tMin) {
+                    tMin = t;
+                    hitObject = planeObject;
+                }
+                if (hitObject == -1)
+                    break;
+
+                glm::vec3 hitPoint = currentRay.origin + currentRay.direction * tMin;
+                glm::vec3 normal;
+                const Material* material;
+                if (hitObject != planeObject) {
+                    normal = glm::normalize(hitPoint - scene.spheres.center(hitObject));
+                    material = &scene.materials[scene.spheres.materialIndex[hitObject]];
+                }
+                else {
+                    normal = scene.floorPlane.normal;
+                    material = &scene.materials[scene.floorPlane.materialIndex];
+                }
+
+                ShadowRay shadow;
+                shadow.ray.origin = hitPoint + normal * 1e-4f;
+                shadow.ray.direction = glm::normalize(scene.light.position - hitPoint);
+                shadow.exclude = hitObject;
+                shadow.fromPlane = hitObject == planeObject;
+                batches.shadow.push_back(shadow);
+
+                if (material->reflection <= 0.0f)
+                    break;
+                glm::vec3 reflectDir = glm::reflect(currentRay.direction, normal);
+                currentRay.origin = hitPoint + reflectDir * 1e-4f;
+                currentRay.direction = reflectDir;
+            }
+        }
+    }
+}
+
+// Время выполнения функции в миллисекундах (лучшее из repeat запусков)
+template <typename Function>
+double bestTimeMs(int repeat, Function function) {
+    double best = 1e300;
+    for (int r = 0; r < repeat; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// Пересечение набора лучей с ближайшим объектом (сферы через BVH и плоскость)
+double timeClosest(const Scene& scene, const SphereBVH& bvh, const std::vector<Ray>& rays, WorkStealingPool& pool, int repeat) {
+    const size_t batches = (rays.size() + RAY_BATCH_SIZE - 1) / RAY_BATCH_SIZE;
+    std::vector<int> hits(pool.size() * 16); // Результат используется, чтобы цикл не выбросил компилятор
+    return bestTimeMs(repeat, [&] {
+        pool.parallelFor(batches, [&](size_t batch, unsigned worker) {
+            const size_t end = std::min(rays.size(), (batch + 1) * RAY_BATCH_SIZE);
+            int count = 0;
+            for (size_t i = batch * RAY_BATCH_SIZE; i < end; ++i) {
+                float tMin = 1e20f, t;
+                int hitObject = -1;
+                bvh.intersectClosest(rays[i].origin, rays[i].direction, tMin, hitObject);
+                if (intersectPlane(rays[i], scene.floorPlane, t) && t < tMin)
+                    hitObject = static_cast<int>(scene.spheres.size());
+                count += hitObject >= 0;
+            }
+            hits[worker * 16] += count;
+        });
+    });
+}
+
+// Проверка теней для набора теневых лучей (любое пересечение)
+double timeShadow(const Scene& scene, const SphereBVH& bvh, const std::vector<ShadowRay>& rays, WorkStealingPool& pool, int repeat) {
+    const size_t batches = (rays.size() + RAY_BATCH_SIZE - 1) / RAY_BATCH_SIZE;
+    std::vector<int> hits(pool.size() * 16);
+    return bestTimeMs(repeat, [&] {
+        pool.parallelFor(batches, [&](size_t batch, unsigned worker) {
+            const size_t end = std::min(rays.size(), (batch + 1) * RAY_BATCH_SIZE);
+            int count = 0;
+            for (size_t i = batch * RAY_BATCH_SIZE; i < end; ++i) {
+                const ShadowRay& shadow = rays[i];
+                bool inShadow = bvh.intersectAny(shadow.ray.origin, shadow.ray.direction, shadow.exclude);
+                float t;
+                if (!inShadow && !shadow.fromPlane)
+                    inShadow = intersectPlane(shadow.ray, scene.floorPlane, t);
+                count += inShadow;
+            }
+            hits[worker * 16] += count;
+        });
+    });
+}
+
+// Выборки узлов BVH и промахи модели кэша на луч при обходе лучей по порядку
+// в одном потоке (модель кэша одного ядра)
+void countNodeFetches(const SphereBVH& bvh, const std::vector<Ray>& rays, double& fetchesPerRay, double& missesPerRay) {
+    NodeFetchStats stats;
+    for (const Ray& ray : rays) {
+        float tMin = 1e20f;
+        int hitObject = -1;
+        bvh.intersectClosest(ray.origin, ray.direction, tMin, hitObject, &stats);
+    }
+    const double count = static_cast<double>(std::max<size_t>(1, rays.size()));
+    fetchesPerRay = stats.fetches / count;
+    missesPerRay = stats.misses / count;
+}
+
+// Млн лучей в секунду
+double mraysPerSecond(size_t rays, double ms) {
+    return ms > 0.0 ? static_cast<double>(rays) / (ms * 1e3) : 0.0;
+}
+
+const char* simdPath() {
+#if defined(RT_USE_AVX2)
+    return "avx2";
+#elif defined(RT_USE_SSE4)
+    return "sse4.1";
+#else
+    return "scalar";
+#endif
+}
+
+// Список чисел через запятую ("10,1000")
+std::vector<size_t> parseList(const char* text) {
+    std::vector<size_t> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            values.push_back(static_cast<size_t>(std::atoll(item.c_str())));
+    return values;
+}
+
+int main(int argc, char** argv) {
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    RenderSettings settings;
+    settings.width = 640;
+    settings.height = 480;
+    int repeat = 3;
+    std::string outPath = "benchmark.json";
+
+    // Сцены: основная сцена lab5 плюс поле сфер на полу. Общее число сфер —
+    // sphereCounts (две основные входят в него); отражение задаётся всем сферам.
+    std::vector<size_t> sphereCounts = { 10, 1000, 100000, 1000000 };
+    const float reflections[] = { 0.0f, 0.5f, 0.9f };
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            maxThreads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        else if (std::strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+            settings.width = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+            settings.height = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            settings.maxDepth = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--spheres") == 0 && i + 1 < argc)
+            sphereCounts = parseList(argv[++i]);
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else {
+            std::cerr << "Использование: " << argv[0]
+                      << " [--threads N] [--width W] [--height H] [--depth D] [--repeat R] [--spheres 10,1000,...] [--out benchmark.json]"
+                      << std::endl;
+            return -1;
+        }
+    }
+
+    // Число потоков: 1, 2, 4, ... и само N
+    std::vector<unsigned> threadCounts;
+    for (unsigned count = 1; count < maxThreads; count *= 2)
+        threadCounts.push_back(count);
+    threadCounts.push_back(maxThreads);
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"width\": " << settings.width << ",\n"
+         << "  \"height\": " << settings.height << ",\n"
+         << "  \"maxDepth\": " << settings.maxDepth << ",\n"
+         << "  \"repeat\": " << repeat << ",\n"
+         << "  \"simd\": \"" << simdPath() << "\",\n"
+         << "  \"hardwareThreads\": " << std::thread::hardware_concurrency() << ",\n"
+         << "  \"results\": [";
+    bool firstResult = true;
+
+    std::cout << "SIMD: " << simdPath() << ", кадр " << settings.width << "x" << settings.height
+              << ", глубина " << settings.maxDepth << std::endl;
+
+    for (size_t sphereCount : sphereCounts) {
+        Scene scene = makeDefaultScene();
+        if (sphereCount > scene.spheres.size())
+            addSphereField(scene, sphereCount - scene.spheres.size());
+
+        // BVH зависит только от геометрии и общая для всех коэффициентов отражения
+        SceneBVH bvh;
+        const double buildMs = bestTimeMs(1, [&] { bvh.build(scene); });
+        std::cout << "\nСфер: " << scene.spheres.size() << ", построение BVH: " << buildMs << " мс" << std::endl;
+
+        for (float reflection : reflections) {
+            for (uint32_t m = 0; m < scene.materials.size(); ++m) {
+                if (m == scene.floorPlane.materialIndex)
+                    continue;
+                Material material = scene.materials[m];
+                material.reflection = reflection;
+                scene.materials.set(m, material);
+            }
+
+            RayBatches batches;
+            captureRays(scene, bvh.spheres, settings, batches);
+
+            // Отражённые лучи в порядке корзин и выборки узлов в обоих порядках
+            std::vector<Ray> binnedReflection(batches.reflection.size());
+            {
+                WorkStealingPool pool(maxThreads);
+                const std::vector<uint32_t> order = binnedRayOrder(
+                    batches.reflection.size(), [&](size_t i) -> const Ray& { return batches.reflection[i]; }, pool);
+                for (size_t i = 0; i < order.size(); ++i)
+                    binnedReflection[i] = batches.reflection[order[i]];
+            }
+            double fetches, misses, binnedFetches, binnedMisses;
+            countNodeFetches(bvh.spheres, batches.reflection, fetches, misses);
+            countNodeFetches(bvh.spheres, binnedReflection, binnedFetches, binnedMisses);
+            if (!batches.reflection.empty())
+                std::cout << "  отражение " << reflection << ": узлов BVH на отражённый луч " << fetches << " -> " << binnedFetches
+                          << " по корзинам, промахов модели кэша " << misses << " -> " << binnedMisses << std::endl;
+
+            RenderSettings queuedSettings = settings, binnedSettings = settings;
+            queuedSettings.rayOrder = RayOrder::Queued;
+            binnedSettings.rayOrder = RayOrder::Binned;
+
+            for (unsigned threads : threadCounts) {
+                WorkStealingPool pool(threads);
+                Framebuffer framebuffer;
+
+                RayCounters counters;
+                renderImage(scene, bvh, settings, framebuffer, pool, &counters); // Прогрев
+                const double frameMs = bestTimeMs(repeat, [&] { renderImage(scene, bvh, settings, framebuffer, pool); });
+                const double primaryMs = timeClosest(scene, bvh.spheres, batches.primary, pool, repeat);
+                const double shadowMs = timeShadow(scene, bvh.spheres, batches.shadow, pool, repeat);
+                const double reflectionMs = timeClosest(scene, bvh.spheres, batches.reflection, pool, repeat);
+                const double queuedFrameMs = bestTimeMs(repeat, [&] { renderImage(scene, bvh, queuedSettings, framebuffer, pool); });
+                const double binnedFrameMs = bestTimeMs(repeat, [&] { renderImage(scene, bvh, binnedSettings, framebuffer, pool); });
+                WavefrontRenderer wavefront;
+                wavefront.render(scene, bvh, settings, framebuffer, pool); // Прогрев: выделение очередей
+                const double wavefrontMs = bestTimeMs(repeat, [&] { wavefront.render(scene, bvh, settings, framebuffer, pool); });
+                const double binnedReflectionMs = timeClosest(scene, bvh.spheres, binnedReflection, pool, repeat);
+
+                const double totalRate = mraysPerSecond(counters.total(), frameMs);
+                const double primaryRate = mraysPerSecond(batches.primary.size(), primaryMs);
+                const double shadowRate = mraysPerSecond(batches.shadow.size(), shadowMs);
+                const double reflectionRate = mraysPerSecond(batches.reflection.size(), reflectionMs);
+                const double queuedRate = mraysPerSecond(counters.total(), queuedFrameMs);
+                const double binnedRate = mraysPerSecond(counters.total(), binnedFrameMs);
+                const double wavefrontRate = mraysPerSecond(counters.total(), wavefrontMs);
+                const double binnedReflectionRate = mraysPerSecond(binnedReflection.size(), binnedReflectionMs);
+
+                std::cout << "  отражение " << reflection << ", потоков " << threads << ": кадр " << frameMs << " мс, "
+                          << totalRate << " млн лучей/с (первичные " << primaryRate << ", теневые " << shadowRate
+                          << ", отражённые " << reflectionRate << ")" << std::endl;
+                std::cout << "    волновой конвейер: кадр " << wavefrontMs << " мс, " << wavefrontRate << " млн лучей/с" << std::endl;
+                std::cout << "    очереди по отскокам: кадр " << queuedFrameMs << " мс, " << queuedRate
+                          << " млн лучей/с; с корзинами: кадр " << binnedFrameMs << " мс, " << binnedRate
+                          << " млн лучей/с; отражённые лучи по корзинам " << binnedReflectionRate << " млн лучей/с" << std::endl;
+
+                json << (firstResult ? "\n" : ",\n")
+                     << "    {\"spheres\": " << scene.spheres.size()
+                     << ", \"reflection\": " << reflection
+                     << ", \"threads\": " << threads
+                     << ", \"bvhBuildMs\": " << buildMs
+                     << ", \"frameMs\": " << frameMs
+                     << ", \"queuedFrameMs\": " << queuedFrameMs
+                     << ", \"binnedFrameMs\": " << binnedFrameMs
+                     << ", \"wavefrontFrameMs\": " << wavefrontMs
+                     << ", \"rays\": {\"primary\": " << counters.primary << ", \"shadow\": " << counters.shadow
+                     << ", \"reflection\": " << counters.reflection << "}"
+                     << ", \"mraysPerSec\": {\"frame\": " << totalRate << ", \"primary\": " << primaryRate
+                     << ", \"shadow\": " << shadowRate << ", \"reflection\": " << reflectionRate
+                     << ", \"frameWavefront\": " << wavefrontRate << ", \"frameQueued\": " << queuedRate << ", \"frameBinned\": " << binnedRate
+                     << ", \"reflectionBinned\": " << binnedReflectionRate << "}"
+                     << ", \"reflectionNodesPerRay\": {\"fetches\": " << fetches << ", \"misses\": " << misses
+                     << ", \"binnedFetches\": " << binnedFetches << ", \"binnedMisses\": " << binnedMisses << "}}";
+                firstResult = false;
+            }
+        }
+    }
+
+    json << "\n  ]\n}\n";
+
+    std::ofstream file(outPath.c_str());
+    if (!file || !(file << json.str())) {
+        std::cerr << "Не удалось записать " << outPath << std::endl;
+        return -1;
+    }
+    std::cout << "\nРезультаты сохранены: " << outPath << std::endl;
+    return 0;
+}
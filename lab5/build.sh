@@ -10,7 +10,7 @@ SOURCE="main.cpp"
 CXX=g++
 
 # Флаги компиляции
-CXXFLAGS="-std=c++11 -Wall -O2 `pkg-config --cflags glew glfw3`"
+CXXFLAGS="-std=c++11 -Wall -O2 -pthread `pkg-config --cflags glew glfw3`"
 
 # Линковка библиотек
 LIBS="`pkg-config --libs glew glfw3` -lGL -lm"
@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Имя исполняемого файла
+OUTPUT="texture_atlas"
+
+# Путь к исходному файлу
+SOURCE="atlas_main.cpp"
+
+# Компилятор
+CXX=g++
+
+# Флаги компиляции
+CXXFLAGS="-std=c++11 -Wall -O3 -march=native -pthread"
+
+# Библиотеки; zlib, если найден, — для сжатия PNG (без него PNG пишется несжатым)
+LIBS="-lm"
+if echo "#include <zlib.h>" | $CXX -E -x c++ - > /dev/null 2>&1; then
+    CXXFLAGS="$CXXFLAGS -DRT_USE_ZLIB"
+    LIBS="$LIBS -lz"
+fi
+
+# Компиляция
+echo "Компилируем $SOURCE..."
+$CXX $CXXFLAGS $SOURCE -o $OUTPUT $LIBS
+
+# Проверяем успешность компиляции
+if [ $? -eq 0 ]; then
+    echo "Успешно скомпилировано: $OUTPUT"
+    echo "Упаковка атласа..."
+    ./$OUTPUT "$@"
+else
+    echo "Ошибка компиляции!"
+fi
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+# Имя исполняемого файла
+OUTPUT="raytrace_benchmark"
+
+# Путь к исходному файлу
+SOURCE="benchmark.cpp"
+
+# Компилятор
+CXX=g++
+
+# Флаги компиляции. -ffp-contract=off запрещает слияние умножения и сложения
+# (FMA): иначе компилятор сливает их по-разному в разных порядках обхода лучей
+# (--ray-order, --wavefront), и изображения и счётчики лучей расходятся
+CXXFLAGS="-std=c++11 -Wall -O3 -march=native -ffp-contract=off -pthread"
+
+# Компиляция
+echo "Компилируем $SOURCE..."
+$CXX $CXXFLAGS $SOURCE -o $OUTPUT -lm
+
+# Проверяем успешность компиляции
+if [ $? -eq 0 ]; then
+    echo "Успешно скомпилировано: $OUTPUT"
+    echo "Запуск замеров..."
+    ./$OUTPUT "$@"
+else
+    echo "Ошибка компиляции!"
+fi
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Имя исполняемого файла
+OUTPUT="texture_compress"
+
+# Путь к исходному файлу
+SOURCE="compress_main.cpp"
+
+# Компилятор
+CXX=g++
+
+# Флаги компиляции
+CXXFLAGS="-std=c++11 -Wall -O3 -march=native -pthread"
+
+# Компиляция
+echo "Компилируем $SOURCE..."
+$CXX $CXXFLAGS $SOURCE -o $OUTPUT -lm
+
+# Проверяем успешность компиляции
+if [ $? -eq 0 ]; then
+    echo "Успешно скомпилировано: $OUTPUT"
+    echo "Сжатие текстур..."
+    ./$OUTPUT "$@"
+else
+    echo "Ошибка компиляции!"
+fi
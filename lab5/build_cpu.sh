@@ -0,0 +1,35 @@
+#!/bin/bash
+
+# Имя исполняемого файла
+OUTPUT="raytrace_cpu"
+
+# Путь к исходному файлу
+SOURCE="cpu_main.cpp"
+
+# Компилятор
+CXX=g++
+
+# Флаги компиляции. -ffp-contract=off запрещает слияние умножения и сложения
+# (FMA): иначе компилятор сливает их по-разному в разных порядках обхода лучей
+# (--ray-order, --wavefront), и изображения и счётчики лучей расходятся
+CXXFLAGS="-std=c++11 -Wall -O3 -march=native -ffp-contract=off -pthread"
+
+# Библиотеки; zlib, если найден, — для сжатия PNG (без него PNG пишется несжатым)
+LIBS="-lm"
+if echo "#include <zlib.h>" | $CXX -E -x c++ - > /dev/null 2>&1; then
+    CXXFLAGS="$CXXFLAGS -DRT_USE_ZLIB"
+    LIBS="$LIBS -lz"
+fi
+
+# Компиляция
+echo "Компилируем $SOURCE..."
+$CXX $CXXFLAGS $SOURCE -o $OUTPUT $LIBS
+
+# Проверяем успешность компиляции
+if [ $? -eq 0 ]; then
+    echo "Успешно скомпилировано: $OUTPUT"
+    echo "Запуск рендеринга..."
+    ./$OUTPUT "$@"
+else
+    echo "Ошибка компиляции!"
+fi
@@ -0,0 +1,779 @@
+// bvh.h
+// Иерархия ограничивающих объёмов (BVH) с разбиением по SAH на корзинах (binned SAH).
+// Для анимированных сцен есть уточнение границ без смены топологии (refit) и
+// быстрое параллельное перестроение по кодам Мортона (LBVH).
+// Плоскость бесконечна и в BVH не входит — она проверяется отдельно.
+
+#pragma once
+
+#include "scene.h"
+#include "simd_sphere.h"
+#include "thread_pool.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Число корзин на ось при поиске разбиения
+const int BVH_BINS = 16;
+
+// Максимум примитивов в листе (один векторный блок ядра из simd_sphere.h)
+const int BVH_MAX_LEAF = SIMD_WIDTH;
+
+// Стоимости обхода узла и проверки листа для SAH. Лист проверяется векторным
+// ядром блоками по SIMD_WIDTH сфер, поэтому стоимость считается в блоках, а не в сферах.
+const float SAH_TRAVERSAL_COST = 1.0f;
+const float SAH_INTERSECT_COST = 1.0f;
+
+inline int simdBlocks(int count) {
+    return (count + SIMD_WIDTH - 1) / SIMD_WIDTH;
+}
+
+// Глубина стека обхода
+const int BVH_STACK_SIZE = 64;
+
+// Предельная глубина листа (корень — глубина 0). Обход кладёт на стек не
+// больше одного узла на уровень и ещё один при спуске к листу, поэтому стек
+// глубины BVH_STACK_SIZE не переполняется. Узел на этой глубине становится
+// листом, сколько бы примитивов в нём ни было.
+const int BVH_MAX_DEPTH = BVH_STACK_SIZE - 1;
+
+// LBVH: примитивов на поддерево, которое строится одной задачей пула
+// (верх дерева до этого размера строится последовательно)
+const int LBVH_MIN_TASK_PRIMS = 1024;
+
+// Предельный рост оценки SAH после уточнения границ относительно дерева сразу
+// после перестроения: дальше дерево перестраивается, не дожидаясь замеров
+const float BVH_REFIT_MAX_SAH_GROWTH = 2.0f;
+
+// Ограничивающий параллелепипед
+struct AABB {
+    glm::vec3 bmin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 bmax = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3& p) {
+        bmin = glm::min(bmin, p);
+        bmax = glm::max(bmax, p);
+    }
+
+    void grow(const AABB& box) {
+        bmin = glm::min(bmin, box.bmin);
+        bmax = glm::max(bmax, box.bmax);
+    }
+
+    bool empty() const { return bmin.x > bmax.x; }
+
+    // Половина площади поверхности (для SAH важны только отношения)
+    float halfArea() const {
+        if (empty())
+            return 0.0f;
+        glm::vec3 e = bmax - bmin;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    glm::vec3 centroid() const { return (bmin + bmax) * 0.5f; }
+};
+
+// Узел BVH (32 байта). Для внутреннего узла count == 0 и leftFirst — индекс левого
+// потомка (правый лежит следом), для листа leftFirst — первый примитив.
+struct BVHNode {
+    glm::vec3 bmin;
+    int32_t leftFirst;
+    glm::vec3 bmax;
+    int32_t count;
+
+    bool isLeaf() const { return count > 0; }
+};
+
+// Пересечение луча с узлом (метод плит). tEntry — расстояние входа в параллелепипед.
+inline bool intersectNode(const BVHNode& node, const glm::vec3& origin, const glm::vec3& invDir, float tMax, float& tEntry) {
+    float tx1 = (node.bmin.x - origin.x) * invDir.x, tx2 = (node.bmax.x - origin.x) * invDir.x;
+    float ty1 = (node.bmin.y - origin.y) * invDir.y, ty2 = (node.bmax.y - origin.y) * invDir.y;
+    float tz1 = (node.bmin.z - origin.z) * invDir.z, tz2 = (node.bmax.z - origin.z) * invDir.z;
+    float tNear = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+    float tFar = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+    tEntry = tNear;
+    return tFar >= std::max(tNear, 0.0f) && tNear < tMax;
+}
+
+// Счётчик выборок узлов BVH с моделью кэша данных: прямое отображение,
+// NODE_CACHE_LINES строк по 64 байта (32 КБ, как L1). Аппаратные счётчики
+// промахов доступны не везде, а модель даёт воспроизводимую оценку того,
+// насколько соседние лучи обходят одни и те же узлы.
+const int NODE_CACHE_LINES = 512;
+
+struct NodeFetchStats {
+    uint64_t fetches = 0;
+    uint64_t misses = 0;
+    uintptr_t lines[NODE_CACHE_LINES] = {}; // Номер строки + 1, 0 — пустая
+
+    void fetch(const BVHNode* node) {
+        const uintptr_t line = reinterpret_cast<uintptr_t>(node) / 64;
+        uintptr_t& cached = lines[line % NODE_CACHE_LINES];
+        ++fetches;
+        if (cached != line + 1) {
+            cached = line + 1;
+            ++misses;
+        }
+    }
+};
+
+inline glm::vec3 safeInverse(const glm::vec3& dir) {
+    const float big = 1e30f;
+    return glm::vec3(dir.x != 0.0f ? 1.0f / dir.x : big,
+                     dir.y != 0.0f ? 1.0f / dir.y : big,
+                     dir.z != 0.0f ? 1.0f / dir.z : big);
+}
+
+// Раздвигает младшие 10 бит на каждую третью позицию (для 30-битного кода Мортона)
+inline uint32_t expandBits10(uint32_t v) {
+    v &= 0x3FFu;
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v << 8)) & 0x0300F00Fu;
+    v = (v | (v << 4)) & 0x030C30C3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+}
+
+// Код Мортона точки с координатами в [0, 1]
+inline uint32_t morton3D(const glm::vec3& p) {
+    const glm::vec3 q = glm::min(glm::max(p * 1024.0f, glm::vec3(0.0f)), glm::vec3(1023.0f));
+    return (expandBits10(static_cast<uint32_t>(q.x)) << 2) | (expandBits10(static_cast<uint32_t>(q.y)) << 1) |
+           expandBits10(static_cast<uint32_t>(q.z));
+}
+
+// BVH над произвольными примитивами, заданными своими AABB.
+// Потомки узла всегда лежат в массиве после него — на этом держится refit.
+class BVH {
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<int> primIndices; // Порядок примитивов в листах
+
+    void build(const std::vector<AABB>& primBounds) {
+        nodes.clear();
+        primIndices.resize(primBounds.size());
+        if (primBounds.empty())
+            return;
+
+        centroids_.resize(primBounds.size());
+        for (size_t i = 0; i < primBounds.size(); ++i) {
+            primIndices[i] = static_cast<int>(i);
+            centroids_[i] = primBounds[i].centroid();
+        }
+
+        nodes.reserve(primBounds.size() * 2);
+        nodes.push_back(BVHNode());
+        subdivide(0, 0, static_cast<int>(primBounds.size()), 0, primBounds);
+
+        centroids_.clear();
+        centroids_.shrink_to_fit();
+    }
+
+    // Построение LBVH. Ключ сортировки — код Мортона центра примитива в старших
+    // 32 битах и индекс примитива в младших, поэтому ключи различны и порядок
+    // однозначен. Узел делится по старшему различающемуся биту ключей своего
+    // диапазона. Коды, сортировка и нижние поддеревья считаются на пуле потоков.
+    void buildLBVH(const std::vector<AABB>& primBounds, WorkStealingPool& pool) {
+        nodes.clear();
+        primIndices.resize(primBounds.size());
+        if (primBounds.empty())
+            return;
+
+        const size_t count = primBounds.size();
+        const size_t workers = pool.size();
+        std::vector<AABB> workerBounds(workers);
+        pool.parallelFor(workers, [&](size_t chunk, unsigned) {
+            for (size_t i = count * chunk / workers; i < count * (chunk + 1) / workers; ++i)
+                workerBounds[chunk].grow(primBounds[i].centroid());
+        });
+        AABB centroidBounds;
+        for (const AABB& box : workerBounds)
+            centroidBounds.grow(box);
+        const glm::vec3 extent = glm::max(centroidBounds.bmax - centroidBounds.bmin, glm::vec3(1e-20f));
+
+        keys_.resize(count);
+        pool.parallelFor(workers, [&](size_t chunk, unsigned) {
+            for (size_t i = count * chunk / workers; i < count * (chunk + 1) / workers; ++i) {
+                const uint32_t code = morton3D((primBounds[i].centroid() - centroidBounds.bmin) / extent);
+                keys_[i] = (static_cast<uint64_t>(code) << 32) | static_cast<uint32_t>(i);
+            }
+        });
+        parallelSort(keys_, pool);
+        for (size_t i = 0; i < count; ++i)
+            primIndices[i] = static_cast<int>(keys_[i] & 0xFFFFFFFFu);
+
+        // Верх дерева: деление, пока диапазоны крупнее задачи
+        std::vector<LBVHTask> tasks;
+        const int taskPrims = std::max(LBVH_MIN_TASK_PRIMS, static_cast<int>(count / (4 * workers)));
+        nodes.reserve(count * 2);
+        nodes.push_back(BVHNode());
+        splitTop(0, 0, static_cast<int>(count), 0, taskPrims, tasks);
+        const size_t topCount = nodes.size();
+
+        // Поддеревья строятся независимо в локальные массивы (корень — элемент 0)
+        std::vector<std::vector<BVHNode>> subtrees(tasks.size());
+        pool.parallelFor(tasks.size(), [&](size_t task, unsigned) {
+            std::vector<BVHNode>& local = subtrees[task];
+            local.reserve(static_cast<size_t>(tasks[task].count) * 2);
+            local.push_back(BVHNode());
+            emitLBVH(local, 0, tasks[task].first, tasks[task].count, tasks[task].depth, primBounds);
+        });
+
+        // Сшивка: корень поддерева занимает узел-заготовку, остальные узлы дописываются
+        for (size_t task = 0; task < tasks.size(); ++task) {
+            const std::vector<BVHNode>& local = subtrees[task];
+            const int base = static_cast<int>(nodes.size()) - 1;
+            for (size_t i = 0; i < local.size(); ++i) {
+                BVHNode node = local[i];
+                if (!node.isLeaf())
+                    node.leftFirst += base;
+                if (i == 0)
+                    nodes[tasks[task].node] = node;
+                else
+                    nodes.push_back(node);
+            }
+        }
+
+        // Границы верхних узлов (у корней поддеревьев они уже посчитаны)
+        for (size_t i = topCount; i-- > 0;) {
+            if (!nodes[i].isLeaf())
+                growFromChildren(nodes[i]);
+        }
+    }
+
+    // Уточнение границ узлов без изменения топологии: один обратный проход,
+    // так как потомки лежат после родителя. leafBounds(node) — границы листа.
+    template <class LeafBounds>
+    void refit(const LeafBounds& leafBounds) {
+        for (size_t i = nodes.size(); i-- > 0;) {
+            BVHNode& node = nodes[i];
+            if (node.isLeaf()) {
+                const AABB box = leafBounds(node);
+                node.bmin = box.bmin;
+                node.bmax = box.bmax;
+            }
+            else {
+                growFromChildren(node);
+            }
+        }
+    }
+
+    void refit(const std::vector<AABB>& primBounds) {
+        refit([&](const BVHNode& node) {
+            AABB box;
+            for (int i = 0; i < node.count; ++i)
+                box.grow(primBounds[primIndices[node.leftFirst + i]]);
+            return box;
+        });
+    }
+
+    // Оценка стоимости обхода по SAH (в единицах обхода одного узла на луч,
+    // попадающий в корень). Растёт, когда после refit узлы раздуваются и перекрываются.
+    float sahCost() const {
+        if (nodes.empty())
+            return 0.0f;
+        float cost = 0.0f;
+        for (const BVHNode& node : nodes) {
+            AABB box;
+            box.bmin = node.bmin;
+            box.bmax = node.bmax;
+            cost += box.halfArea() * (node.isLeaf() ? SAH_INTERSECT_COST * simdBlocks(node.count) : SAH_TRAVERSAL_COST);
+        }
+        AABB root;
+        root.bmin = nodes[0].bmin;
+        root.bmax = nodes[0].bmax;
+        return root.halfArea() > 0.0f ? cost / root.halfArea() : cost;
+    }
+
+private:
+    std::vector<glm::vec3> centroids_;
+    std::vector<uint64_t> keys_; // Отсортированные ключи LBVH
+
+    // Поддерево LBVH, которое строится одной задачей пула
+    struct LBVHTask {
+        int node; // Узел-заготовка под корень поддерева
+        int first;
+        int count;
+        int depth; // Глубина корня поддерева
+    };
+
+    void growFromChildren(BVHNode& node) {
+        const BVHNode& left = nodes[node.leftFirst];
+        const BVHNode& right = nodes[node.leftFirst + 1];
+        node.bmin = glm::min(left.bmin, right.bmin);
+        node.bmax = glm::max(left.bmax, right.bmax);
+    }
+
+    // Граница деления диапазона [first, first + count) отсортированных ключей:
+    // первый ключ, у которого установлен старший различающийся бит диапазона
+    int lbvhSplit(int first, int count) const {
+        const uint64_t firstKey = keys_[first];
+        const uint64_t lastKey = keys_[first + count - 1];
+        const int prefix = __builtin_clzll(firstKey ^ lastKey);
+
+        // Двоичный поиск последнего ключа с тем же префиксом длиной prefix + 1, что у первого
+        int split = first;
+        int step = count - 1;
+        do {
+            step = (step + 1) >> 1;
+            const int candidate = split + step;
+            if (candidate < first + count - 1 && __builtin_clzll(firstKey ^ keys_[candidate]) > prefix)
+                split = candidate;
+        } while (step > 1);
+        return split + 1;
+    }
+
+    void splitTop(int nodeIndex, int first, int count, int depth, int taskPrims, std::vector<LBVHTask>& tasks) {
+        if (count <= taskPrims || depth >= BVH_MAX_DEPTH) {
+            LBVHTask task = { nodeIndex, first, count, depth };
+            tasks.push_back(task);
+            return;
+        }
+        const int mid = lbvhSplit(first, count);
+        const int leftChild = static_cast<int>(nodes.size());
+        nodes.push_back(BVHNode());
+        nodes.push_back(BVHNode());
+        nodes[nodeIndex].leftFirst = leftChild;
+        nodes[nodeIndex].count = 0;
+        splitTop(leftChild, first, mid - first, depth + 1, taskPrims, tasks);
+        splitTop(leftChild + 1, mid, first + count - mid, depth + 1, taskPrims, tasks);
+    }
+
+    // Построение поддерева LBVH в local (depth — глубина узла во всём дереве);
+    // возвращает границы узла
+    AABB emitLBVH(std::vector<BVHNode>& local, int nodeIndex, int first, int count, int depth,
+                  const std::vector<AABB>& primBounds) const {
+        AABB bounds;
+        if (count <= BVH_MAX_LEAF || depth >= BVH_MAX_DEPTH) {
+            for (int i = first; i < first + count; ++i)
+                bounds.grow(primBounds[primIndices[i]]);
+            local[nodeIndex].leftFirst = first;
+            local[nodeIndex].count = count;
+        }
+        else {
+            const int mid = lbvhSplit(first, count);
+            const int leftChild = static_cast<int>(local.size());
+            local.push_back(BVHNode());
+            local.push_back(BVHNode());
+            local[nodeIndex].leftFirst = leftChild;
+            local[nodeIndex].count = 0;
+            bounds = emitLBVH(local, leftChild, first, mid - first, depth + 1, primBounds);
+            bounds.grow(emitLBVH(local, leftChild + 1, mid, first + count - mid, depth + 1, primBounds));
+        }
+        local[nodeIndex].bmin = bounds.bmin;
+        local[nodeIndex].bmax = bounds.bmax;
+        return bounds;
+    }
+
+    void makeLeaf(int nodeIndex, int first, int count) {
+        nodes[nodeIndex].leftFirst = first;
+        nodes[nodeIndex].count = count;
+    }
+
+    void subdivide(int nodeIndex, int first, int count, int depth, const std::vector<AABB>& primBounds) {
+        AABB bounds, centroidBounds;
+        for (int i = first; i < first + count; ++i) {
+            bounds.grow(primBounds[primIndices[i]]);
+            centroidBounds.grow(centroids_[primIndices[i]]);
+        }
+        nodes[nodeIndex].bmin = bounds.bmin;
+        nodes[nodeIndex].bmax = bounds.bmax;
+
+        if (count <= 1 || depth >= BVH_MAX_DEPTH) {
+            makeLeaf(nodeIndex, first, count);
+            return;
+        }
+
+        // Поиск лучшего разбиения по корзинам на всех трёх осях
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        const glm::vec3 extent = centroidBounds.bmax - centroidBounds.bmin;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            if (extent[axis] <= 0.0f)
+                continue;
+
+            AABB binBounds[BVH_BINS];
+            int binCount[BVH_BINS] = {};
+            const float scale = BVH_BINS / extent[axis];
+            for (int i = first; i < first + count; ++i) {
+                int bin = binIndex(centroids_[primIndices[i]][axis], centroidBounds.bmin[axis], scale);
+                binCount[bin]++;
+                binBounds[bin].grow(primBounds[primIndices[i]]);
+            }
+
+            // Площади и количества слева и справа от каждой границы
+            float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+            int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+            AABB leftBox, rightBox;
+            int leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BVH_BINS - 1; ++i) {
+                leftSum += binCount[i];
+                leftCount[i] = leftSum;
+                leftBox.grow(binBounds[i]);
+                leftArea[i] = leftBox.halfArea();
+
+                rightSum += binCount[BVH_BINS - 1 - i];
+                rightCount[BVH_BINS - 2 - i] = rightSum;
+                rightBox.grow(binBounds[BVH_BINS - 1 - i]);
+                rightArea[BVH_BINS - 2 - i] = rightBox.halfArea();
+            }
+
+            for (int i = 0; i < BVH_BINS - 1; ++i) {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = simdBlocks(leftCount[i]) * leftArea[i] + simdBlocks(rightCount[i]) * rightArea[i];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        const float parentArea = bounds.halfArea();
+        const float leafCost = SAH_INTERSECT_COST * simdBlocks(count);
+        const float splitCost = parentArea > 0.0f
+            ? SAH_TRAVERSAL_COST + SAH_INTERSECT_COST * bestCost / parentArea
+            : std::numeric_limits<float>::max();
+
+        int mid;
+        if (bestAxis < 0) {
+            // Все центры совпадают: делим пополам по индексу, если лист слишком велик
+            if (count <= BVH_MAX_LEAF) {
+                makeLeaf(nodeIndex, first, count);
+                return;
+            }
+            mid = first + count / 2;
+        }
+        else {
+            if (count <= BVH_MAX_LEAF && splitCost >= leafCost) {
+                makeLeaf(nodeIndex, first, count);
+                return;
+            }
+
+            const float scale = BVH_BINS / extent[bestAxis];
+            const float axisMin = centroidBounds.bmin[bestAxis];
+            int* split = std::partition(primIndices.data() + first, primIndices.data() + first + count, [&](int prim) {
+                return binIndex(centroids_[prim][bestAxis], axisMin, scale) <= bestSplit;
+            });
+            mid = static_cast<int>(split - primIndices.data());
+        }
+
+        const int leftChild = static_cast<int>(nodes.size());
+        nodes.push_back(BVHNode());
+        nodes.push_back(BVHNode());
+        nodes[nodeIndex].leftFirst = leftChild;
+        nodes[nodeIndex].count = 0;
+
+        subdivide(leftChild, first, mid - first, depth + 1, primBounds);
+        subdivide(leftChild + 1, mid, first + count - mid, depth + 1, primBounds);
+    }
+
+    static int binIndex(float value, float axisMin, float scale) {
+        return std::min(BVH_BINS - 1, static_cast<int>((value - axisMin) * scale));
+    }
+};
+
+// BVH над сферами сцены. Сферы каждого листа лежат в отдельном блоке из
+// SIMD_WIDTH ячеек, хвост блока заполнен фиктивными сферами, поэтому лист
+// проверяется одним вызовом векторного ядра.
+class SphereBVH {
+public:
+    BVH bvh;
+    std::vector<float> cx, cy, cz, radius2;
+    std::vector<int> slotSphere; // Ячейка -> индекс сферы в сцене (-1 для заполнителя)
+    std::vector<int> sphereSlot; // Индекс сферы -> ячейка
+
+    void build(const SphereArray& spheres) {
+        bvh.build(sphereBounds(spheres));
+        packLeaves(spheres);
+    }
+
+    // Быстрое перестроение (LBVH на пуле потоков) для анимированных сцен
+    void buildLBVH(const SphereArray& spheres, WorkStealingPool& pool) {
+        bvh.buildLBVH(sphereBounds(spheres), pool);
+        packLeaves(spheres);
+    }
+
+    // Сферы сдвинулись, но их число не изменилось: обновляются данные ячеек
+    // и границы узлов, топология и раскладка листов остаются прежними
+    void refit(const SphereArray& spheres) {
+        for (size_t slot = 0; slot < slotSphere.size(); ++slot) {
+            const int sphere = slotSphere[slot];
+            if (sphere < 0)
+                continue;
+            cx[slot] = spheres.centerX[sphere];
+            cy[slot] = spheres.centerY[sphere];
+            cz[slot] = spheres.centerZ[sphere];
+            radius2[slot] = spheres.radius[sphere] * spheres.radius[sphere];
+        }
+        bvh.refit([&](const BVHNode& node) {
+            AABB box;
+            for (int i = 0; i < node.count; ++i) {
+                const int sphere = slotSphere[node.leftFirst + i];
+                const glm::vec3 r(spheres.radius[sphere]);
+                box.grow(spheres.center(sphere) - r);
+                box.grow(spheres.center(sphere) + r);
+            }
+            return box;
+        });
+    }
+
+private:
+    static std::vector<AABB> sphereBounds(const SphereArray& spheres) {
+        std::vector<AABB> bounds(spheres.size());
+        for (size_t i = 0; i < spheres.size(); ++i) {
+            glm::vec3 r(spheres.radius[i]);
+            bounds[i].bmin = spheres.center(i) - r;
+            bounds[i].bmax = spheres.center(i) + r;
+        }
+        return bounds;
+    }
+
+    // Раскладка сфер листов по блокам ячеек; leftFirst листа становится номером ячейки
+    void packLeaves(const SphereArray& spheres) {
+        cx.clear();
+        cy.clear();
+        cz.clear();
+        radius2.clear();
+        slotSphere.clear();
+        sphereSlot.assign(spheres.size(), -1);
+
+        for (BVHNode& node : bvh.nodes) {
+            if (!node.isLeaf())
+                continue;
+            const int slot = static_cast<int>(slotSphere.size());
+            const int blockSize = simdBlocks(node.count) * SIMD_WIDTH;
+            for (int i = 0; i < blockSize; ++i) {
+                if (i < node.count) {
+                    const int sphere = bvh.primIndices[node.leftFirst + i];
+                    cx.push_back(spheres.centerX[sphere]);
+                    cy.push_back(spheres.centerY[sphere]);
+                    cz.push_back(spheres.centerZ[sphere]);
+                    radius2.push_back(spheres.radius[sphere] * spheres.radius[sphere]);
+                    slotSphere.push_back(sphere);
+                    sphereSlot[sphere] = slot + i;
+                }
+                else {
+                    cx.push_back(0.0f);
+                    cy.push_back(0.0f);
+                    cz.push_back(0.0f);
+                    radius2.push_back(PADDING_RADIUS2);
+                    slotSphere.push_back(-1);
+                }
+            }
+            node.leftFirst = slot;
+        }
+    }
+
+public:
+    // Ближайшее пересечение с упорядоченным обходом (сначала ближний потомок).
+    // sphereIndex — индекс сферы в сцене. Если stats задан, в него считаются
+    // выборки узлов (для замеров, в рендеринге не используется).
+    bool intersectClosest(const glm::vec3& origin, const glm::vec3& dir, float& tNearest, int& sphereIndex,
+                          NodeFetchStats* stats = nullptr) const {
+        if (bvh.nodes.empty())
+            return false;
+
+        const glm::vec3 invDir = safeInverse(dir);
+        float tEntry;
+        if (stats)
+            stats->fetch(&bvh.nodes[0]);
+        if (!intersectNode(bvh.nodes[0], origin, invDir, tNearest, tEntry))
+            return false;
+
+        struct StackEntry {
+            int node;
+            float tEntry;
+        };
+        StackEntry stack[BVH_STACK_SIZE];
+        int stackSize = 0;
+        int nodeIndex = 0;
+        bool found = false;
+
+        for (;;) {
+            const BVHNode& node = bvh.nodes[nodeIndex];
+            if (node.isLeaf()) {
+                int local = -1;
+                if (intersectSpheresClosest(origin, dir, leafLanes(node), tNearest, local)) {
+                    sphereIndex = slotSphere[node.leftFirst + local];
+                    found = true;
+                }
+            }
+            else {
+                float tLeft, tRight;
+                const int left = node.leftFirst;
+                if (stats) {
+                    stats->fetch(&bvh.nodes[left]);
+                    stats->fetch(&bvh.nodes[left + 1]);
+                }
+                bool hitLeft = intersectNode(bvh.nodes[left], origin, invDir, tNearest, tLeft);
+                bool hitRight = intersectNode(bvh.nodes[left + 1], origin, invDir, tNearest, tRight);
+                if (hitLeft && hitRight) {
+                    if (tLeft <= tRight) {
+                        stack[stackSize++] = { left + 1, tRight };
+                        nodeIndex = left;
+                    }
+                    else {
+                        stack[stackSize++] = { left, tLeft };
+                        nodeIndex = left + 1;
+                    }
+                    continue;
+                }
+                if (hitLeft || hitRight) {
+                    nodeIndex = hitLeft ? left : left + 1;
+                    continue;
+                }
+            }
+
+            // Снимаем со стека узлы, которые ещё могут содержать более близкое пересечение
+            bool next = false;
+            while (stackSize > 0) {
+                const StackEntry& entry = stack[--stackSize];
+                if (entry.tEntry < tNearest) {
+                    nodeIndex = entry.node;
+                    next = true;
+                    break;
+                }
+            }
+            if (!next)
+                return found;
+        }
+    }
+
+    // Есть ли хоть одно пересечение (теневые лучи). Сфера exclude пропускается.
+    bool intersectAny(const glm::vec3& origin, const glm::vec3& dir, int exclude, NodeFetchStats* stats = nullptr) const {
+        if (bvh.nodes.empty())
+            return false;
+
+        const glm::vec3 invDir = safeInverse(dir);
+        const float tMax = std::numeric_limits<float>::max();
+        const int excludeSlot = exclude >= 0 && exclude < static_cast<int>(sphereSlot.size()) ? sphereSlot[exclude] : -1;
+
+        int stack[BVH_STACK_SIZE];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const BVHNode& node = bvh.nodes[stack[--stackSize]];
+            float tEntry;
+            if (stats)
+                stats->fetch(&node);
+            if (!intersectNode(node, origin, invDir, tMax, tEntry))
+                continue;
+
+            if (node.isLeaf()) {
+                const int localExclude = excludeSlot - node.leftFirst;
+                if (intersectSpheresAny(origin, dir, leafLanes(node), localExclude))
+                    return true;
+            }
+            else {
+                stack[stackSize++] = node.leftFirst + 1;
+                stack[stackSize++] = node.leftFirst;
+            }
+        }
+        return false;
+    }
+
+private:
+    SphereLanes leafLanes(const BVHNode& node) const {
+        SphereLanes lanes;
+        lanes.cx = cx.data() + node.leftFirst;
+        lanes.cy = cy.data() + node.leftFirst;
+        lanes.cz = cz.data() + node.leftFirst;
+        lanes.radius2 = radius2.data() + node.leftFirst;
+        lanes.count = node.count;
+        return lanes;
+    }
+};
+
+// BVH анимированной сцены. Каждый кадр дерево либо уточняется (refit), либо
+// перестраивается через LBVH. После перестроения запоминается измеренная
+// стоимость луча; в кадрах с уточнением копится превышение над ней (время,
+// потерянное на раздувшихся узлах). Когда потери превышают время последнего
+// перестроения, следующий кадр перестраивает дерево. Сильный рост оценки SAH
+// вызывает перестроение сразу, без ожидания замеров.
+class DynamicSphereBVH {
+public:
+    enum class Update { Rebuild, Refit };
+
+    SphereBVH bvh;
+
+    // Обновление перед кадром; сферы уже на новых местах
+    Update update(const SphereArray& spheres, WorkStealingPool& pool) {
+        auto start = std::chrono::steady_clock::now();
+        Update result = Update::Refit;
+        if (rebuildPending_ || spheres.size() != bvh.sphereSlot.size()) {
+            result = Update::Rebuild;
+        }
+        else {
+            bvh.refit(spheres);
+            sahGrowth_ = baselineSah_ > 0.0f ? bvh.bvh.sahCost() / baselineSah_ : 1.0f;
+            if (sahGrowth_ > BVH_REFIT_MAX_SAH_GROWTH)
+                result = Update::Rebuild;
+        }
+
+        if (result == Update::Rebuild) {
+            bvh.buildLBVH(spheres, pool);
+            baselineSah_ = bvh.bvh.sahCost();
+            sahGrowth_ = 1.0f;
+            baselineCost_ = -1.0;
+            excessMs_ = 0.0;
+            rebuildPending_ = false;
+            ++rebuilds_;
+        }
+        else {
+            ++refits_;
+        }
+
+        lastUpdate_ = result;
+        lastUpdateMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (result == Update::Rebuild)
+            rebuildMs_ = lastUpdateMs_;
+        return result;
+    }
+
+    // Поколение дерева: растёт с каждым перестроением. Замер времени кадра
+    // помечается поколением дерева, с которым кадр рисовался.
+    size_t generation() const { return rebuilds_; }
+
+    // Измеренное время трассировки кадра и число лучей (или пикселей); generation —
+    // поколение дерева кадра. Замеры, пришедшие с запаздыванием от дерева до
+    // последнего перестроения, отбрасываются: иначе они стали бы опорными.
+    void reportTraversal(double ms, uint64_t rays, size_t generation) {
+        if (rays == 0 || generation != rebuilds_)
+            return;
+        const double cost = ms / static_cast<double>(rays);
+        if (baselineCost_ < 0.0) {
+            baselineCost_ = cost; // Первый замер после перестроения
+            return;
+        }
+        // Знаковое накопление: случайные колебания замеров взаимно гасятся
+        excessMs_ = std::max(0.0, excessMs_ + (cost - baselineCost_) * static_cast<double>(rays));
+        if (excessMs_ > rebuildMs_)
+            rebuildPending_ = true;
+    }
+
+    Update lastUpdate() const { return lastUpdate_; }
+    double lastUpdateMs() const { return lastUpdateMs_; }
+    float sahGrowth() const { return sahGrowth_; }
+    size_t rebuilds() const { return rebuilds_; }
+    size_t refits() const { return refits_; }
+
+private:
+    bool rebuildPending_ = true;
+    float baselineSah_ = 0.0f;  // Оценка SAH сразу после перестроения
+    float sahGrowth_ = 1.0f;
+    double baselineCost_ = -1.0; // мс на луч сразу после перестроения (-1 — ещё не измерено)
+    double excessMs_ = 0.0;      // Накопленные потери времени на уточнённом дереве
+    double rebuildMs_ = 0.0;
+    double lastUpdateMs_ = 0.0;
+    Update lastUpdate_ = Update::Rebuild;
+    size_t rebuilds_ = 0;
+    size_t refits_ = 0;
+};
@@ -0,0 +1,94 @@
+// compress_main.cpp
+// Офлайн-сжатие текстур в блочные форматы GPU (texture_compress.h): для
+// каждого изображения строится mip-цепочка RGBA8 (или берётся из кэша),
+// сжимается в BC1 и/или ETC2 и записывается в кэш текстур (texture_cache.h)
+// рядом с записью RGBA8. main.cpp при следующем запуске возьмёт сжатую
+// запись, если GPU понимает её формат, иначе — RGBA8.
+
+#include "texture.h"
+#include "texture_compress.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void printUsage(const char* program) {
+    std::cerr << "Использование: " << program << " image1.png [image2.jpg ...]"
+              << " [--format bc1|etc2|all] [--texture-cache DIR]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> inputs;
+    std::vector<TextureFormat> formats = { TextureFormat::BC1, TextureFormat::ETC2 };
+    std::string textureCacheDir = TEXTURE_CACHE_DIR;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const std::string name = argv[++i];
+            if (name == "bc1")
+                formats = { TextureFormat::BC1 };
+            else if (name == "etc2")
+                formats = { TextureFormat::ETC2 };
+            else if (name != "all") {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--texture-cache") == 0 && i + 1 < argc)
+            textureCacheDir = argv[++i];
+        else if (argv[i][0] == '-') {
+            printUsage(argv[0]);
+            return -1;
+        }
+        else
+            inputs.push_back(argv[i]);
+    }
+    if (inputs.empty() || textureCacheDir.empty()) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    // Декодирование и mip-цепочки — параллельно по файлам; записи RGBA8 попадают в кэш
+    TextureLoader loader(0, true, textureCacheDir);
+    for (const std::string& path : inputs)
+        loader.request(path);
+    loader.wait();
+    std::vector<LoadedTexture> loaded;
+    loader.takeReady(loaded);
+
+    // Сжатие одной текстуры — параллельно по строкам блоков
+    const unsigned hardware = std::thread::hardware_concurrency();
+    WorkStealingPool pool(hardware > 0 ? hardware : 1);
+    int failed = 0;
+    std::cout << std::fixed << std::setprecision(1);
+    for (const LoadedTexture& item : loaded) {
+        std::vector<uint8_t> bytes;
+        if (!item.ok || !readFileBytes(item.path, bytes)) {
+            std::cerr << "Не удалось загрузить текстуру " << item.path << ": " << item.error << std::endl;
+            ++failed;
+            continue;
+        }
+        const uint64_t hash = hashTextureSource(bytes.data(), bytes.size());
+        const size_t rgbaBytes = item.texture.levelOffset(item.texture.levels);
+        std::cout << item.path << ": " << item.texture.width << "x" << item.texture.height << ", "
+                  << item.texture.levels << " уровней, RGBA8 " << rgbaBytes / 1024 << " КБ" << std::endl;
+        for (TextureFormat format : formats) {
+            const auto start = std::chrono::steady_clock::now();
+            const Texture compressed = compressTexture(item.texture, format, &pool);
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            const size_t compressedBytes = compressed.levelOffset(compressed.levels);
+            if (!writeCachedTexture(textureCacheDir, hash, bytes.size(), compressed)) {
+                std::cerr << "Не удалось записать " << textureCachePath(textureCacheDir, hash, format) << std::endl;
+                ++failed;
+                continue;
+            }
+            std::cout << "  " << textureFormatName(format) << ": " << compressedBytes / 1024 << " КБ (в "
+                      << static_cast<double>(rgbaBytes) / compressedBytes << " раз меньше), PSNR "
+                      << compressedPSNR(item.texture, compressed) << " дБ, " << ms << " мс" << std::endl;
+        }
+    }
+    return failed == 0 ? 0 : -1;
+}
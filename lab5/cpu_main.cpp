@@ -0,0 +1,283 @@
+// cpu_main.cpp
+// Headless-запуск CPU-трассировщика (без окна и GPU)
+
+#include "image_writer.h"
+#include "raytracer.h"
+#include "texture.h"
+#include "texture_atlas.h"
+#include "wavefront.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Повторы текстуры пола на единицу длины и текстуры сферы на оборот
+const float FLOOR_TEXTURE_SCALE = 0.5f;
+const float SPHERE_TEXTURE_SCALE = 1.0f;
+
+// Время рендеринга кадра в миллисекундах
+double timeRender(const Scene& scene, const SceneBVH& bvh, const RenderSettings& settings, bool wavefront,
+                  Framebuffer& framebuffer, unsigned threads, RayCounters* counters = nullptr,
+                  AdaptiveStats* adaptiveStats = nullptr) {
+    WorkStealingPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    if (wavefront)
+        renderImageWavefront(scene, bvh, settings, framebuffer, pool, counters);
+    else
+        renderImage(scene, bvh, settings, framebuffer, pool, counters, adaptiveStats);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Использование: " << program
+              << " [--width W] [--height H] [--spp N] [--depth D] [--integrator whitted|path]"
+              << " [--adaptive THRESHOLD] [--max-spp N] [--heatmap samples.png] [--ray-order pixel|queued|binned] [--wavefront]"
+              << " [--cubes N] [--mesh model.obj] [--floor-texture image.png] [--sphere-texture image.jpg]"
+              << " [--cube-texture image.png ...] [--texture-cache DIR] [--no-texture-cache]"
+              << " [--threads N] [--scaling] [--out frame.ppm|frame.png]"
+              << std::endl;
+    if (!PNG_COMPRESSED)
+        std::cerr << "PNG записывается без сжатия (сборка без zlib)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool scaling = false;
+    bool wavefront = false;
+    std::string outPath = "frame.ppm";
+    std::string heatmapPath;
+    size_t cubes = 0;
+    std::string meshPath;
+    std::string floorTexturePath, sphereTexturePath;
+    std::vector<std::string> cubeTexturePaths; // Упаковываются в один атлас
+    std::string textureCacheDir = TEXTURE_CACHE_DIR;
+    RenderSettings settings;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        else if (std::strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+            settings.width = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+            settings.height = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--spp") == 0 && i + 1 < argc)
+            settings.samplesPerPixel = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            settings.maxDepth = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--integrator") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (std::strcmp(name, "path") == 0)
+                settings.integrator = Integrator::Path;
+            else if (std::strcmp(name, "whitted") == 0)
+                settings.integrator = Integrator::Whitted;
+            else {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc)
+            settings.adaptiveThreshold = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        else if (std::strcmp(argv[i], "--max-spp") == 0 && i + 1 < argc)
+            settings.adaptiveMaxSamples = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc)
+            heatmapPath = argv[++i];
+        else if (std::strcmp(argv[i], "--ray-order") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (std::strcmp(name, "pixel") == 0)
+                settings.rayOrder = RayOrder::Pixel;
+            else if (std::strcmp(name, "queued") == 0)
+                settings.rayOrder = RayOrder::Queued;
+            else if (std::strcmp(name, "binned") == 0)
+                settings.rayOrder = RayOrder::Binned;
+            else {
+                printUsage(argv[0]);
+                return -1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--wavefront") == 0)
+            wavefront = true;
+        else if (std::strcmp(argv[i], "--cubes") == 0 && i + 1 < argc)
+            cubes = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        else if (std::strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+            meshPath = argv[++i];
+        else if (std::strcmp(argv[i], "--floor-texture") == 0 && i + 1 < argc)
+            floorTexturePath = argv[++i];
+        else if (std::strcmp(argv[i], "--sphere-texture") == 0 && i + 1 < argc)
+            sphereTexturePath = argv[++i];
+        else if (std::strcmp(argv[i], "--cube-texture") == 0 && i + 1 < argc)
+            cubeTexturePaths.push_back(argv[++i]);
+        else if (std::strcmp(argv[i], "--texture-cache") == 0 && i + 1 < argc)
+            textureCacheDir = argv[++i];
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            textureCacheDir.clear();
+        else if (std::strcmp(argv[i], "--scaling") == 0)
+            scaling = true;
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            outPath = argv[++i];
+        else {
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (wavefront && (settings.integrator != Integrator::Whitted || settings.adaptiveThreshold > 0.0f)) {
+        std::cerr << "Волновой конвейер (--wavefront) поддерживает только метод Уиттеда без адаптивной выборки" << std::endl;
+        return -1;
+    }
+    if (settings.rayOrder != RayOrder::Pixel && (settings.integrator != Integrator::Whitted || settings.adaptiveThreshold > 0.0f)) {
+        std::cerr << "Очереди лучей (--ray-order queued|binned) поддерживают только метод Уиттеда без адаптивной выборки"
+                  << std::endl;
+        return -1;
+    }
+    // Бюджет адаптивного кадра — width * height * spp выборок, а первый раунд
+    // тратит по ADAPTIVE_MIN_SAMPLES на пиксель: при меньшем spp уточнять нечем
+    if (settings.adaptiveThreshold > 0.0f && settings.samplesPerPixel <= ADAPTIVE_MIN_SAMPLES) {
+        std::cerr << "Адаптивной выборке (--adaptive) нужен бюджет --spp больше " << ADAPTIVE_MIN_SAMPLES
+                  << " выборок на пиксель" << std::endl;
+        return -1;
+    }
+
+    // Текстуры декодируются (или берутся из кэша) в фоне, пока строятся сцена и BVH
+    TextureLoader textureLoader(0, false, textureCacheDir);
+    const uint32_t noTexture = UINT32_MAX;
+    const uint32_t floorTextureId = floorTexturePath.empty() ? noTexture : textureLoader.request(floorTexturePath);
+    const uint32_t sphereTextureId = sphereTexturePath.empty() ? noTexture : textureLoader.request(sphereTexturePath);
+    std::vector<uint32_t> cubeTextureIds;
+    for (const std::string& path : cubeTexturePaths)
+        cubeTextureIds.push_back(textureLoader.request(path));
+
+    Scene scene = makeDefaultScene();
+    Framebuffer framebuffer;
+
+    // Экземпляры куба из lab4 (или загруженной сетки) на полу
+    if (cubes > 0) {
+        TriangleMesh mesh = makeCubeMesh();
+        if (!meshPath.empty()) {
+            if (!loadObjMesh(meshPath, mesh)) {
+                std::cerr << "Не удалось загрузить сетку " << meshPath << std::endl;
+                return -1;
+            }
+            normalizeMesh(mesh);
+        }
+        addMeshInstances(scene, mesh, cubes);
+    }
+
+    // BVH строится один раз для статичной сцены
+    SceneBVH bvh;
+    bvh.build(scene);
+
+    // Текстура пола — материалу плоскости, текстура сфер — всем материалам сфер,
+    // текстуры кубов — в атлас
+    textureLoader.wait();
+    std::vector<LoadedTexture> loaded;
+    textureLoader.takeReady(loaded);
+    std::vector<Texture> cubeTextures(cubeTextureIds.size());
+    for (LoadedTexture& item : loaded) {
+        if (!item.ok) {
+            std::cerr << "Не удалось загрузить текстуру " << item.path << ": " << item.error << std::endl;
+            return -1;
+        }
+        std::cout << "Текстура " << item.path << ": " << item.texture.width << "x" << item.texture.height
+                  << (item.cached ? " (из кэша)" : "") << std::endl;
+        const auto cube = std::find(cubeTextureIds.begin(), cubeTextureIds.end(), item.id);
+        if (cube != cubeTextureIds.end()) {
+            cubeTextures[cube - cubeTextureIds.begin()] = std::move(item.texture);
+            continue;
+        }
+        const int32_t texture = addTexture(scene, std::move(item.texture));
+        if (item.id == floorTextureId)
+            setMaterialTexture(scene, scene.floorPlane.materialIndex, texture, FLOOR_TEXTURE_SCALE);
+        if (item.id == sphereTextureId) {
+            const std::set<uint32_t> sphereMaterials(scene.spheres.materialIndex.begin(), scene.spheres.materialIndex.end());
+            for (uint32_t material : sphereMaterials)
+                setMaterialTexture(scene, material, texture, SPHERE_TEXTURE_SCALE);
+        }
+    }
+    if (!cubeTextures.empty()) {
+        // Один атлас на все кубы: экземпляр i получает текстуру i % N — копию
+        // своего материала с областью атласа (одинаковые копии объединяет MaterialTable)
+        TextureAtlas atlas;
+        std::string error;
+        if (!packTextureAtlas(cubeTextures, ATLAS_PADDING, ATLAS_MAX_SIZE, atlas, error)) {
+            std::cerr << "Не удалось собрать атлас: " << error << std::endl;
+            return -1;
+        }
+        std::cout << "Атлас " << atlas.image.width << "x" << atlas.image.height << ": " << cubeTextures.size() << " текстур" << std::endl;
+        const int32_t texture = addTexture(scene, std::move(atlas.image));
+        for (size_t i = 0; i < scene.instances.size(); ++i) {
+            Material material = scene.materials[scene.instances[i].materialIndex];
+            material.texture = texture;
+            material.textureRegion = atlas.regions[i % atlas.regions.size()].uv;
+            scene.instances[i].materialIndex = scene.materials.add(material);
+        }
+        bvh.instances.updateMaterials(scene.instances);
+    }
+    if (!scene.instances.empty()) {
+        std::cout << "Экземпляров сеток: " << bvh.instances.instanceCount() << ", треугольников в сетках: "
+                  << scene.meshes.back().triangleCount() << ", память TLAS/BLAS: " << bvh.instances.memoryBytes() / 1024.0
+                  << " КБ (с копиями сеток было бы " << bvh.instances.flattenedMemoryBytes() / 1024.0 << " КБ)" << std::endl;
+    }
+
+    if (scaling) {
+        // Замер масштабирования: 1, 2, 4, ... потоков
+        double baseTime = 0.0;
+        for (unsigned count = 1; count <= threads; count *= 2) {
+            double ms = timeRender(scene, bvh, settings, wavefront, framebuffer, count);
+            if (count == 1)
+                baseTime = ms;
+            std::cout << "Потоков: " << count << ", время: " << ms << " мс, ускорение: " << baseTime / ms << std::endl;
+        }
+    }
+
+    // Запись идёт в фоновом потоке, пока печатается статистика
+    BackgroundImageWriter writer;
+
+    auto wallStart = std::chrono::steady_clock::now();
+    RayCounters counters;
+    AdaptiveStats adaptiveStats;
+    double ms = timeRender(scene, bvh, settings, wavefront, framebuffer, threads, &counters, &adaptiveStats);
+    writer.submit(outPath, settings.width, settings.height, toRGB8(framebuffer));
+    const bool adaptive = settings.adaptiveThreshold > 0.0f;
+    if (adaptive && !heatmapPath.empty())
+        writer.submit(heatmapPath, settings.width, settings.height, samplesHeatmapRGB8(adaptiveStats, settings.width, settings.height));
+
+    const double seconds = ms * 1e-3;
+    std::cout << "Кадр " << settings.width << "x" << settings.height << ", выборок на пиксель: " << settings.samplesPerPixel
+              << ", глубина: " << settings.maxDepth << " (" << threads << " потоков): " << ms << " мс" << std::endl;
+    const double pixels = static_cast<double>(settings.width) * settings.height;
+    const double samples = adaptive ? static_cast<double>(adaptiveStats.samples) : pixels * settings.samplesPerPixel;
+    if (adaptive) {
+        const auto range = std::minmax_element(adaptiveStats.tileSamples.begin(), adaptiveStats.tileSamples.end());
+        std::cout << "Адаптивная выборка: порог " << settings.adaptiveThreshold << ", раундов " << adaptiveStats.rounds
+                  << ", выборок на пиксель в среднем " << samples / pixels << " (от " << *range.first << " до " << *range.second
+                  << ", предел " << adaptiveStats.maxSamples << "), сошлось тайлов " << adaptiveStats.convergedTiles << " из "
+                  << adaptiveStats.tileSamples.size() << std::endl;
+    }
+    std::string order;
+    if (wavefront)
+        order = settings.rayOrder == RayOrder::Binned ? " (волновой конвейер, корзины)" : " (волновой конвейер)";
+    else if (settings.rayOrder != RayOrder::Pixel)
+        order = settings.rayOrder == RayOrder::Queued ? " (очереди лучей по отскокам)" : " (очереди лучей по отскокам, корзины)";
+    std::cout << "Метод: " << (settings.integrator == Integrator::Path ? "трассировка путей" : "Уиттед") << order
+              << ", лучей на выборку: " << counters.total() / samples << std::endl;
+    std::cout << "Лучей: " << counters.total() << " (первичных " << counters.primary << ", теневых " << counters.shadow
+              << ", отражённых " << counters.reflection << "), " << counters.total() / seconds / 1e6 << " млн лучей/с" << std::endl;
+
+    if (!writer.finish())
+        return -1;
+    auto wallEnd = std::chrono::steady_clock::now();
+    std::cout << "Изображение сохранено: " << outPath << std::endl;
+    if (adaptive && !heatmapPath.empty())
+        std::cout << "Карта числа выборок сохранена: " << heatmapPath << std::endl;
+    std::cout << "Общее время (рендеринг и запись): "
+              << std::chrono::duration<double, std::milli>(wallEnd - wallStart).count() << " мс" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+// image_writer.h
+// Запись изображений RGB8 в PPM (P6) и PNG, а также фоновый поток записи,
+// чтобы рендеринг следующего кадра не ждал диска.
+//
+// В lab5 из stb есть только декодер (stb_image.h), поэтому PNG кодируется здесь.
+// При сборке с RT_USE_ZLIB (скрипты сборки включают его, если найден zlib.h;
+// нужна -lz) данные сжимаются compress2. Без zlib поток состоит из несжатых
+// (stored) блоков deflate: файл получается даже чуть крупнее PPM.
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef RT_USE_ZLIB
+#include <zlib.h>
+#endif
+
+// Сжимается ли PNG (для справки программ)
+#ifdef RT_USE_ZLIB
+const bool PNG_COMPRESSED = true;
+#else
+const bool PNG_COMPRESSED = false;
+#endif
+
+// Запись изображения в формате PPM (P6)
+inline bool writePPM(const char* path, int width, int height, const std::vector<uint8_t>& rgb) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+    return static_cast<bool>(file);
+}
+
+namespace png_detail {
+
+struct CrcTable {
+    uint32_t values[256];
+
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            values[n] = c;
+        }
+    }
+};
+
+inline uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const CrcTable table; // Потокобезопасная инициализация (C++11)
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline void putBigEndian32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Блок PNG: длина, тип, данные, CRC32 по типу и данным
+inline void putChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    putBigEndian32(out, static_cast<uint32_t>(data.size()));
+    const size_t typeStart = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putBigEndian32(out, crc32(&out[typeStart], out.size() - typeStart));
+}
+
+// Поток zlib из несжатых блоков deflate (не более 65535 байт в блоке)
+inline std::vector<uint8_t> zlibStored(const std::vector<uint8_t>& data) {
+    const size_t maxBlock = 65535;
+    std::vector<uint8_t> out;
+    out.reserve(data.size() + data.size() / maxBlock * 5 + 16);
+    out.push_back(0x78); // CMF: deflate, окно 32 КБ
+    out.push_back(0x01); // FLG: без словаря, контрольная сумма заголовка
+
+    size_t offset = 0;
+    do {
+        const size_t block = std::min(maxBlock, data.size() - offset);
+        const bool last = offset + block == data.size();
+        out.push_back(last ? 1 : 0); // BFINAL, BTYPE = 00
+        out.push_back(static_cast<uint8_t>(block & 0xFF));
+        out.push_back(static_cast<uint8_t>(block >> 8));
+        out.push_back(static_cast<uint8_t>(~block & 0xFF));
+        out.push_back(static_cast<uint8_t>((~block >> 8) & 0xFF));
+        out.insert(out.end(), data.begin() + offset, data.begin() + offset + block);
+        offset += block;
+    } while (offset < data.size());
+
+    // Adler-32 несжатых данных
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBigEndian32(out, (b << 16) | a);
+    return out;
+}
+
+// Поток zlib для IDAT: compress2, если собрано с zlib, иначе несжатые блоки
+inline std::vector<uint8_t> zlibStream(const std::vector<uint8_t>& data) {
+#ifdef RT_USE_ZLIB
+    uLongf size = compressBound(static_cast<uLong>(data.size()));
+    std::vector<uint8_t> out(size);
+    if (compress2(out.data(), &size, data.data(), static_cast<uLong>(data.size()), Z_DEFAULT_COMPRESSION) == Z_OK) {
+        out.resize(size);
+        return out;
+    }
+#endif
+    return zlibStored(data);
+}
+
+} // namespace png_detail
+
+// Запись изображения в формате PNG (RGB или, при channels == 4, RGBA; 8 бит на канал)
+inline bool writePNG(const char* path, int width, int height, const std::vector<uint8_t>& rgb, int channels = 3) {
+    const size_t rowBytes = static_cast<size_t>(width) * channels;
+
+    // Каждая строка начинается с байта типа фильтра (0 — без фильтра)
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * rowBytes, rgb.begin() + (y + 1) * rowBytes);
+    }
+
+    std::vector<uint8_t> header;
+    png_detail::putBigEndian32(header, static_cast<uint32_t>(width));
+    png_detail::putBigEndian32(header, static_cast<uint32_t>(height));
+    header.push_back(8); // Бит на канал
+    header.push_back(channels == 4 ? 6 : 2); // Тип цвета: RGBA или RGB
+    header.push_back(0); // Сжатие deflate
+    header.push_back(0); // Стандартные фильтры
+    header.push_back(0); // Без чересстрочности
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> png(signature, signature + 8);
+    png_detail::putChunk(png, "IHDR", header);
+    png_detail::putChunk(png, "IDAT", png_detail::zlibStream(raw));
+    png_detail::putChunk(png, "IEND", std::vector<uint8_t>());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    file.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+    return static_cast<bool>(file);
+}
+
+// Формат выбирается по расширению: ".png" — PNG, иначе PPM
+inline bool writeImage(const std::string& path, int width, int height, const std::vector<uint8_t>& rgb) {
+    const bool png = path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0;
+    return png ? writePNG(path.c_str(), width, height, rgb) : writePPM(path.c_str(), width, height, rgb);
+}
+
+// Фоновый поток записи: submit() забирает изображение и сразу возвращается,
+// файлы пишутся по очереди в отдельном потоке. finish() дожидается записи всех
+// файлов и возвращает false, если хотя бы один записать не удалось.
+class BackgroundImageWriter {
+public:
+    BackgroundImageWriter() : thread_(&BackgroundImageWriter::run, this) {}
+
+    ~BackgroundImageWriter() { finish(); }
+
+    BackgroundImageWriter(const BackgroundImageWriter&) = delete;
+    BackgroundImageWriter& operator=(const BackgroundImageWriter&) = delete;
+
+    void submit(const std::string& path, int width, int height, std::vector<uint8_t> rgb) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Job job;
+            job.path = path;
+            job.width = width;
+            job.height = height;
+            job.rgb.swap(rgb);
+            jobs_.push_back(std::move(job));
+        }
+        wake_.notify_one();
+    }
+
+    bool finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        if (thread_.joinable())
+            thread_.join();
+        return !failed_;
+    }
+
+private:
+    struct Job {
+        std::string path;
+        int width;
+        int height;
+        std::vector<uint8_t> rgb;
+    };
+
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return; // stop_ и очередь пуста
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+
+            if (!writeImage(job.path, job.width, job.height, job.rgb)) {
+                std::cerr << "Не удалось записать " << job.path << std::endl;
+                failed_ = true;
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job> jobs_;
+    bool stop_ = false;
+    bool failed_ = false; // Читается только после join
+    std::thread thread_;
+};
@@ -0,0 +1,304 @@
+// instancing.h
+// Двухуровневая BVH для экземпляров треугольных сеток. Нижний уровень (BLAS)
+// строится один раз на сетку в её локальных координатах, верхний (TLAS) — по
+// мировым AABB экземпляров. На границе экземпляра луч переводится в локальные
+// координаты сетки обратной матрицей экземпляра; направление не нормируется,
+// поэтому параметр t пересечения один и тот же в обеих системах координат.
+// Треугольники не копируются: память растёт с числом экземпляров (матрица и
+// индексы), а не как треугольники, умноженные на экземпляры.
+// Треугольники листа BLAS проверяются одним вызовом векторного ядра из
+// simd_triangle.h по заранее посчитанным рёбрам.
+
+#pragma once
+
+#include "bvh.h"
+#include "scene.h"
+#include "simd_triangle.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Упорядоченный обход BVH для ближайшего пересечения: сначала ближний потомок,
+// узлы дальше найденного пересечения отбрасываются. leaf(first, count) проверяет
+// примитивы листа и уменьшает tNearest; возвращает true при попадании.
+template <class LeafTest>
+bool traverseClosest(const BVH& bvh, const glm::vec3& origin, const glm::vec3& invDir, float& tNearest, const LeafTest& leaf) {
+    if (bvh.nodes.empty())
+        return false;
+    float tEntry;
+    if (!intersectNode(bvh.nodes[0], origin, invDir, tNearest, tEntry))
+        return false;
+
+    struct StackEntry {
+        int node;
+        float tEntry;
+    };
+    StackEntry stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    bool found = false;
+
+    for (;;) {
+        const BVHNode& node = bvh.nodes[nodeIndex];
+        if (node.isLeaf()) {
+            if (leaf(node.leftFirst, node.count))
+                found = true;
+        }
+        else {
+            float tLeft, tRight;
+            const int left = node.leftFirst;
+            bool hitLeft = intersectNode(bvh.nodes[left], origin, invDir, tNearest, tLeft);
+            bool hitRight = intersectNode(bvh.nodes[left + 1], origin, invDir, tNearest, tRight);
+            if (hitLeft && hitRight) {
+                const bool leftFirst = tLeft <= tRight;
+                stack[stackSize++] = { leftFirst ? left + 1 : left, leftFirst ? tRight : tLeft };
+                nodeIndex = leftFirst ? left : left + 1;
+                continue;
+            }
+            if (hitLeft || hitRight) {
+                nodeIndex = hitLeft ? left : left + 1;
+                continue;
+            }
+        }
+
+        bool next = false;
+        while (stackSize > 0) {
+            const StackEntry& entry = stack[--stackSize];
+            if (entry.tEntry < tNearest) {
+                nodeIndex = entry.node;
+                next = true;
+                break;
+            }
+        }
+        if (!next)
+            return found;
+    }
+}
+
+// Обход BVH до первого попадания (теневые лучи)
+template <class LeafTest>
+bool traverseAny(const BVH& bvh, const glm::vec3& origin, const glm::vec3& invDir, const LeafTest& leaf) {
+    if (bvh.nodes.empty())
+        return false;
+    const float tMax = std::numeric_limits<float>::max();
+    int stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BVHNode& node = bvh.nodes[stack[--stackSize]];
+        float tEntry;
+        if (!intersectNode(node, origin, invDir, tMax, tEntry))
+            continue;
+        if (node.isLeaf()) {
+            if (leaf(node.leftFirst, node.count))
+                return true;
+        }
+        else {
+            stack[stackSize++] = node.leftFirst + 1;
+            stack[stackSize++] = node.leftFirst;
+        }
+    }
+    return false;
+}
+
+// Попадание в экземпляр сетки
+struct MeshHit {
+    int instance = -1;
+    int triangle = -1; // Ячейка треугольника в упакованных листах BLAS
+};
+
+class InstanceBVH {
+public:
+    void build(const std::vector<TriangleMesh>& meshes, const std::vector<MeshInstance>& instances) {
+        blas_.clear();
+        instances_.clear();
+        tlas_ = BVH();
+
+        // Нижний уровень: BVH каждой сетки и её треугольники, упакованные по листам
+        blas_.resize(meshes.size());
+        for (size_t m = 0; m < meshes.size(); ++m) {
+            const TriangleMesh& mesh = meshes[m];
+            MeshBLAS& blas = blas_[m];
+            std::vector<AABB> bounds(mesh.triangleCount());
+            for (size_t i = 0; i < bounds.size(); ++i) {
+                bounds[i].grow(mesh.positions[3 * i]);
+                bounds[i].grow(mesh.positions[3 * i + 1]);
+                bounds[i].grow(mesh.positions[3 * i + 2]);
+            }
+            blas.bvh.build(bounds);
+            packLeaves(mesh, blas);
+            if (!blas.bvh.nodes.empty()) {
+                blas.bounds.bmin = blas.bvh.nodes[0].bmin;
+                blas.bounds.bmax = blas.bvh.nodes[0].bmax;
+            }
+        }
+
+        // Верхний уровень: мировые AABB экземпляров (восемь углов AABB сетки)
+        std::vector<AABB> bounds;
+        bounds.reserve(instances.size());
+        instances_.reserve(instances.size());
+        for (const MeshInstance& source : instances) {
+            const AABB& local = blas_[source.mesh].bounds;
+            if (local.empty())
+                continue;
+            Instance instance;
+            instance.worldToObject = glm::inverse(source.transform);
+            instance.normalMatrix = glm::transpose(glm::mat3(instance.worldToObject));
+            instance.mesh = source.mesh;
+            instance.materialIndex = source.materialIndex;
+            instances_.push_back(instance);
+
+            AABB world;
+            for (int corner = 0; corner < 8; ++corner) {
+                const glm::vec3 p((corner & 1) ? local.bmax.x : local.bmin.x, (corner & 2) ? local.bmax.y : local.bmin.y,
+                                  (corner & 4) ? local.bmax.z : local.bmin.z);
+                world.grow(glm::vec3(source.transform * glm::vec4(p, 1.0f)));
+            }
+            bounds.push_back(world);
+        }
+        tlas_.build(bounds);
+    }
+
+    bool empty() const { return instances_.empty(); }
+    size_t instanceCount() const { return instances_.size(); }
+
+    // Ближайшее пересечение с экземплярами на отрезке [0, tNearest)
+    bool intersectClosest(const glm::vec3& origin, const glm::vec3& dir, float& tNearest, MeshHit& hit) const {
+        return traverseClosest(tlas_, origin, safeInverse(dir), tNearest, [&](int first, int count) {
+            bool found = false;
+            for (int i = first; i < first + count; ++i) {
+                const int instanceIndex = tlas_.primIndices[i];
+                const Instance& instance = instances_[instanceIndex];
+                const MeshBLAS& blas = blas_[instance.mesh];
+                const glm::vec3 localOrigin(instance.worldToObject * glm::vec4(origin, 1.0f));
+                const glm::vec3 localDir(instance.worldToObject * glm::vec4(dir, 0.0f));
+                found |= traverseClosest(blas.bvh, localOrigin, safeInverse(localDir), tNearest, [&](int slot, int triCount) {
+                    int local = -1;
+                    if (!intersectTrianglesClosest(localOrigin, localDir, blas.triangles.lanes(slot, triCount), tNearest, local))
+                        return false;
+                    hit.instance = instanceIndex;
+                    hit.triangle = slot + local;
+                    return true;
+                });
+            }
+            return found;
+        });
+    }
+
+    // Есть ли на луче хоть один треугольник (теневые лучи)
+    bool intersectAny(const glm::vec3& origin, const glm::vec3& dir) const {
+        return traverseAny(tlas_, origin, safeInverse(dir), [&](int first, int count) {
+            for (int i = first; i < first + count; ++i) {
+                const Instance& instance = instances_[tlas_.primIndices[i]];
+                const MeshBLAS& blas = blas_[instance.mesh];
+                const glm::vec3 localOrigin(instance.worldToObject * glm::vec4(origin, 1.0f));
+                const glm::vec3 localDir(instance.worldToObject * glm::vec4(dir, 0.0f));
+                const bool occluded = traverseAny(blas.bvh, localOrigin, safeInverse(localDir), [&](int slot, int triCount) {
+                    return intersectTrianglesAny(localOrigin, localDir, blas.triangles.lanes(slot, triCount));
+                });
+                if (occluded)
+                    return true;
+            }
+            return false;
+        });
+    }
+
+    // Нормаль треугольника в мировых координатах, развёрнутая навстречу лучу
+    glm::vec3 normal(const MeshHit& hit, const glm::vec3& rayDir) const {
+        const Instance& instance = instances_[hit.instance];
+        const MeshBLAS& blas = blas_[instance.mesh];
+        const glm::vec3 local = glm::cross(blas.triangles.edge1(hit.triangle), blas.triangles.edge2(hit.triangle));
+        glm::vec3 world = glm::normalize(instance.normalMatrix * local);
+        return glm::dot(world, rayDir) > 0.0f ? -world : world;
+    }
+
+    uint32_t materialIndex(const MeshHit& hit) const { return instances_[hit.instance].materialIndex; }
+
+    // Точка попадания и (ненормированная) нормаль треугольника в локальных
+    // координатах сетки — для текстурных координат
+    glm::vec3 localPoint(const MeshHit& hit, const glm::vec3& worldPoint) const {
+        return glm::vec3(instances_[hit.instance].worldToObject * glm::vec4(worldPoint, 1.0f));
+    }
+
+    glm::vec3 localNormal(const MeshHit& hit) const {
+        const MeshBLAS& blas = blas_[instances_[hit.instance].mesh];
+        return glm::cross(blas.triangles.edge1(hit.triangle), blas.triangles.edge2(hit.triangle));
+    }
+
+    // Новые материалы экземпляров без перестройки (дерево от них не зависит),
+    // например когда текстуры догрузились после build()
+    void updateMaterials(const std::vector<MeshInstance>& instances) {
+        size_t index = 0;
+        for (const MeshInstance& source : instances) {
+            if (!blas_[source.mesh].bounds.empty()) // Как в build(): пустые сетки пропущены
+                instances_[index++].materialIndex = source.materialIndex;
+        }
+    }
+
+    // Память структуры: треугольники и BLAS считаются один раз на сетку
+    size_t memoryBytes() const {
+        size_t bytes = tlas_.nodes.size() * sizeof(BVHNode) + tlas_.primIndices.size() * sizeof(int) +
+                       instances_.size() * sizeof(Instance);
+        for (const MeshBLAS& blas : blas_)
+            bytes += blas.bvh.nodes.size() * sizeof(BVHNode) + blas.bvh.primIndices.size() * sizeof(int) +
+                     9 * blas.triangles.size() * sizeof(float);
+        return bytes;
+    }
+
+    // Память, если бы треугольники и BLAS каждого экземпляра хранились отдельно
+    size_t flattenedMemoryBytes() const {
+        size_t bytes = tlas_.nodes.size() * sizeof(BVHNode) + tlas_.primIndices.size() * sizeof(int);
+        for (const Instance& instance : instances_) {
+            const MeshBLAS& blas = blas_[instance.mesh];
+            bytes += blas.bvh.nodes.size() * sizeof(BVHNode) + blas.bvh.primIndices.size() * sizeof(int) +
+                     9 * blas.triangles.size() * sizeof(float);
+        }
+        return bytes;
+    }
+
+private:
+    struct MeshBLAS {
+        BVH bvh;
+        PackedTriangles triangles; // v0 и рёбра, блок из SIMD_WIDTH ячеек на лист
+        AABB bounds;               // Границы сетки в локальных координатах
+    };
+
+    struct Instance {
+        glm::mat4 worldToObject;
+        glm::mat3 normalMatrix; // Транспонированная обратная матрица (для нормалей)
+        uint32_t mesh;
+        uint32_t materialIndex;
+    };
+
+    // Треугольники каждого листа — в отдельный блок ячеек с заполнителями в хвосте,
+    // leftFirst листа становится номером первой ячейки (как в SphereBVH)
+    static void packLeaves(const TriangleMesh& mesh, MeshBLAS& blas) {
+        blas.triangles.clear();
+        for (BVHNode& node : blas.bvh.nodes) {
+            if (!node.isLeaf())
+                continue;
+            const int slot = static_cast<int>(blas.triangles.size());
+            const int blockSize = simdBlocks(node.count) * SIMD_WIDTH;
+            for (int i = 0; i < blockSize; ++i) {
+                if (i < node.count) {
+                    const int triangle = blas.bvh.primIndices[node.leftFirst + i];
+                    blas.triangles.push(mesh.positions[3 * triangle], mesh.positions[3 * triangle + 1],
+                                        mesh.positions[3 * triangle + 2]);
+                }
+                else {
+                    blas.triangles.pushPadding();
+                }
+            }
+            node.leftFirst = slot;
+        }
+    }
+
+    std::vector<MeshBLAS> blas_;
+    std::vector<Instance> instances_;
+    BVH tlas_;
+};
@@ -8,6 +8,45 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "program_reflection.h"
+#include "texture_stream.h"
+
+// Число сфер в сцене шейдера (задаётся в шейдере как SPHERE_COUNT)
+const int SCENE_SPHERE_COUNT = 2;
+
+// Максимальная глубина отражений для варианта шейдера с отражениями
+const int TRACER_MAX_DEPTH = 5;
+
+// Максимальное число отскоков пути в режиме трассировки путей (обычно путь раньше
+// обрывает русская рулетка)
+const int PATH_MAX_BOUNCES = 32;
+
+// Текстуры: повторы текстуры пола на единицу длины и текстуры сфер на оборот
+// (как в cpu_main.cpp), бюджет выгрузки mip-уровней за кадр и видеопамять под
+// все текстуры по умолчанию (texture_stream.h)
+const float FLOOR_TEXTURE_SCALE = 0.5f;
+const float SPHERE_TEXTURE_SCALE = 1.0f;
+const size_t TEXTURE_UPLOAD_BYTES_PER_FRAME = 4 << 20;
+const size_t TEXTURE_VRAM_BUDGET = 64 << 20;
+
+// Отзыв LOD читается раз в столько кадров трассировки
+const int TEXTURE_FEEDBACK_INTERVAL = 8;
+
+// Максимальное число накапливаемых выборок на пиксель (после него кадр считается готовым).
+// Трассировке путей для сходимости шума нужно больше выборок.
+const int MAX_ACCUMULATED_SAMPLES = 256;
+const int MAX_PATH_SAMPLES = 4096;
+
+// Динамическое разрешение: бюджет времени трассировки одного кадра и пределы масштаба
+const float FRAME_TIME_BUDGET_MS = 14.0f;   // Запас до 16.7 мс (60 Гц) на вывод и обмен буферов
+const float MIN_RESOLUTION_SCALE = 0.25f;
+const float RESOLUTION_SCALE_STEP = 1.0f / 16.0f;
 
 // Вершинный шейдер
 const char* vertexShaderSource = R"(
@@ -27,7 +66,10 @@ const char* vertexShaderSource = R"(
 const char* fragmentShaderSource = R"(
     #version 330 core
 
-    out vec4 FragColor;
+    layout(location = 0) out vec4 FragColor;
+    // Отзыв LOD: log2 наименьшего пятна конуса луча в повторах текстуры
+    // (x — пол, y — сферы); NO_FEEDBACK — текстура в пикселе не нужна
+    layout(location = 1) out vec2 TextureFeedback;
     in vec2 fragCoord;
 
     // Структура для материала
@@ -69,8 +111,73 @@ const char* fragmentShaderSource = R"(
     uniform float uAspectRatio;
     uniform float uFOV;
 
-    // Максимальная глубина итераций для отражений
-    const int MAX_DEPTH = 5;
+    // Прогрессивное накопление
+    uniform vec2 uJitter;          // Субпиксельное смещение луча (в нормализованных координатах)
+    uniform sampler2D uAccum;      // Среднее по предыдущим кадрам (линейный цвет)
+    uniform float uSampleCount;    // Сколько выборок уже накоплено в uAccum
+
+    // Текстуры (sRGB, выборка даёт линейный цвет) умножают ambient и diffuse
+    uniform sampler2D uFloorTexture;
+    uniform sampler2D uSphereTexture;
+    uniform float uFloorTextureScale;
+    uniform float uSphereTextureScale;
+    uniform float uPixelSpread;    // Ширина конуса луча на единицу пути (угол пикселя)
+
+    // Параметры варианта шейдера (подставляются при компиляции через #define,
+    // значения по умолчанию соответствуют исходной сцене)
+    #ifndef MAX_DEPTH
+    #define MAX_DEPTH 5       // Максимальная глубина итераций для отражений
+    #endif
+    #ifndef SPHERE_COUNT
+    #define SPHERE_COUNT 2    // Число сфер в сцене
+    #endif
+    #ifndef REFLECTIONS
+    #define REFLECTIONS 1     // 0 - отражения выключены, цикл выполняется один раз
+    #endif
+    #ifndef PATH_TRACING
+    #define PATH_TRACING 0    // 1 - трассировка путей Монте-Карло вместо Уиттеда
+    #endif
+    #ifndef FLOOR_TEXTURE
+    #define FLOOR_TEXTURE 0   // 1 - у пола есть текстура
+    #endif
+    #ifndef SPHERE_TEXTURE
+    #define SPHERE_TEXTURE 0  // 1 - у сфер есть текстура
+    #endif
+    #define PATH_ROULETTE_START 2 // Отскок, с которого работает русская рулетка
+    #define NO_FEEDBACK 64.0
+
+    #if PATH_TRACING
+    // Генератор случайных чисел выборки: хэш PCG, состояние — последний хэш
+    uint rngState;
+
+    uint pcgHash(uint value)
+    {
+        uint state = value * 747796405u + 2891336453u;
+        uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    float random01()
+    {
+        rngState = pcgHash(rngState);
+        return float(rngState >> 8u) * (1.0 / 16777216.0);
+    }
+
+    // 1 / pi: нормировка ламбертовой BRDF (diffuse / pi)
+    const float INV_PI = 0.31830988;
+
+    // Направление в полусфере вокруг n с плотностью cos(theta) / pi
+    vec3 cosineSampleHemisphere(vec3 n)
+    {
+        float u1 = random01();
+        float u2 = random01();
+        float r = sqrt(u1);
+        float phi = 6.28318531 * u2;
+        vec3 tangent = normalize(cross(n, abs(n.x) > 0.5 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+        vec3 bitangent = cross(n, tangent);
+        return normalize(tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + n * sqrt(max(0.0, 1.0 - u1)));
+    }
+    #endif
 
     // Класс для луча
     struct Ray {
@@ -131,6 +238,30 @@ const char* fragmentShaderSource = R"(
         return false;
     }
 
+    // Текстурные координаты сферы: долгота и широта по нормали (v = 0 на полюсе +Y)
+    vec2 sphereTexCoord(vec3 normal)
+    {
+        return vec2(0.5 + atan(normal.z, normal.x) * (0.5 / 3.14159265), acos(clamp(normal.y, -1.0, 1.0)) * (1.0 / 3.14159265));
+    }
+
+    // Текстурные координаты плоскости: проекция на два направления в плоскости
+    vec2 planeTexCoord(Plane plane, vec3 hitPoint)
+    {
+        vec3 tangent = normalize(cross(plane.normal, abs(plane.normal.x) > 0.5 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+        vec3 bitangent = cross(plane.normal, tangent);
+        vec3 offset = hitPoint - plane.point;
+        return vec2(dot(offset, tangent), dot(offset, bitangent));
+    }
+
+    // Mip-уровень по ширине пятна конуса луча в текстурных координатах.
+    // textureSize(tex, 0) — размер базового (самого подробного выгруженного)
+    // уровня, поэтому уровень отсчитывается от него, как и в textureLod.
+    float textureLevel(sampler2D tex, float footprint)
+    {
+        vec2 size = vec2(textureSize(tex, 0));
+        return log2(max(footprint * max(size.x, size.y), 1.0));
+    }
+
     // Функция для получения цвета из материала с учётом освещения
     vec3 getColor(Material mat, vec3 hitPoint, vec3 normal, vec3 viewDir, Light light, bool inShadow)
     {
@@ -158,7 +289,7 @@ const char* fragmentShaderSource = R"(
 
     void main()
     {
-        Sphere spheres[2];
+        Sphere spheres[SPHERE_COUNT];
         // Первая сфера
         spheres[0].center = vec3(-1.0, 1.0, -3.0);
         spheres[0].radius = 1.0;
@@ -187,42 +318,41 @@ const char* fragmentShaderSource = R"(
         floorPlane.material.shininess = 32.0;
         floorPlane.material.reflection = uPlaneReflection;
 
-        // Определение источника света
-        Light light;
-        light.position = vec3(2.0, 4.0, 2.0);
-        light.color = vec3(1.0, 1.0, 1.0); // Белый свет
+        // Источник света задаётся униформом, чтобы его изменение сбрасывало накопление
+        Light light = uLight;
 
         // Определение параметров камеры
         vec3 cameraDir = normalize(vec3(0.0, 1.0, -3.0) - uCameraPos);
         vec3 cameraRight = normalize(cross(cameraDir, vec3(0.0, 1.0, 0.0)));
         vec3 cameraUp = cross(cameraRight, cameraDir);
 
-        // Генерация луча через пиксель
-        Ray ray = generateRay(fragCoord, uCameraPos, cameraDir, cameraRight, cameraUp, uFOV, uAspectRatio);
+        // Генерация луча через пиксель (со смещением внутри пикселя для сглаживания)
+        Ray ray = generateRay(fragCoord + uJitter, uCameraPos, cameraDir, cameraRight, cameraUp, uFOV, uAspectRatio);
 
         // Инициализация переменных для итеративного трассинга
         vec3 finalColor = vec3(0.0);
         Ray currentRay = ray;
-        float currentReflection = 1.0;
+        vec3 throughput = vec3(1.0); // Вес пути (у Уиттеда — произведение коэффициентов отражения)
+        float travelled = 0.0;       // Длина пути от камеры: ширина конуса луча uPixelSpread * travelled
+        vec2 feedback = vec2(NO_FEEDBACK);
+
+    #if PATH_TRACING
+        // Своя последовательность случайных чисел для каждого пикселя и кадра накопления
+        rngState = pcgHash(uint(gl_FragCoord.x) + pcgHash(uint(gl_FragCoord.y) + pcgHash(uint(uSampleCount))));
+    #endif
 
         for (int depth = 0; depth < MAX_DEPTH; ++depth) {
             float tMin = 1e20;
-            int hitObject = -1; // 0 или 1 для сфер, 2 для плоскости
+            int hitObject = -1; // Индекс сферы или SPHERE_COUNT для плоскости
             float t;
 
-            // Проверка пересечения с первой сферой
-            if (intersectSphere(currentRay, spheres[0], t)) {
-                if (t < tMin) {
-                    tMin = t;
-                    hitObject = 0;
-                }
-            }
-
-            // Проверка пересечения со второй сферой
-            if (intersectSphere(currentRay, spheres[1], t)) {
-                if (t < tMin) {
-                    tMin = t;
-                    hitObject = 1;
+            // Проверка пересечения со сферами (цикл с постоянной границей разворачивается)
+            for (int i = 0; i < SPHERE_COUNT; ++i) {
+                if (intersectSphere(currentRay, spheres[i], t)) {
+                    if (t < tMin) {
+                        tMin = t;
+                        hitObject = i;
+                    }
                 }
             }
 
@@ -230,13 +360,13 @@ const char* fragmentShaderSource = R"(
             if (intersectPlane(currentRay, floorPlane, t)) {
                 if (t < tMin) {
                     tMin = t;
-                    hitObject = 2;
+                    hitObject = SPHERE_COUNT;
                 }
             }
 
             // Если ничего не пересекло, добавить цвет фона и выйти из цикла
             if (hitObject == -1) {
-                finalColor += currentReflection * vec3(0.2, 0.7, 0.8); // Цвет неба
+                finalColor += throughput * vec3(0.2, 0.7, 0.8); // Цвет неба
                 break;
             }
 
@@ -244,17 +374,37 @@ const char* fragmentShaderSource = R"(
             vec3 hitPoint;
             vec3 normal;
             Material material;
+            travelled += tMin; // Кривизна отражающих поверхностей не учитывается
 
-            if (hitObject == 0 || hitObject == 1) {
+            if (hitObject < SPHERE_COUNT) {
                 Sphere sphere = spheres[hitObject];
                 hitPoint = currentRay.origin + currentRay.direction * tMin;
                 normal = normalize(hitPoint - sphere.center);
                 material = sphere.material;
+    #if SPHERE_TEXTURE
+                // Уровень явно по конусу луча: в цикле отражений производных для выбора уровня нет.
+                // Пятно в долях оборота: ширина / |cos| / длина экватора
+                float footprint = uPixelSpread * travelled / max(abs(dot(normal, currentRay.direction)), 0.1) *
+                                  uSphereTextureScale / (6.28318531 * sphere.radius);
+                vec3 texel = textureLod(uSphereTexture, sphereTexCoord(normal) * uSphereTextureScale,
+                                        textureLevel(uSphereTexture, footprint)).rgb;
+                feedback.y = min(feedback.y, log2(max(footprint, 1e-12)));
+                material.ambient *= texel;
+                material.diffuse *= texel;
+    #endif
             }
             else {
                 hitPoint = currentRay.origin + currentRay.direction * tMin;
                 normal = floorPlane.normal;
                 material = floorPlane.material;
+    #if FLOOR_TEXTURE
+                float footprint = uPixelSpread * travelled / max(abs(dot(normal, currentRay.direction)), 0.1) * uFloorTextureScale;
+                vec3 texel = textureLod(uFloorTexture, planeTexCoord(floorPlane, hitPoint) * uFloorTextureScale,
+                                        textureLevel(uFloorTexture, footprint)).rgb;
+                feedback.x = min(feedback.x, log2(max(footprint, 1e-12)));
+                material.ambient *= texel;
+                material.diffuse *= texel;
+    #endif
             }
 
             vec3 viewDir = normalize(-currentRay.direction);
@@ -267,7 +417,7 @@ const char* fragmentShaderSource = R"(
             bool inShadow = false;
 
             // Проверка пересечений для теней
-            for (int i = 0; i < 2; ++i) {
+            for (int i = 0; i < SPHERE_COUNT; ++i) {
                 if (i == hitObject)
                     continue;
                 float tShadow;
@@ -277,7 +427,7 @@ const char* fragmentShaderSource = R"(
                 }
             }
 
-            if (!inShadow && hitObject != 2) {
+            if (!inShadow && hitObject != SPHERE_COUNT) {
                 float tShadow;
                 if (intersectPlane(shadowRay, floorPlane, tShadow)) {
                     inShadow = true;
@@ -286,25 +436,114 @@ const char* fragmentShaderSource = R"(
 
             vec3 color = getColor(material, hitPoint, normal, viewDir, light, inShadow);
 
+    #if PATH_TRACING
+            // Материал — смесь зеркала (вес reflection) и диффузно-бликовой поверхности.
+            // Прямой свет источника считается явно (NEE) для диффузно-бликовой части,
+            // диффузная часть — с BRDF diffuse / pi, как у косинусной выборки ниже;
+            // ambient заменяется переотражённым светом неба и объектов.
+            float mirror = clamp(material.reflection, 0.0, 1.0);
+            vec3 diffuseLight = inShadow ? vec3(0.0) : material.diffuse * max(dot(normal, lightDir), 0.0) * light.color;
+            vec3 specularLight = color - material.ambient * light.color - diffuseLight;
+            finalColor += throughput * (1.0 - mirror) * (diffuseLight * INV_PI + specularLight);
+
+            // Выбор следующего направления: зеркало или косинусное распределение
+            vec3 nextDir;
+            if (random01() < mirror) {
+                nextDir = reflect(currentRay.direction, normal);
+            }
+            else {
+                nextDir = cosineSampleHemisphere(normal);
+                throughput *= material.diffuse;
+            }
+            currentRay.origin = hitPoint + nextDir * 1e-4;
+            currentRay.direction = nextDir;
+
+            // Русская рулетка: пути с малым весом обрываются, выжившие усиливаются
+            if (depth >= PATH_ROULETTE_START) {
+                float survive = min(max(throughput.r, max(throughput.g, throughput.b)), 0.95);
+                if (random01() >= survive)
+                    break;
+                throughput /= survive;
+            }
+    #else
             // Добавление цвета с учётом текущего отражения
-            finalColor += currentReflection * color;
+            finalColor += throughput * color;
 
             // Обработка отражения
+    #if REFLECTIONS
             if (material.reflection > 0.0) {
                 vec3 reflectDir = reflect(currentRay.direction, normal);
                 currentRay.origin = hitPoint + reflectDir * 1e-4;
                 currentRay.direction = reflectDir;
-                currentReflection *= material.reflection;
+                throughput *= material.reflection;
             }
             else {
                 break; // Если материал не отражает, выйти из цикла
             }
+    #else
+            break;
+    #endif
+    #endif
         }
 
-        // Применение гамма-коррекции
-        finalColor = pow(finalColor, vec3(1.0 / 2.2));
+        // Накопление: скользящее среднее в линейном пространстве.
+        // Гамма-коррекция выполняется при выводе на экран.
+        if (uSampleCount > 0.0) {
+            vec3 previous = texelFetch(uAccum, ivec2(gl_FragCoord.xy), 0).rgb;
+            finalColor = mix(previous, finalColor, 1.0 / (uSampleCount + 1.0));
+        }
 
         FragColor = vec4(finalColor, 1.0);
+        TextureFeedback = feedback;
+    }
+)";
+
+// Фрагментный шейдер вывода накопленного изображения на экран.
+// Изображение может быть меньше окна (динамическое разрешение), поэтому оно
+// увеличивается билинейно, но соседние текселы с сильно отличающейся яркостью
+// получают малый вес — границы объектов остаются резкими.
+const char* displayFragmentShaderSource = R"(
+    #version 330 core
+
+    out vec4 FragColor;
+    in vec2 fragCoord;
+
+    uniform sampler2D uImage;
+    uniform vec2 uOutputSize; // Размер окна в пикселях
+
+    float luminance(vec3 color)
+    {
+        return dot(color, vec3(0.2126, 0.7152, 0.0722));
+    }
+
+    void main()
+    {
+        ivec2 imageSize = textureSize(uImage, 0);
+        vec2 pos = gl_FragCoord.xy / uOutputSize * vec2(imageSize) - 0.5;
+        ivec2 base = ivec2(floor(pos));
+        vec2 f = pos - vec2(base);
+
+        // Ближайший тексел задаёт опорную яркость
+        ivec2 maxTexel = imageSize - 1;
+        ivec2 nearest = clamp(ivec2(floor(pos + 0.5)), ivec2(0), maxTexel);
+        float reference = luminance(texelFetch(uImage, nearest, 0).rgb);
+
+        vec3 sum = vec3(0.0);
+        float weightSum = 0.0;
+        for (int j = 0; j <= 1; j++) {
+            for (int i = 0; i <= 1; i++) {
+                vec3 texel = texelFetch(uImage, clamp(base + ivec2(i, j), ivec2(0), maxTexel), 0).rgb;
+                float bilinear = (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);
+                float diff = luminance(texel) - reference;
+                float weight = bilinear * exp(-diff * diff * 50.0) + 1e-5;
+                sum += texel * weight;
+                weightSum += weight;
+            }
+        }
+        vec3 color = sum / weightSum;
+
+        // Применение гамма-коррекции
+        FragColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
     }
 )";
 
@@ -370,7 +609,429 @@ GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
     return program;
 }
 
-int main() {
+// Вставка строк #define в исходный код шейдера (после #version, если он есть)
+std::string injectDefines(const char* source, const std::string& defines) {
+    std::string text(source);
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start != std::string::npos && text.compare(start, 8, "#version") == 0) {
+        size_t lineEnd = text.find('\n', start);
+        if (lineEnd == std::string::npos) {
+            text += '\n';
+            lineEnd = text.size() - 1;
+        }
+        text.insert(lineEnd + 1, defines);
+        return text;
+    }
+    return defines + text;
+}
+
+// Кэш специализированных вариантов программы. Ключ — набор #define:
+// каждый вариант компилируется один раз при первом запросе и затем
+// только выбирается перед отрисовкой.
+class ShaderVariantCache {
+public:
+    ShaderVariantCache(const char* vertexSource, const char* fragmentSource)
+        : vertexSource_(vertexSource), fragmentSource_(fragmentSource) {}
+
+    ShaderVariantCache(const ShaderVariantCache&) = delete;
+    ShaderVariantCache& operator=(const ShaderVariantCache&) = delete;
+
+    // Удаление всех программ (вызывается, пока контекст OpenGL ещё существует)
+    void clear() {
+        for (auto& entry : programs_)
+            glDeleteProgram(entry.second);
+        programs_.clear();
+    }
+
+    GLuint get(const std::string& defines) {
+        auto it = programs_.find(defines);
+        if (it != programs_.end())
+            return it->second;
+
+        std::string vertex = injectDefines(vertexSource_, defines);
+        std::string fragment = injectDefines(fragmentSource_, defines);
+        GLuint program = createProgram(vertex.c_str(), fragment.c_str());
+        programs_.emplace(defines, program);
+        return program;
+    }
+
+private:
+    const char* vertexSource_;
+    const char* fragmentSource_;
+    std::map<std::string, GLuint> programs_;
+};
+
+// Пара текстур с плавающей точкой для накопления выборок (ping-pong):
+// кадр читает среднее из одной текстуры и пишет обновлённое в другую.
+// Второй выход трассировки — отзыв LOD последнего кадра, общий для обоих буферов.
+struct AccumulationBuffer {
+    GLuint textures[2] = { 0, 0 };
+    GLuint framebuffers[2] = { 0, 0 };
+    GLuint feedback = 0;
+    int width = 0;
+    int height = 0;
+    int current = 0;     // Текстура с последним накопленным результатом
+    int sampleCount = 0; // Число накопленных выборок
+};
+
+// Создание (или пересоздание при изменении размера) буферов накопления
+bool createAccumulationBuffer(AccumulationBuffer& accum, int width, int height) {
+    glGenTextures(2, accum.textures);
+    glGenFramebuffers(2, accum.framebuffers);
+    glGenTextures(1, &accum.feedback);
+    glBindTexture(GL_TEXTURE_2D, accum.feedback);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, width, height, 0, GL_RG, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+
+    for (int i = 0; i < 2; ++i) {
+        glBindTexture(GL_TEXTURE_2D, accum.textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, accum.framebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accum.textures[i], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, accum.feedback, 0);
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Буфер накопления не готов к использованию" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return false;
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    accum.width = width;
+    accum.height = height;
+    accum.current = 0;
+    accum.sampleCount = 0;
+    return true;
+}
+
+void destroyAccumulationBuffer(AccumulationBuffer& accum) {
+    glDeleteFramebuffers(2, accum.framebuffers);
+    glDeleteTextures(2, accum.textures);
+    glDeleteTextures(1, &accum.feedback);
+    accum = AccumulationBuffer();
+}
+
+// Асинхронное чтение отзыва LOD: буфер отзыва копируется в PBO за барьером,
+// а разбирается, когда GPU до барьера дошёл, — поток GL чтения не ждёт
+struct FeedbackReadback {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    int width = 0;
+    int height = 0;
+};
+
+// Копирование отзыва последнего кадра трассировки из framebuffer (если прошлое чтение завершено)
+void requestFeedback(FeedbackReadback& readback, GLuint framebuffer, int width, int height) {
+    if (readback.fence)
+        return;
+    if (!readback.buffer)
+        glGenBuffers(1, &readback.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (readback.width != width || readback.height != height) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 2 * sizeof(float), nullptr, GL_STREAM_READ);
+        readback.width = width;
+        readback.height = height;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RG, GL_FLOAT, nullptr);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Наименьший log2 пятна по кадру для пола и сфер; false — чтение ещё не готово
+bool takeFeedback(FeedbackReadback& readback, float minimum[2]) {
+    if (!readback.fence)
+        return false;
+    const GLenum status = glClientWaitSync(readback.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const size_t count = static_cast<size_t>(readback.width) * readback.height;
+    const float* data = static_cast<const float*>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(count * 2 * sizeof(float)), GL_MAP_READ_BIT));
+    minimum[0] = minimum[1] = 1e30f;
+    if (data) {
+        for (size_t i = 0; i < count; ++i) {
+            minimum[0] = std::min(minimum[0], data[2 * i]);
+            minimum[1] = std::min(minimum[1], data[2 * i + 1]);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return data != nullptr;
+}
+
+void destroyFeedbackReadback(FeedbackReadback& readback) {
+    if (readback.fence)
+        glDeleteSync(readback.fence);
+    glDeleteBuffers(1, &readback.buffer);
+    readback = FeedbackReadback();
+}
+
+// Отзыв LOD для текстуры: уровень, выбираемый шейдером для наименьшего пятна
+// (textureLevel: log2 пятна в текселах уровня 0), округлённый к подробному
+void requestStreamedLevel(TextureStreamer& streamer, size_t index, float footprintLog2) {
+    if (index == SIZE_MAX || footprintLog2 >= 60.0f) // NO_FEEDBACK: текстура в кадре не видна
+        return;
+    const Texture& texture = streamer.texture(index);
+    const float level = footprintLog2 + std::log2(static_cast<float>(std::max(texture.width, texture.height)));
+    streamer.requestLevel(index, static_cast<int>(std::floor(std::max(level, 0.0f))));
+}
+
+// Входные данные кадра трассировки: камера, область просмотра и материалы.
+// Кадр заново трассируется только при изменении этого состояния.
+struct RenderState {
+    glm::vec3 cameraPos;
+    glm::vec3 lightPos;
+    glm::vec3 lightColor;
+    float sphereReflection;
+    float planeReflection;
+    float fov;
+    int width;            // Размер окна
+    int height;
+    float resolutionScale; // Доля размера окна, в которой идёт трассировка
+    bool pathTracing;      // Трассировка путей Монте-Карло вместо Уиттеда
+    GLuint floorTexture;   // Текстуры пола и сфер (0 — нет или ещё загружается)
+    GLuint sphereTexture;
+    int floorTextureLevel; // Самый подробный выгруженный mip-уровень текстуры
+    int sphereTextureLevel;
+};
+
+bool operator==(const RenderState& a, const RenderState& b) {
+    return a.cameraPos == b.cameraPos && a.lightPos == b.lightPos && a.lightColor == b.lightColor &&
+           a.sphereReflection == b.sphereReflection && a.planeReflection == b.planeReflection &&
+           a.fov == b.fov && a.width == b.width && a.height == b.height &&
+           a.resolutionScale == b.resolutionScale && a.pathTracing == b.pathTracing &&
+           a.floorTexture == b.floorTexture && a.sphereTexture == b.sphereTexture &&
+           a.floorTextureLevel == b.floorTextureLevel && a.sphereTextureLevel == b.sphereTextureLevel;
+}
+
+bool operator!=(const RenderState& a, const RenderState& b) {
+    return !(a == b);
+}
+
+// Униформы программы трассировки (из таблицы отражения программы)
+struct TracerUniforms {
+    Uniform cameraPos;
+    Uniform lightPos;
+    Uniform lightColor;
+    Uniform sphereReflection;
+    Uniform planeReflection;
+    Uniform aspectRatio;
+    Uniform fov;
+    Uniform jitter;
+    Uniform accum;
+    Uniform sampleCount;
+    Uniform floorTexture;
+    Uniform sphereTexture;
+    Uniform floorTextureScale;
+    Uniform sphereTextureScale;
+    Uniform pixelSpread;
+};
+
+TracerUniforms getTracerUniforms(GLuint program) {
+    ProgramReflection reflection(program);
+    TracerUniforms loc;
+    loc.cameraPos = reflection.uniform("uCameraPos");
+    loc.lightPos = reflection.uniform("uLight.position");
+    loc.lightColor = reflection.uniform("uLight.color");
+    loc.sphereReflection = reflection.uniform("uSphereReflection");
+    loc.planeReflection = reflection.uniform("uPlaneReflection");
+    loc.aspectRatio = reflection.uniform("uAspectRatio");
+    loc.fov = reflection.uniform("uFOV");
+    loc.jitter = reflection.uniform("uJitter");
+    loc.accum = reflection.uniform("uAccum");
+    loc.sampleCount = reflection.uniform("uSampleCount");
+    loc.floorTexture = reflection.uniform("uFloorTexture");
+    loc.sphereTexture = reflection.uniform("uSphereTexture");
+    loc.floorTextureScale = reflection.uniform("uFloorTextureScale");
+    loc.sphereTextureScale = reflection.uniform("uSphereTextureScale");
+    loc.pixelSpread = reflection.uniform("uPixelSpread");
+    return loc;
+}
+
+// Набор #define варианта трассировщика для состояния: при нулевых отражениях
+// цикл отражений не нужен, и шейдер компилируется с одной итерацией.
+// Трассировке путей цикл нужен всегда: диффузные отскоки есть и без зеркал.
+std::string tracerVariantDefines(const RenderState& state) {
+    const bool reflections = state.pathTracing || state.sphereReflection > 0.0f || state.planeReflection > 0.0f;
+    const int maxDepth = state.pathTracing ? PATH_MAX_BOUNCES : (reflections ? TRACER_MAX_DEPTH : 1);
+    std::string defines;
+    defines += "#define MAX_DEPTH " + std::to_string(maxDepth) + "\n";
+    defines += "#define SPHERE_COUNT " + std::to_string(SCENE_SPHERE_COUNT) + "\n";
+    defines += std::string("#define REFLECTIONS ") + (reflections ? "1" : "0") + "\n";
+    defines += std::string("#define PATH_TRACING ") + (state.pathTracing ? "1" : "0") + "\n";
+    defines += std::string("#define FLOOR_TEXTURE ") + (state.floorTexture ? "1" : "0") + "\n";
+    defines += std::string("#define SPHERE_TEXTURE ") + (state.sphereTexture ? "1" : "0") + "\n";
+    return defines;
+}
+
+// Предел накопления для режима трассировки
+int maxAccumulatedSamples(const RenderState& state) {
+    return state.pathTracing ? MAX_PATH_SAMPLES : MAX_ACCUMULATED_SAMPLES;
+}
+
+// Размер изображения трассировки для окна и масштаба
+void traceSize(const RenderState& state, int& traceWidth, int& traceHeight) {
+    traceWidth = std::max(1, static_cast<int>(state.width * state.resolutionScale + 0.5f));
+    traceHeight = std::max(1, static_cast<int>(state.height * state.resolutionScale + 0.5f));
+}
+
+// Передача в программу только изменившихся униформов (без previous — всех,
+// включая номера текстурных блоков и повторы текстур)
+void uploadRenderState(GLuint program, const TracerUniforms& loc, const RenderState& state, const RenderState* previous) {
+    glUseProgram(program);
+    if (!previous) {
+        loc.accum.set(0);
+        loc.floorTexture.set(1);
+        loc.sphereTexture.set(2);
+        loc.floorTextureScale.set(FLOOR_TEXTURE_SCALE);
+        loc.sphereTextureScale.set(SPHERE_TEXTURE_SCALE);
+    }
+    if (!previous || state.cameraPos != previous->cameraPos)
+        loc.cameraPos.set(state.cameraPos);
+    if (!previous || state.lightPos != previous->lightPos)
+        loc.lightPos.set(state.lightPos);
+    if (!previous || state.lightColor != previous->lightColor)
+        loc.lightColor.set(state.lightColor);
+    if (!previous || state.sphereReflection != previous->sphereReflection)
+        loc.sphereReflection.set(state.sphereReflection);
+    if (!previous || state.planeReflection != previous->planeReflection)
+        loc.planeReflection.set(state.planeReflection);
+    if (!previous || state.width != previous->width || state.height != previous->height)
+        loc.aspectRatio.set(static_cast<float>(state.width) / static_cast<float>(state.height));
+    if (!previous || state.fov != previous->fov)
+        loc.fov.set(state.fov);
+    if (!previous || state.fov != previous->fov || state.height != previous->height ||
+        state.resolutionScale != previous->resolutionScale) {
+        int traceWidth, traceHeight;
+        traceSize(state, traceWidth, traceHeight);
+        loc.pixelSpread.set(2.0f * std::tan(glm::radians(state.fov) * 0.5f) / static_cast<float>(traceHeight));
+    }
+}
+
+// Регулятор масштаба разрешения по измеренному времени трассировки.
+// Время пропорционально числу пикселей, то есть квадрату масштаба. Масштаб
+// квантуется и округляется вниз: уменьшается сразу при превышении бюджета,
+// а увеличивается только при запасе не меньше шага (без колебаний).
+struct ResolutionController {
+    float scale = 1.0f;
+    float smoothedMs = 0.0f; // Сглаженное время трассировки при текущем масштабе
+
+    // Возвращает true, если масштаб изменился
+    bool update(float frameMs) {
+        smoothedMs = (smoothedMs == 0.0f) ? frameMs : 0.8f * smoothedMs + 0.2f * frameMs;
+
+        float target = scale * std::sqrt(FRAME_TIME_BUDGET_MS / std::max(smoothedMs, 1e-3f));
+        target = std::floor(target / RESOLUTION_SCALE_STEP) * RESOLUTION_SCALE_STEP;
+        target = glm::clamp(target, MIN_RESOLUTION_SCALE, 1.0f);
+        if (target == scale)
+            return false;
+
+        scale = target;
+        smoothedMs = 0.0f; // Новые замеры уже при новом масштабе
+        return true;
+    }
+};
+
+// Удерживается ли клавиша изменения отражений (тогда кадры нужны непрерывно)
+bool reflectionKeyHeld(GLFWwindow* window) {
+    return glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS ||
+           glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS;
+}
+
+// Поддерживает ли контекст расширение (в Core Profile список — только через glGetStringi)
+bool hasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const GLubyte* extension = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+        if (extension && std::strcmp(reinterpret_cast<const char*>(extension), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Выгружается ли сжатый формат в sRGB-варианте
+bool textureFormatSupported(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::BC1:
+        return hasGLExtension("GL_EXT_texture_compression_s3tc") &&
+               (hasGLExtension("GL_EXT_texture_sRGB") || hasGLExtension("GL_EXT_texture_compression_s3tc_srgb"));
+    case TextureFormat::ETC2: {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 3) || hasGLExtension("GL_ARB_ES3_compatibility");
+    }
+    default:
+        return true;
+    }
+}
+
+// Формат текстур по аргументу --texture-format: auto — BC1 (родной для
+// настольных GPU), затем ETC2, иначе RGBA8. Неподдерживаемый формат
+// заменяется на RGBA8 с предупреждением.
+TextureFormat chooseTextureFormat(const std::string& name) {
+    if (name == "auto") {
+        for (TextureFormat format : { TextureFormat::BC1, TextureFormat::ETC2 })
+            if (textureFormatSupported(format))
+                return format;
+        return TextureFormat::RGBA8;
+    }
+    const TextureFormat format = name == "bc1" ? TextureFormat::BC1 : name == "etc2" ? TextureFormat::ETC2 : TextureFormat::RGBA8;
+    if (!textureFormatSupported(format)) {
+        std::cerr << "Формат текстур " << textureFormatName(format) << " не поддерживается, используется RGBA8" << std::endl;
+        return TextureFormat::RGBA8;
+    }
+    return format;
+}
+
+int main(int argc, char** argv) {
+    // Текстуры пола и сфер (необязательно): декодируются в фоне, пока идёт рендеринг
+    std::string floorTexturePath, sphereTexturePath;
+    std::string textureCacheDir = TEXTURE_CACHE_DIR; // Повторный запуск — без декодирования
+    std::string textureFormat = "auto";              // Сжатые записи кэша (compress_main.cpp), если GPU их понимает
+    size_t textureBudget = TEXTURE_VRAM_BUDGET;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--floor-texture") == 0 && i + 1 < argc)
+            floorTexturePath = argv[++i];
+        else if (std::strcmp(argv[i], "--sphere-texture") == 0 && i + 1 < argc)
+            sphereTexturePath = argv[++i];
+        else if (std::strcmp(argv[i], "--texture-cache") == 0 && i + 1 < argc)
+            textureCacheDir = argv[++i];
+        else if (std::strcmp(argv[i], "--no-texture-cache") == 0)
+            textureCacheDir.clear();
+        else if (std::strcmp(argv[i], "--texture-format") == 0 && i + 1 < argc &&
+                 (std::strcmp(argv[i + 1], "auto") == 0 || std::strcmp(argv[i + 1], "rgba8") == 0 ||
+                  std::strcmp(argv[i + 1], "bc1") == 0 || std::strcmp(argv[i + 1], "etc2") == 0))
+            textureFormat = argv[++i];
+        else if (std::strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+            textureBudget = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        else {
+            std::cerr << "Использование: " << argv[0] << " [--floor-texture image.png] [--sphere-texture image.jpg]"
+                      << " [--texture-cache DIR] [--no-texture-cache] [--texture-format auto|rgba8|bc1|etc2]"
+                      << " [--texture-budget MB]" << std::endl;
+            return -1;
+        }
+    }
+
     // Инициализация GLFW
     if (!glfwInit()) {
         std::cerr << "Не удалось инициализировать GLFW" << std::endl;
@@ -404,13 +1065,34 @@ int main() {
         return -1;
     }
 
+    // Загрузка текстур в фоне (декодирование и mip-цепочки); сжатый формат
+    // выбирается по возможностям контекста, поэтому только после GLEW
+    TextureLoader textureLoader(0, true, textureCacheDir, chooseTextureFormat(textureFormat));
+    const uint32_t noTexture = UINT32_MAX;
+    const uint32_t floorTextureId = floorTexturePath.empty() ? noTexture : textureLoader.request(floorTexturePath);
+    const uint32_t sphereTextureId = sphereTexturePath.empty() ? noTexture : textureLoader.request(sphereTexturePath);
+    std::vector<LoadedTexture> readyTextures;
+    TextureStreamer textureStreamer(textureBudget); // Выгрузка уровней по отзыву LOD в пределах бюджета
+    size_t floorStream = SIZE_MAX, sphereStream = SIZE_MAX;
+    FeedbackReadback feedback;
+    int framesSinceFeedback = 0;
+
     // Установка размеров области просмотра
     int width, height;
     glfwGetFramebufferSize(window, &width, &height);
     glViewport(0, 0, width, height); //самое важное
 
-    // Создание программы шейдеров
-    GLuint shaderProgram = createProgram(vertexShaderSource, fragmentShaderSource);
+    // Создание программ шейдеров: варианты трассировки с накоплением и вывод на экран
+    ShaderVariantCache tracerVariants(vertexShaderSource, fragmentShaderSource);
+    GLuint displayProgram = createProgram(vertexShaderSource, displayFragmentShaderSource);
+
+    // Буферы накопления выборок
+    AccumulationBuffer accum;
+    if (!createAccumulationBuffer(accum, width, height)) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
 
     // Создание полноэкранного квадрата (fullscreen quad)
     float quadVertices[] = {
@@ -443,90 +1125,268 @@ int main() {
     glBindVertexArray(0);
 
     // Получение местоположений униформов
-    GLint cameraPosLoc = glGetUniformLocation(shaderProgram, "uCameraPos");
-    GLint lightPosLoc = glGetUniformLocation(shaderProgram, "uLight.position");
-    GLint lightColorLoc = glGetUniformLocation(shaderProgram, "uLight.color");
-    GLint sphereReflectionLoc = glGetUniformLocation(shaderProgram, "uSphereReflection");
-    GLint planeReflectionLoc = glGetUniformLocation(shaderProgram, "uPlaneReflection");
-    GLint aspectRatioLoc = glGetUniformLocation(shaderProgram, "uAspectRatio");
-    GLint fovLoc = glGetUniformLocation(shaderProgram, "uFOV");
-
-    // Определение параметров сцены
-    glm::vec3 cameraPos = glm::vec3(0.0f, 2.0f, 5.0f);
-    glm::vec3 lightPos = glm::vec3(2.0f, 4.0f, 2.0f);
-    glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-
-    // Коэффициенты отражения по умолчанию
-    float sphereReflection = 0.5f;
-    float planeReflection = 0.3f;
-
-    // Передача униформов
-    glUseProgram(shaderProgram);
-    glUniform3fv(cameraPosLoc, 1, glm::value_ptr(cameraPos));
-    glUniform3fv(lightPosLoc, 1, glm::value_ptr(lightPos));
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
-    glUniform1f(sphereReflectionLoc, sphereReflection);
-    glUniform1f(planeReflectionLoc, planeReflection);
-    glUniform1f(aspectRatioLoc, static_cast<float>(width) / static_cast<float>(height));
-    glUniform1f(fovLoc, 45.0f);
+    ProgramReflection displayReflection(displayProgram);
+    Uniform imageUniform = displayReflection.uniform("uImage");
+    Uniform outputSizeUniform = displayReflection.uniform("uOutputSize");
+
+    // Запросы времени GPU для трассировки. Их два: результат прошлого кадра
+    // читается, когда уже готов, и конвейер не ждёт завершения текущего.
+    GLuint timerQueries[2];
+    bool timerPending[2] = { false, false };
+    float timerScale[2] = { 0.0f, 0.0f }; // Масштаб, при котором трассировался кадр запроса
+    int timerIndex = 0;
+    glGenQueries(2, timerQueries);
+
+    ResolutionController resolution;
+    float lastTraceMs = 0.0f;
+    double lastReportTime = 0.0;
+
+    // Генератор субпиксельных смещений
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> jitterDist(-0.5f, 0.5f);
+
+    // Определение параметров сцены (коэффициенты отражения по умолчанию 0.5 и 0.3)
+    RenderState state;
+    state.cameraPos = glm::vec3(0.0f, 2.0f, 5.0f);
+    state.lightPos = glm::vec3(2.0f, 4.0f, 2.0f);
+    state.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+    state.sphereReflection = 0.5f;
+    state.planeReflection = 0.3f;
+    state.fov = 45.0f;
+    state.width = width;
+    state.height = height;
+    state.resolutionScale = resolution.scale;
+    state.pathTracing = false;
+    state.floorTexture = 0;
+    state.sphereTexture = 0;
+    state.floorTextureLevel = 0;
+    state.sphereTextureLevel = 0;
+    bool pathKeyWasDown = false;
+
+    // Выбор варианта трассировщика и передача униформов
+    GLuint shaderProgram = tracerVariants.get(tracerVariantDefines(state));
+    TracerUniforms tracerUniforms = getTracerUniforms(shaderProgram);
+    uploadRenderState(shaderProgram, tracerUniforms, state, nullptr);
+    RenderState uploaded = state; // Состояние, с которым накоплено текущее изображение
+
+    glUseProgram(displayProgram);
+    imageUniform.set(0);
 
     // Основной цикл рендеринга
     while (!glfwWindowShouldClose(window)) {
+        // Пока изображение не сошлось или клавиша удерживается, кадры идут непрерывно.
+        // Иначе поток спит до ближайшего события окна (ввод, перекрытие, изменение размера).
+        // Пока загружаются текстуры, поток тоже не засыпает: готовые надо выгрузить.
+        if (accum.sampleCount >= maxAccumulatedSamples(uploaded) && !reflectionKeyHeld(window) && textureLoader.idle() &&
+            textureStreamer.idle() && !feedback.fence)
+            glfwWaitEvents();
+        else
+            glfwPollEvents();
+
         // Обработка ввода с клавиатуры
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             glfwSetWindowShouldClose(window, true);
 
         // Изменение коэффициента отражения сфер
         if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) { // Увеличение отражения сфер
-            sphereReflection += 0.5f * 0.016f; // Предполагаем 60 FPS, deltaTime ~0.016
-            sphereReflection = glm::clamp(sphereReflection, 0.0f, 1.0f);
-            glUniform1f(sphereReflectionLoc, sphereReflection);
-            std::cout << "Коэффициент отражения сфер: " << sphereReflection << std::endl;
+            state.sphereReflection += 0.5f * 0.016f; // Предполагаем 60 FPS, deltaTime ~0.016
+            state.sphereReflection = glm::clamp(state.sphereReflection, 0.0f, 1.0f);
+            std::cout << "Коэффициент отражения сфер: " << state.sphereReflection << std::endl;
         }
         if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) { // Уменьшение отражения сфер
-            sphereReflection -= 0.5f * 0.016f;
-            sphereReflection = glm::clamp(sphereReflection, 0.0f, 1.0f);
-            glUniform1f(sphereReflectionLoc, sphereReflection);
-            std::cout << "Коэффициент отражения сфер: " << sphereReflection << std::endl;
+            state.sphereReflection -= 0.5f * 0.016f;
+            state.sphereReflection = glm::clamp(state.sphereReflection, 0.0f, 1.0f);
+            std::cout << "Коэффициент отражения сфер: " << state.sphereReflection << std::endl;
         }
 
         // Изменение коэффициента отражения пола
         if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) { // Увеличение отражения пола
-            planeReflection += 0.3f * 0.016f;
-            planeReflection = glm::clamp(planeReflection, 0.0f, 1.0f);
-            glUniform1f(planeReflectionLoc, planeReflection);
-            std::cout << "Коэффициент отражения пола: " << planeReflection << std::endl;
+            state.planeReflection += 0.3f * 0.016f;
+            state.planeReflection = glm::clamp(state.planeReflection, 0.0f, 1.0f);
+            std::cout << "Коэффициент отражения пола: " << state.planeReflection << std::endl;
         }
         if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) { // Уменьшение отражения пола
-            planeReflection -= 0.3f * 0.016f;
-            planeReflection = glm::clamp(planeReflection, 0.0f, 1.0f);
-            glUniform1f(planeReflectionLoc, planeReflection);
-            std::cout << "Коэффициент отражения пола: " << planeReflection << std::endl;
+            state.planeReflection -= 0.3f * 0.016f;
+            state.planeReflection = glm::clamp(state.planeReflection, 0.0f, 1.0f);
+            std::cout << "Коэффициент отражения пола: " << state.planeReflection << std::endl;
         }
 
-        // Обновление униформов при изменении размера окна
-        glfwGetFramebufferSize(window, &width, &height);
-        glViewport(0, 0, width, height);
-        glUniform1f(aspectRatioLoc, static_cast<float>(width) / static_cast<float>(height));
+        // Переключение режима: трассировка Уиттеда / трассировка путей (по нажатию)
+        const bool pathKeyDown = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+        if (pathKeyDown && !pathKeyWasDown) {
+            state.pathTracing = !state.pathTracing;
+            std::cout << "Режим: " << (state.pathTracing ? "трассировка путей" : "трассировка Уиттеда") << std::endl;
+        }
+        pathKeyWasDown = pathKeyDown;
+
+        // Отзыв LOD прошлых кадров задаёт нужные уровни текстур
+        float footprints[2];
+        if (takeFeedback(feedback, footprints)) {
+            textureStreamer.beginFeedback();
+            requestStreamedLevel(textureStreamer, floorStream, footprints[0]);
+            requestStreamedLevel(textureStreamer, sphereStream, footprints[1]);
+        }
 
-        // Очистка буферов
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+        // Выгрузка декодированных текстур по mip-уровням от мелких к крупным до
+        // нужных по отзыву, не больше TEXTURE_UPLOAD_BYTES_PER_FRAME за кадр.
+        // Новая текстура меняет вариант шейдера, каждый новый или вытесненный
+        // уровень сбрасывает накопление.
+        readyTextures.clear();
+        textureLoader.takeReady(readyTextures);
+        for (LoadedTexture& item : readyTextures) {
+            if (!item.ok) {
+                std::cerr << "Не удалось загрузить текстуру " << item.path << ": " << item.error << std::endl;
+                continue;
+            }
+            std::cout << "Текстура " << item.path << ": " << item.texture.width << "x" << item.texture.height << ", "
+                      << textureFormatName(item.texture.format) << ", "
+                      << item.texture.levelOffset(item.texture.levels) / 1024 << " КБ" << (item.cached ? " (из кэша)" : "")
+                      << std::endl;
+            const size_t index = textureStreamer.add(std::move(item.texture));
+            if (item.id == floorTextureId)
+                floorStream = index;
+            else if (item.id == sphereTextureId)
+                sphereStream = index;
+        }
+        glActiveTexture(GL_TEXTURE0);
+        textureStreamer.update(TEXTURE_UPLOAD_BYTES_PER_FRAME);
+        if (floorStream != SIZE_MAX && textureStreamer.residentLevel(floorStream) < textureStreamer.texture(floorStream).levels) {
+            state.floorTexture = textureStreamer.id(floorStream);
+            state.floorTextureLevel = textureStreamer.residentLevel(floorStream);
+        }
+        if (sphereStream != SIZE_MAX && textureStreamer.residentLevel(sphereStream) < textureStreamer.texture(sphereStream).levels) {
+            state.sphereTexture = textureStreamer.id(sphereStream);
+            state.sphereTextureLevel = textureStreamer.residentLevel(sphereStream);
+        }
+
+        // Размер области просмотра и масштаб трассировки
+        glfwGetFramebufferSize(window, &state.width, &state.height);
+        if (state.width == 0 || state.height == 0) { // Окно свёрнуто: ждать восстановления
+            glfwWaitEvents();
+            continue;
+        }
+        state.resolutionScale = resolution.scale;
+
+        // Изменение состояния сбрасывает накопление (при новом размере — и буферы)
+        if (state != uploaded) {
+            int traceWidth, traceHeight;
+            traceSize(state, traceWidth, traceHeight);
+            if (traceWidth != accum.width || traceHeight != accum.height) {
+                destroyAccumulationBuffer(accum);
+                if (!createAccumulationBuffer(accum, traceWidth, traceHeight))
+                    break;
+            }
+
+            // Смена варианта: униформы новой программы передаются полностью
+            GLuint variant = tracerVariants.get(tracerVariantDefines(state));
+            if (variant != shaderProgram) {
+                shaderProgram = variant;
+                tracerUniforms = getTracerUniforms(shaderProgram);
+                uploadRenderState(shaderProgram, tracerUniforms, state, nullptr);
+            }
+            else {
+                uploadRenderState(shaderProgram, tracerUniforms, state, &uploaded);
+            }
+            uploaded = state;
+            accum.sampleCount = 0;
+
+            // Текстуры остаются привязанными к блокам 1 и 2 (вывод на экран использует только блок 0)
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, state.floorTexture);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, state.sphereTexture);
+        }
 
-        // Отрисовка полноэкранного квадрата
         glBindVertexArray(VAO);
+        glActiveTexture(GL_TEXTURE0);
+
+        // Трассировка очередной выборки в свободную текстуру (пока не набран предел).
+        // Когда изображение сошлось, на экран повторно выводится последний результат.
+        if (accum.sampleCount < maxAccumulatedSamples(state)) {
+            // Первая выборка идёт через центр пикселя, следующие — со случайным смещением
+            float jitterX = 0.0f, jitterY = 0.0f;
+            if (accum.sampleCount > 0) {
+                jitterX = jitterDist(rng) * 2.0f / static_cast<float>(accum.width);
+                jitterY = jitterDist(rng) * 2.0f / static_cast<float>(accum.height);
+            }
+
+            const int target = 1 - accum.current;
+            glBindFramebuffer(GL_FRAMEBUFFER, accum.framebuffers[target]);
+            glViewport(0, 0, accum.width, accum.height);
+            glUseProgram(shaderProgram);
+            tracerUniforms.jitter.set(glm::vec2(jitterX, jitterY));
+            tracerUniforms.sampleCount.set(static_cast<float>(accum.sampleCount));
+            glBindTexture(GL_TEXTURE_2D, accum.textures[accum.current]);
+
+            glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerIndex]);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glEndQuery(GL_TIME_ELAPSED);
+            timerPending[timerIndex] = true;
+            timerScale[timerIndex] = uploaded.resolutionScale;
+            timerIndex = 1 - timerIndex;
+
+            accum.current = target;
+            accum.sampleCount++;
+
+            // Отзыв LOD нужен только при потоковых текстурах
+            if (textureStreamer.size() > 0 && ++framesSinceFeedback >= TEXTURE_FEEDBACK_INTERVAL) {
+                requestFeedback(feedback, accum.framebuffers[target], accum.width, accum.height);
+                framesSinceFeedback = 0;
+            }
+
+            // Время предыдущей трассировки (если готово) управляет масштабом.
+            // Новый масштаб вступит в силу со следующего кадра и сбросит накопление.
+            // Замер кадра, трассированного ещё при прежнем масштабе, регулятору не
+            // передаётся: иначе одно превышение бюджета уменьшило бы масштаб дважды.
+            if (timerPending[timerIndex]) {
+                GLint available = 0;
+                glGetQueryObjectiv(timerQueries[timerIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available) {
+                    GLuint64 elapsedNs = 0;
+                    glGetQueryObjectui64v(timerQueries[timerIndex], GL_QUERY_RESULT, &elapsedNs);
+                    timerPending[timerIndex] = false;
+                    lastTraceMs = static_cast<float>(elapsedNs) * 1e-6f;
+                    if (timerScale[timerIndex] == resolution.scale)
+                        resolution.update(lastTraceMs);
+                }
+            }
+        }
+
+        // Вывод масштаба и времени трассировки в заголовок окна (два раза в секунду)
+        const double now = glfwGetTime();
+        if (now - lastReportTime >= 0.5) {
+            char title[192];
+            std::snprintf(title, sizeof(title), "Ray Tracing - масштаб %.2f (%dx%d), трассировка %.2f мс, выборок %d, текстуры %.1f МБ",
+                          resolution.scale, accum.width, accum.height, lastTraceMs, accum.sampleCount,
+                          static_cast<double>(textureStreamer.residentBytes()) / (1 << 20));
+            glfwSetWindowTitle(window, title);
+            lastReportTime = now;
+        }
+
+        // Вывод накопленного изображения на экран
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, state.width, state.height);
+        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glUseProgram(displayProgram);
+        outputSizeUniform.set(glm::vec2(static_cast<float>(state.width), static_cast<float>(state.height)));
+        glBindTexture(GL_TEXTURE_2D, accum.textures[accum.current]);
         glDrawArrays(GL_TRIANGLES, 0, 6);
         glBindVertexArray(0);
 
-        // Обмен буферов и обработка событий
+        // Обмен буферов
         glfwSwapBuffers(window);
-        glfwPollEvents();
     }
 
     // Очистка ресурсов
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
-    glDeleteProgram(shaderProgram);
+    glDeleteQueries(2, timerQueries);
+    textureStreamer.clear();
+    destroyFeedbackReadback(feedback);
+    destroyAccumulationBuffer(accum);
+    tracerVariants.clear();
+    glDeleteProgram(displayProgram);
 
     // Завершение работы GLFW
     glfwDestroyWindow(window);
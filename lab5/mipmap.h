@@ -0,0 +1,160 @@
+// mipmap.h
+// Построение mip-цепочки текстуры на CPU вместо glGenerateMipmap в потоке GL.
+// Фильтр — ящик 2x2 в линейном цвете: текселы sRGB переводятся в линейный цвет
+// по таблице, усредняются и кодируются обратно в sRGB по таблице на 65536
+// значений (шаг меньше самого мелкого шага sRGB у нуля). Альфа усредняется без
+// гамма-преобразования. Каждый уровень строится из предыдущего.
+//
+// Строки уровня делятся между потоками пула. В строке суммы каналов RGBA и
+// индексы таблицы кодирования считаются в одном регистре SSE2 (есть на любом
+// x86-64, в том числе в сборке lab5 без -march=native); выборки из таблиц
+// скалярные — gather AVX2 оказался медленнее отдельных загрузок.
+
+#pragma once
+
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#define MIP_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Строк уровня в одной задаче пула
+const int MIP_ROWS_PER_TASK = 16;
+
+// Число уровней полной цепочки (до 1x1)
+inline int mipLevelCount(int width, int height) {
+    int levels = 1;
+    for (int size = std::max(width, height); size > 1; size >>= 1)
+        ++levels;
+    return levels;
+}
+
+// Размер полной цепочки RGBA8 в байтах
+inline size_t mipChainSize(int width, int height) {
+    Texture chain;
+    chain.width = width;
+    chain.height = height;
+    return chain.levelOffset(mipLevelCount(width, height));
+}
+
+// Таблица декодирования: [0, 256) — sRGB в линейный цвет, [256, 512) — альфа (i / 255)
+struct MipDecodeTable {
+    float values[512];
+
+    MipDecodeTable() {
+        const float* srgb = srgbToLinearTable();
+        for (int i = 0; i < 256; ++i) {
+            values[i] = srgb[i];
+            values[256 + i] = static_cast<float>(i) / 255.0f;
+        }
+    }
+};
+
+// Таблица кодирования: линейный цвет round(c * 65535) -> sRGB 0..255
+struct MipEncodeTable {
+    uint8_t values[65536];
+
+    MipEncodeTable() {
+        for (int i = 0; i < 65536; ++i) {
+            const float c = static_cast<float>(i) / 65535.0f;
+            const float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            values[i] = static_cast<uint8_t>(std::min(255.0f, srgb * 255.0f + 0.5f));
+        }
+    }
+};
+
+inline const float* mipDecodeTable() {
+    static const MipDecodeTable table; // Потокобезопасная инициализация (C++11)
+    return table.values;
+}
+
+inline const uint8_t* mipEncodeTable() {
+    static const MipEncodeTable table;
+    return table.values;
+}
+
+// Множители суммы четырёх текселов: среднее сразу в индекс таблицы
+// кодирования (цвет) или в 0..255 (альфа)
+const float MIP_COLOR_SCALE = 0.25f * 65535.0f;
+const float MIP_ALPHA_SCALE = 0.25f * 255.0f;
+
+// Строки [y0, y1) уровня dst из уровня src. Нечётный последний столбец или
+// строка источника отбрасываются, у источника шириной (высотой) 1 берётся
+// один и тот же тексел дважды.
+inline void downsampleRows(const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst, int dstWidth, int y0, int y1) {
+    const float* decode = mipDecodeTable();
+    const uint8_t* encode = mipEncodeTable();
+    const int dx = srcWidth > 1 ? 1 : 0;
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t* row0 = src + static_cast<size_t>(std::min(2 * y, srcHeight - 1)) * srcWidth * 4;
+        const uint8_t* row1 = src + static_cast<size_t>(std::min(2 * y + 1, srcHeight - 1)) * srcWidth * 4;
+        uint8_t* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+        int x = 0;
+#if defined(MIP_USE_SSE2)
+        const __m128 scale = _mm_setr_ps(MIP_COLOR_SCALE, MIP_COLOR_SCALE, MIP_COLOR_SCALE, MIP_ALPHA_SCALE);
+        const __m128 limit = _mm_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (; x < dstWidth; ++x) {
+            const uint8_t* a = row0 + 8 * x;
+            const uint8_t* b = row1 + 8 * x;
+            const int n = 4 * dx;
+            const __m128 left = _mm_add_ps(_mm_setr_ps(decode[a[0]], decode[a[1]], decode[a[2]], decode[256 + a[3]]),
+                                           _mm_setr_ps(decode[b[0]], decode[b[1]], decode[b[2]], decode[256 + b[3]]));
+            const __m128 right = _mm_add_ps(_mm_setr_ps(decode[a[n]], decode[a[n + 1]], decode[a[n + 2]], decode[256 + a[n + 3]]),
+                                            _mm_setr_ps(decode[b[n]], decode[b[n + 1]], decode[b[n + 2]], decode[256 + b[n + 3]]));
+            const __m128 value = _mm_add_ps(_mm_min_ps(_mm_mul_ps(_mm_add_ps(left, right), scale), limit), half);
+            alignas(16) int32_t index[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(value));
+            uint8_t* texel = out + 4 * x;
+            texel[0] = encode[index[0]];
+            texel[1] = encode[index[1]];
+            texel[2] = encode[index[2]];
+            texel[3] = static_cast<uint8_t>(index[3]);
+        }
+#endif
+        for (; x < dstWidth; ++x) {
+            const uint8_t* a = row0 + 8 * x;
+            const uint8_t* b = row1 + 8 * x;
+            const int n = 4 * dx;
+            uint8_t* texel = out + 4 * x;
+            for (int c = 0; c < 4; ++c) {
+                const int offset = c == 3 ? 256 : 0;
+                // Тот же порядок операций, что и в ветке SSE2
+                const float sum = (decode[offset + a[c]] + decode[offset + b[c]]) + (decode[offset + a[n + c]] + decode[offset + b[n + c]]);
+                const int index = static_cast<int>(std::min(sum * (c == 3 ? MIP_ALPHA_SCALE : MIP_COLOR_SCALE), c == 3 ? 255.0f : 65535.0f) + 0.5f);
+                texel[c] = c == 3 ? static_cast<uint8_t>(index) : encode[index];
+            }
+        }
+    }
+}
+
+// Достраивание полной mip-цепочки к уровню 0 (texture.levels == 1 на входе
+// или уровни перестраиваются заново). pool == nullptr — в текущем потоке.
+inline void generateMipmaps(Texture& texture, WorkStealingPool* pool = nullptr) {
+    texture.levels = mipLevelCount(texture.width, texture.height);
+    texture.rgba.resize(texture.levelOffset(texture.levels));
+    for (int level = 1; level < texture.levels; ++level) {
+        const uint8_t* src = texture.rgba.data() + texture.levelOffset(level - 1);
+        uint8_t* dst = texture.rgba.data() + texture.levelOffset(level);
+        const int srcWidth = texture.levelWidth(level - 1), srcHeight = texture.levelHeight(level - 1);
+        const int dstWidth = texture.levelWidth(level), dstHeight = texture.levelHeight(level);
+        const size_t tasks = static_cast<size_t>((dstHeight + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK);
+        auto task = [&](size_t index, unsigned) {
+            const int y0 = static_cast<int>(index) * MIP_ROWS_PER_TASK;
+            downsampleRows(src, srcWidth, srcHeight, dst, dstWidth, y0, std::min(dstHeight, y0 + MIP_ROWS_PER_TASK));
+        };
+        if (pool && tasks > 1)
+            pool->parallelFor(tasks, task);
+        else
+            for (size_t i = 0; i < tasks; ++i)
+                task(i, 0);
+    }
+}
@@ -0,0 +1,181 @@
+// program_reflection.h
+// Таблица униформов и атрибутов программы шейдеров, построенная один раз
+// через glGetActiveUniform / glGetActiveAttrib. Имена элементов массивов и
+// полей структур ("uSpheres[3].material.ambient") попадают в таблицу целиком,
+// поэтому строки не собираются по частям, а поиск — одно обращение к хэш-таблице.
+// Полученные объекты Uniform хранят местоположение и тип, и передача значений
+// в цикле рендеринга идёт без поиска.
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Описание активного униформа
+struct UniformInfo {
+    GLint location;
+    GLenum type;
+    GLint size; // Число элементов (для массивов базовых типов)
+};
+
+// Целочисленные униформы: int, bool и сэмплеры (передаются через glUniform1i)
+inline bool isIntegerUniformType(GLenum type) {
+    switch (type) {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Типизированный униформ. Программа должна быть активна (glUseProgram),
+// как и при прямых вызовах glUniform*. Неактивный униформ (location = -1)
+// молча пропускается, так же как в OpenGL.
+class Uniform {
+public:
+    Uniform() : location_(-1), type_(GL_NONE) {}
+    Uniform(GLint location, GLenum type) : location_(location), type_(type) {}
+
+    bool valid() const { return location_ >= 0; }
+    GLint location() const { return location_; }
+    GLenum type() const { return type_; }
+
+    void set(float value) const {
+        assert(!valid() || type_ == GL_FLOAT);
+        glUniform1f(location_, value);
+    }
+    void set(int value) const {
+        assert(!valid() || isIntegerUniformType(type_));
+        glUniform1i(location_, value);
+    }
+    void set(const glm::vec2& value) const {
+        assert(!valid() || type_ == GL_FLOAT_VEC2);
+        glUniform2fv(location_, 1, glm::value_ptr(value));
+    }
+    void set(const glm::vec3& value) const {
+        assert(!valid() || type_ == GL_FLOAT_VEC3);
+        glUniform3fv(location_, 1, glm::value_ptr(value));
+    }
+    void set(const glm::vec4& value) const {
+        assert(!valid() || type_ == GL_FLOAT_VEC4);
+        glUniform4fv(location_, 1, glm::value_ptr(value));
+    }
+    void set(const glm::mat4& value) const {
+        assert(!valid() || type_ == GL_FLOAT_MAT4);
+        glUniformMatrix4fv(location_, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    // Массивы базовых типов: значения с этого элемента подряд
+    void set(const float* values, GLsizei count) const {
+        assert(!valid() || type_ == GL_FLOAT);
+        glUniform1fv(location_, count, values);
+    }
+    void set(const glm::vec3* values, GLsizei count) const {
+        assert(!valid() || type_ == GL_FLOAT_VEC3);
+        glUniform3fv(location_, count, glm::value_ptr(values[0]));
+    }
+    void set(const glm::vec4* values, GLsizei count) const {
+        assert(!valid() || type_ == GL_FLOAT_VEC4);
+        glUniform4fv(location_, count, glm::value_ptr(values[0]));
+    }
+
+private:
+    GLint location_;
+    GLenum type_;
+};
+
+class ProgramReflection {
+public:
+    ProgramReflection() : program_(0) {}
+
+    // Перечисление активных униформов и атрибутов (один раз после линковки)
+    explicit ProgramReflection(GLuint program) : program_(program) {
+        GLint uniformCount = 0, uniformMaxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformMaxLength);
+        uniforms_.reserve(static_cast<size_t>(uniformCount));
+
+        std::vector<char> name(static_cast<size_t>(uniformMaxLength) + 1);
+        for (GLint i = 0; i < uniformCount; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+            std::string uniformName(name.data(), static_cast<size_t>(length));
+
+            GLint location = glGetUniformLocation(program, uniformName.c_str());
+            if (location < 0)
+                continue; // Униформ из блока: у него нет местоположения
+
+            UniformInfo info = { location, type, size };
+            uniforms_[uniformName] = info;
+
+            // Массив базового типа приходит одной записью "name[0]" с size > 1:
+            // имя без индекса и остальные элементы добавляются явно
+            const std::string suffix = "[0]";
+            if (uniformName.size() > suffix.size() &&
+                uniformName.compare(uniformName.size() - suffix.size(), suffix.size(), suffix) == 0) {
+                const std::string base = uniformName.substr(0, uniformName.size() - suffix.size());
+                uniforms_[base] = info;
+                for (GLint element = 1; element < size; ++element) {
+                    const std::string elementName = base + "[" + std::to_string(element) + "]";
+                    UniformInfo elementInfo = { glGetUniformLocation(program, elementName.c_str()), type, size - element };
+                    uniforms_[elementName] = elementInfo;
+                }
+            }
+        }
+
+        GLint attribCount = 0, attribMaxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &attribCount);
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attribMaxLength);
+        name.assign(static_cast<size_t>(attribMaxLength) + 1, '\0');
+        for (GLint i = 0; i < attribCount; ++i) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = GL_NONE;
+            glGetActiveAttrib(program, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), &length, &size, &type, name.data());
+            std::string attribName(name.data(), static_cast<size_t>(length));
+            attributes_[attribName] = glGetAttribLocation(program, attribName.c_str());
+        }
+    }
+
+    GLuint program() const { return program_; }
+
+    // Униформ по полному имени; для неактивного — пустой Uniform
+    Uniform uniform(const std::string& name) const {
+        auto it = uniforms_.find(name);
+        if (it == uniforms_.end())
+            return Uniform();
+        return Uniform(it->second.location, it->second.type);
+    }
+
+    // Местоположение атрибута; -1, если атрибут неактивен
+    GLint attribute(const std::string& name) const {
+        auto it = attributes_.find(name);
+        return it == attributes_.end() ? -1 : it->second;
+    }
+
+    const std::unordered_map<std::string, UniformInfo>& uniforms() const { return uniforms_; }
+
+private:
+    GLuint program_;
+    std::unordered_map<std::string, UniformInfo> uniforms_;
+    std::unordered_map<std::string, GLint> attributes_;
+};
@@ -0,0 +1,1000 @@
+// raytracer.h
+// CPU-версия трассировщика лучей из фрагментного шейдера lab5/main.cpp.
+// Функции повторяют generateRay / intersectPlane / getColor и цикл отражений
+// с MAX_DEPTH (сферы проверяются векторными ядрами simd_sphere.h через BVH),
+// поэтому изображение совпадает с GPU-версией.
+
+#pragma once
+
+#include "bvh.h"
+#include "instancing.h"
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Максимальная глубина итераций для отражений
+const int MAX_DEPTH = 5;
+
+// Размер тайла в пикселях
+const int TILE_SIZE = 16;
+
+// Лучей в одной задаче пула при трассировке очередей лучей по отскокам
+const size_t RAY_QUEUE_CHUNK = 4096;
+
+// Предел числа выборок в одной полосе строк кадра при трассировке очередями:
+// очереди и цвета выборок выделяются на полосу и переиспользуются
+const size_t RAY_QUEUE_BATCH = 1 << 18;
+
+// Трассировка путей: предел длины пути (пути обычно раньше обрывает русская
+// рулетка) и число отскоков, после которого рулетка включается
+const int PATH_MAX_BOUNCES = 32;
+const int PATH_ROULETTE_START = 2;
+
+// 1 / pi: нормировка ламбертовой BRDF (diffuse / pi)
+const float INV_PI = 0.31830988f;
+
+// Адаптивная выборка: выборок на пиксель в первом проходе по всем тайлам,
+// порция выборок в следующих раундах и добавка к яркости в относительной ошибке
+// (чтобы почти чёрные пиксели не требовали бесконечного числа выборок)
+const int ADAPTIVE_MIN_SAMPLES = 4;
+const int ADAPTIVE_BATCH = 4;
+const float ADAPTIVE_LUMINANCE_EPSILON = 0.01f;
+
+// Цвет неба
+const glm::vec3 SKY_COLOR(0.2f, 0.7f, 0.8f);
+
+// Класс для луча
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+};
+
+// Базис камеры, вычисляется один раз на кадр
+struct CameraBasis {
+    glm::vec3 position;
+    glm::vec3 dir;
+    glm::vec3 right;
+    glm::vec3 up;
+    float angle;
+    float aspectRatio;
+};
+
+// Изображение в линейном цвете (до гамма-коррекции)
+struct Framebuffer {
+    int width = 0;
+    int height = 0;
+    std::vector<glm::vec3> pixels;
+
+    Framebuffer() = default;
+    Framebuffer(int w, int h) : width(w), height(h), pixels(static_cast<size_t>(w) * h) {}
+
+    glm::vec3& at(int x, int y) { return pixels[static_cast<size_t>(y) * width + x]; }
+    const glm::vec3& at(int x, int y) const { return pixels[static_cast<size_t>(y) * width + x]; }
+};
+
+// Метод расчёта освещения
+enum class Integrator {
+    Whitted, // Как в шейдере: локальное освещение и зеркальные отражения до maxDepth
+    Path     // Монте-Карло трассировка путей с NEE и русской рулеткой
+};
+
+// Порядок трассировки лучей кадра
+enum class RayOrder {
+    Pixel,  // По тайлам: луч пикселя прослеживается через все отскоки (traceRay)
+    Queued, // Очередями по отскокам: лучи одного отскока всего кадра подряд, в порядке пикселей
+    Binned  // Как Queued, но отражённые лучи перед отскоком разложены по корзинам
+};
+
+// Параметры рендеринга
+struct RenderSettings {
+    int width = 800;
+    int height = 600;
+    int maxDepth = MAX_DEPTH; // Только для Integrator::Whitted
+    int samplesPerPixel = 1;  // Первая выборка — центр пикселя, остальные со смещением
+    Integrator integrator = Integrator::Whitted;
+
+    // Порядок трассировки лучей (только Integrator::Whitted без адаптивной выборки)
+    RayOrder rayOrder = RayOrder::Pixel;
+
+    // Адаптивная выборка (при adaptiveThreshold > 0): samplesPerPixel задаёт средний
+    // бюджет на пиксель, тайлы с относительной ошибкой ниже порога перестают получать
+    // выборки, а освободившийся бюджет уходит шумным тайлам, но не больше
+    // adaptiveMaxSamples на пиксель (0 — 8 * samplesPerPixel)
+    float adaptiveThreshold = 0.0f;
+    int adaptiveMaxSamples = 0;
+};
+
+// Итоги адаптивной выборки: число выборок на пиксель в каждом тайле
+struct AdaptiveStats {
+    int tilesX = 0;
+    int tilesY = 0;
+    int maxSamples = 0;
+    int rounds = 0;
+    uint64_t samples = 0;       // Всего выборок в кадре
+    size_t convergedTiles = 0;  // Тайлы с ошибкой ниже порога
+    std::vector<int> tileSamples;
+
+    int samplesAt(int x, int y) const { return tileSamples[static_cast<size_t>(y / TILE_SIZE) * tilesX + x / TILE_SIZE]; }
+};
+
+// Счётчики выпущенных лучей (для оценки пропускной способности)
+struct RayCounters {
+    uint64_t primary = 0;
+    uint64_t shadow = 0;
+    uint64_t reflection = 0;
+
+    uint64_t total() const { return primary + shadow + reflection; }
+
+    RayCounters& operator+=(const RayCounters& other) {
+        primary += other.primary;
+        shadow += other.shadow;
+        reflection += other.reflection;
+        return *this;
+    }
+};
+
+inline CameraBasis makeCameraBasis(const Camera& camera, float aspectRatio) {
+    CameraBasis basis;
+    basis.position = camera.position;
+    basis.dir = glm::normalize(camera.target - camera.position);
+    basis.right = glm::normalize(glm::cross(basis.dir, glm::vec3(0.0f, 1.0f, 0.0f)));
+    basis.up = glm::cross(basis.right, basis.dir);
+    basis.angle = std::tan(glm::radians(camera.fov) / 2.0f);
+    basis.aspectRatio = aspectRatio;
+    return basis;
+}
+
+// Функция для генерации луча через пиксель (x, y — нормализованные координаты [-1, 1])
+inline Ray generateRay(float x, float y, const CameraBasis& basis) {
+    Ray r;
+    r.origin = basis.position;
+    r.direction = glm::normalize(basis.dir + basis.right * (x * basis.angle * basis.aspectRatio) + basis.up * (y * basis.angle));
+    return r;
+}
+
+// Функция для пересечения луча с плоскостью
+inline bool intersectPlane(const Ray& ray, const Plane& plane, float& t) {
+    float denom = glm::dot(plane.normal, ray.direction);
+    if (std::fabs(denom) > 1e-6f) { // Не параллельно
+        t = glm::dot(plane.point - ray.origin, plane.normal) / denom;
+        return (t >= 0.0f);
+    }
+    return false;
+}
+
+// Фоновая (ambient) часть цвета точки: от тени не зависит
+inline glm::vec3 getAmbient(const Material& mat, const Light& light) {
+    return mat.ambient * light.color;
+}
+
+// Прямой свет источника в точке: диффузная часть и блик (то, что убирает тень).
+// diffuseScale — множитель диффузной части (INV_PI для ламбертовой BRDF в tracePath)
+inline glm::vec3 getDirect(const Material& mat, const glm::vec3& hitPoint, const glm::vec3& normal,
+                           const glm::vec3& viewDir, const Light& light, float diffuseScale = 1.0f) {
+    glm::vec3 lightDir = glm::normalize(light.position - hitPoint);
+    float diff = std::max(glm::dot(normal, lightDir), 0.0f);
+    glm::vec3 diffuse = mat.diffuse * diff * light.color * diffuseScale;
+
+    // Specular
+    glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+    float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), mat.shininess);
+    glm::vec3 specular = mat.specular * spec * light.color;
+
+    return diffuse + specular;
+}
+
+// Функция для получения цвета из материала с учётом освещения
+inline glm::vec3 getColor(const Material& mat, const glm::vec3& hitPoint, const glm::vec3& normal,
+                          const glm::vec3& viewDir, const Light& light, bool inShadow) {
+    glm::vec3 ambient = getAmbient(mat, light);
+    if (inShadow)
+        return ambient;
+    return ambient + getDirect(mat, hitPoint, normal, viewDir, light);
+}
+
+// Ускоряющие структуры сцены: BVH сфер и двухуровневая BVH экземпляров сеток
+struct SceneBVH {
+    SphereBVH spheres;
+    InstanceBVH instances;
+
+    void build(const Scene& scene) {
+        spheres.build(scene.spheres);
+        instances.build(scene.meshes, scene.instances);
+    }
+};
+
+// Ближайшее пересечение луча со сценой. Номер объекта: сфера из [0, N),
+// N — плоскость, N + 1 — экземпляр сетки (какой и какой треугольник — в meshHit),
+// -1 — промах.
+inline int intersectScene(const Scene& scene, const SceneBVH& bvh, const Ray& ray, float& tMin, MeshHit& meshHit) {
+    const int planeObject = static_cast<int>(scene.spheres.size()); // Индекс плоскости идёт после сфер
+    int hitObject = -1;
+    float t;
+
+    // Проверка пересечения с сферами (упорядоченный обход BVH)
+    bvh.spheres.intersectClosest(ray.origin, ray.direction, tMin, hitObject);
+
+    // Проверка пересечения с плоскостью
+    if (intersectPlane(ray, scene.floorPlane, t) && t < tMin) {
+        tMin = t;
+        hitObject = planeObject;
+    }
+
+    // Экземпляры сеток (TLAS/BLAS)
+    if (!bvh.instances.empty() && bvh.instances.intersectClosest(ray.origin, ray.direction, tMin, meshHit))
+        hitObject = planeObject + 1;
+    return hitObject;
+}
+
+// Тексел уровня 0 в линейном цвете
+inline glm::vec3 texelLinear(const Texture& texture, int x, int y) {
+    const float* table = srgbToLinearTable();
+    const uint8_t* texel = texture.pixels() + (static_cast<size_t>(y) * texture.width + x) * 4;
+    return glm::vec3(table[texel[0]], table[texel[1]], table[texel[2]]);
+}
+
+// Билинейная выборка уровня 0 с повтором, как GL_LINEAR / GL_REPEAT у текстуры
+// GL_SRGB8_ALPHA8: текселы переводятся в линейный цвет до фильтрации
+inline glm::vec3 sampleTexture(const Texture& texture, const glm::vec2& uv) {
+    const float x = uv.x * static_cast<float>(texture.width) - 0.5f;
+    const float y = uv.y * static_cast<float>(texture.height) - 0.5f;
+    const float fx = std::floor(x), fy = std::floor(y);
+    const float tx = x - fx, ty = y - fy;
+    auto wrap = [](int i, int size) { i %= size; return i < 0 ? i + size : i; };
+    const int x0 = wrap(static_cast<int>(fx), texture.width), x1 = wrap(x0 + 1, texture.width);
+    const int y0 = wrap(static_cast<int>(fy), texture.height), y1 = wrap(y0 + 1, texture.height);
+    const glm::vec3 top = texelLinear(texture, x0, y0) * (1.0f - tx) + texelLinear(texture, x1, y0) * tx;
+    const glm::vec3 bottom = texelLinear(texture, x0, y1) * (1.0f - tx) + texelLinear(texture, x1, y1) * tx;
+    return top * (1.0f - ty) + bottom * ty;
+}
+
+// Текстурные координаты сферы: долгота и широта по нормали (v = 0 на полюсе +Y)
+inline glm::vec2 sphereTexCoord(const glm::vec3& normal) {
+    const float u = 0.5f + std::atan2(normal.z, normal.x) * (0.5f / 3.14159265f);
+    const float v = std::acos(glm::clamp(normal.y, -1.0f, 1.0f)) * (1.0f / 3.14159265f);
+    return glm::vec2(u, v);
+}
+
+// Текстурные координаты сетки: проекция на грань куба [-0.5, 0.5] по
+// наибольшей компоненте локальной нормали. У makeCubeMesh каждая грань
+// получает квадрат [0, 1] с v = 0 сверху (у верхней и нижней граней — по z).
+inline glm::vec2 boxTexCoord(const glm::vec3& localPoint, const glm::vec3& localNormal) {
+    const glm::vec3 p = localPoint + glm::vec3(0.5f);
+    const glm::vec3 n = glm::abs(localNormal);
+    if (n.x >= n.y && n.x >= n.z)
+        return glm::vec2(p.z, 1.0f - p.y);
+    if (n.z >= n.y)
+        return glm::vec2(p.x, 1.0f - p.y);
+    return glm::vec2(p.x, p.z);
+}
+
+// Перевод координат в область атласа (Material::textureRegion) с повтором внутри области
+inline glm::vec2 regionTexCoord(const glm::vec4& region, const glm::vec2& uv) {
+    return glm::vec2(region.x, region.y) + (uv - glm::floor(uv)) * glm::vec2(region.z, region.w);
+}
+
+// Текстурные координаты плоскости: проекция на два направления в плоскости
+// (в единицах длины сцены)
+inline glm::vec2 planeTexCoord(const Plane& plane, const glm::vec3& hitPoint) {
+    const glm::vec3 tangent = glm::normalize(glm::cross(plane.normal, std::fabs(plane.normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                                                                                    : glm::vec3(1.0f, 0.0f, 0.0f)));
+    const glm::vec3 bitangent = glm::cross(plane.normal, tangent);
+    const glm::vec3 offset = hitPoint - plane.point;
+    return glm::vec2(glm::dot(offset, tangent), glm::dot(offset, bitangent));
+}
+
+// Нормаль и материал в точке попадания. У материала с текстурой ambient и
+// diffuse умножаются на цвет текстуры в точке; такой материал собирается в
+// textured. Текстурные координаты сфер — широта и долгота, плоскости — проекция
+// на плоскость, сеток — проекция на грани куба; у материала из атласа
+// координаты затем переводятся в его область.
+inline const Material& surfaceAt(const Scene& scene, const SceneBVH& bvh, int hitObject, const MeshHit& meshHit,
+                                 const Ray& ray, const glm::vec3& hitPoint, glm::vec3& normal, Material& textured) {
+    const int planeObject = static_cast<int>(scene.spheres.size());
+    const Material* material;
+    if (hitObject < planeObject) {
+        normal = glm::normalize(hitPoint - scene.spheres.center(hitObject));
+        material = &scene.materials[scene.spheres.materialIndex[hitObject]];
+    }
+    else if (hitObject == planeObject) {
+        normal = scene.floorPlane.normal;
+        material = &scene.materials[scene.floorPlane.materialIndex];
+    }
+    else {
+        normal = bvh.instances.normal(meshHit, ray.direction);
+        material = &scene.materials[bvh.instances.materialIndex(meshHit)];
+    }
+    if (material->texture < 0)
+        return *material;
+
+    glm::vec2 uv;
+    if (hitObject < planeObject)
+        uv = sphereTexCoord(normal);
+    else if (hitObject == planeObject)
+        uv = planeTexCoord(scene.floorPlane, hitPoint);
+    else
+        uv = boxTexCoord(bvh.instances.localPoint(meshHit, hitPoint), bvh.instances.localNormal(meshHit));
+    uv *= material->textureScale;
+    if (material->textureRegion != glm::vec4(0.0f, 0.0f, 1.0f, 1.0f))
+        uv = regionTexCoord(material->textureRegion, uv);
+    const glm::vec3 color = sampleTexture(scene.textures[material->texture], uv);
+    textured = *material;
+    textured.ambient *= color;
+    textured.diffuse *= color;
+    return textured;
+}
+
+// Закрыт ли источник света: сферы (кроме hitObject), плоскость (если луч вышел
+// не из неё) и сетки
+inline bool occluded(const Scene& scene, const SceneBVH& bvh, const Ray& shadowRay, int hitObject) {
+    const int planeObject = static_cast<int>(scene.spheres.size());
+    bool inShadow = bvh.spheres.intersectAny(shadowRay.origin, shadowRay.direction, hitObject);
+    if (!inShadow && hitObject != planeObject) {
+        float tShadow;
+        if (intersectPlane(shadowRay, scene.floorPlane, tShadow))
+            inShadow = true;
+    }
+    if (!inShadow && !bvh.instances.empty())
+        inShadow = bvh.instances.intersectAny(shadowRay.origin, shadowRay.direction);
+    return inShadow;
+}
+
+// Трассировка одного луча с итеративными отражениями (цикл из main() шейдера).
+// Сферы и сетки перебираются через BVH, построенную по сцене.
+inline glm::vec3 traceRay(const Scene& scene, const SceneBVH& bvh, Ray currentRay, int maxDepth, RayCounters& counters) {
+    glm::vec3 finalColor(0.0f);
+    float currentReflection = 1.0f;
+
+    for (int depth = 0; depth < maxDepth; ++depth) {
+        float tMin = 1e20f;
+        MeshHit meshHit;
+
+        if (depth == 0)
+            ++counters.primary;
+        else
+            ++counters.reflection;
+
+        const int hitObject = intersectScene(scene, bvh, currentRay, tMin, meshHit);
+
+        // Если ничего не пересекло, добавить цвет фона и выйти из цикла
+        if (hitObject == -1) {
+            finalColor += currentReflection * SKY_COLOR;
+            break;
+        }
+
+        // Определение точки пересечения и нормали
+        glm::vec3 hitPoint = currentRay.origin + currentRay.direction * tMin;
+        glm::vec3 normal;
+        Material textured;
+        const Material* material = &surfaceAt(scene, bvh, hitObject, meshHit, currentRay, hitPoint, normal, textured);
+
+        glm::vec3 viewDir = glm::normalize(-currentRay.direction);
+
+        // Проверка теней
+        Ray shadowRay;
+        shadowRay.origin = hitPoint + normal * 1e-4f;
+        shadowRay.direction = glm::normalize(scene.light.position - hitPoint);
+        bool inShadow = occluded(scene, bvh, shadowRay, hitObject);
+        ++counters.shadow;
+
+        glm::vec3 color = getColor(*material, hitPoint, normal, viewDir, scene.light, inShadow);
+
+        // Добавление цвета с учётом текущего отражения
+        finalColor += currentReflection * color;
+
+        // Обработка отражения
+        if (material->reflection > 0.0f) {
+            glm::vec3 reflectDir = glm::reflect(currentRay.direction, normal);
+            currentRay.origin = hitPoint + reflectDir * 1e-4f;
+            currentRay.direction = reflectDir;
+            currentReflection *= material->reflection;
+        }
+        else {
+            break; // Если материал не отражает, выйти из цикла
+        }
+    }
+
+    return finalColor;
+}
+
+inline glm::vec3 traceRay(const Scene& scene, const SceneBVH& bvh, Ray currentRay, int maxDepth) {
+    RayCounters counters;
+    return traceRay(scene, bvh, currentRay, maxDepth, counters);
+}
+
+// Хэш PCG (RXS-M-XS) одного 32-битного слова
+inline uint32_t pcgHash(uint32_t value) {
+    uint32_t state = value * 747796405u + 2891336453u;
+    uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// Детерминированный хэш для смещений выборок внутри пикселя:
+// изображение не зависит от числа потоков и порядка обработки тайлов
+inline uint32_t hashSample(uint32_t x, uint32_t y, uint32_t sample) {
+    return pcgHash(x * 747796405u + y * 2891336453u + sample * 277803737u + 1u);
+}
+
+// Случайное число из [0, 1) по хэшу (24 старших бита)
+inline float hashToUnit(uint32_t hash) {
+    return static_cast<float>(hash >> 8) * (1.0f / 16777216.0f);
+}
+
+// Поток случайных чисел одной выборки (состояние — последний хэш)
+struct SampleRandom {
+    uint32_t state;
+
+    explicit SampleRandom(uint32_t seed) : state(seed) {}
+
+    float next() {
+        state = pcgHash(state);
+        return hashToUnit(state);
+    }
+};
+
+// Направление в полусфере вокруг n с плотностью cos(theta) / pi
+inline glm::vec3 cosineSampleHemisphere(const glm::vec3& n, float u1, float u2) {
+    const float r = std::sqrt(u1);
+    const float phi = 6.28318531f * u2;
+    const glm::vec3 helper = std::fabs(n.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 tangent = glm::normalize(glm::cross(n, helper));
+    const glm::vec3 bitangent = glm::cross(n, tangent);
+    return glm::normalize(tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) +
+                          n * std::sqrt(std::max(0.0f, 1.0f - u1)));
+}
+
+// Трассировка пути методом Монте-Карло.
+// Материал — смесь: с весом reflection зеркало, с весом 1 - reflection
+// диффузно-бликовая поверхность (диффузная часть по Ламберту, блик Фонга
+// только для прямого света, как в getColor). На каждом пересечении:
+//   - прямой свет от uLight считается явно (next-event estimation) теневым лучом;
+//     диффузная часть — с BRDF diffuse / pi, как у косинусной выборки ниже;
+//   - следующее направление выбирается по весам: зеркальное отражение
+//     или косинусное распределение (вес пути умножается на diffuse);
+//   - после PATH_ROULETTE_START отскоков путь с малым весом обрывается
+//     русской рулеткой, выжившие пути делятся на вероятность выживания.
+// Небо — источник света для ушедших лучей; ambient не нужен, его заменяет
+// переотражённый свет.
+inline glm::vec3 tracePath(const Scene& scene, const SceneBVH& bvh, Ray currentRay, SampleRandom& random,
+                           RayCounters& counters) {
+    glm::vec3 radiance(0.0f);
+    glm::vec3 throughput(1.0f);
+
+    for (int bounce = 0; bounce < PATH_MAX_BOUNCES; ++bounce) {
+        float tMin = 1e20f;
+        MeshHit meshHit;
+
+        if (bounce == 0)
+            ++counters.primary;
+        else
+            ++counters.reflection;
+
+        const int hitObject = intersectScene(scene, bvh, currentRay, tMin, meshHit);
+        if (hitObject == -1) {
+            radiance += throughput * SKY_COLOR;
+            break;
+        }
+
+        glm::vec3 hitPoint = currentRay.origin + currentRay.direction * tMin;
+        glm::vec3 normal;
+        Material textured;
+        const Material* material = &surfaceAt(scene, bvh, hitObject, meshHit, currentRay, hitPoint, normal, textured);
+
+        // Прямое освещение (NEE) для диффузно-бликовой части
+        const float mirror = glm::clamp(material->reflection, 0.0f, 1.0f);
+        if (mirror < 1.0f) {
+            Ray shadowRay;
+            shadowRay.origin = hitPoint + normal * 1e-4f;
+            shadowRay.direction = glm::normalize(scene.light.position - hitPoint);
+            bool inShadow = occluded(scene, bvh, shadowRay, hitObject);
+            ++counters.shadow;
+
+            if (!inShadow) {
+                glm::vec3 viewDir = -currentRay.direction;
+                glm::vec3 direct = getDirect(*material, hitPoint, normal, viewDir, scene.light, INV_PI);
+                radiance += throughput * (1.0f - mirror) * direct;
+            }
+        }
+
+        // Выбор следующего направления
+        glm::vec3 nextDir;
+        if (random.next() < mirror) {
+            nextDir = glm::reflect(currentRay.direction, normal);
+        }
+        else {
+            nextDir = cosineSampleHemisphere(normal, random.next(), random.next());
+            throughput *= material->diffuse;
+        }
+        currentRay.origin = hitPoint + nextDir * 1e-4f;
+        currentRay.direction = nextDir;
+
+        // Русская рулетка
+        if (bounce >= PATH_ROULETTE_START) {
+            const float survive = std::min(std::max(throughput.x, std::max(throughput.y, throughput.z)), 0.95f);
+            if (random.next() >= survive)
+                break;
+            throughput /= survive;
+        }
+    }
+
+    return radiance;
+}
+
+// Нормализованные координаты центра пикселя (строка 0 — верх изображения)
+inline glm::vec2 pixelToNdc(float px, float py, int width, int height) {
+    return glm::vec2(2.0f * px / width - 1.0f, 1.0f - 2.0f * py / height);
+}
+
+// Первичный луч выборки s пикселя (x, y): первая выборка через центр пикселя,
+// остальные со смещением по хэшу
+inline Ray sampleRay(const CameraBasis& basis, const RenderSettings& settings, int x, int y, int s) {
+    float dx = 0.5f, dy = 0.5f;
+    if (s > 0) {
+        dx = hashToUnit(hashSample(x, y, 2 * s));
+        dy = hashToUnit(hashSample(x, y, 2 * s + 1));
+    }
+    glm::vec2 ndc = pixelToNdc(x + dx, y + dy, settings.width, settings.height);
+    return generateRay(ndc.x, ndc.y, basis);
+}
+
+// Выборка s пикселя (x, y). Смещение и случайные числа зависят только от
+// пикселя и номера выборки, поэтому результат не зависит от порядка вычислений.
+inline glm::vec3 traceSample(const Scene& scene, const SceneBVH& bvh, const CameraBasis& basis,
+                             const RenderSettings& settings, int x, int y, int s, RayCounters& counters) {
+    Ray ray = sampleRay(basis, settings, x, y, s);
+    if (settings.integrator == Integrator::Path) {
+        SampleRandom random(hashSample(x, y, 0x80000000u | static_cast<uint32_t>(s)));
+        return tracePath(scene, bvh, ray, random, counters);
+    }
+    return traceRay(scene, bvh, ray, settings.maxDepth, counters);
+}
+
+// Рендеринг одного тайла
+inline void renderTile(const Scene& scene, const SceneBVH& bvh, const CameraBasis& basis,
+                       const RenderSettings& settings, Framebuffer& framebuffer, int tileX, int tileY,
+                       RayCounters& counters) {
+    const int x0 = tileX * TILE_SIZE;
+    const int y0 = tileY * TILE_SIZE;
+    const int x1 = std::min(x0 + TILE_SIZE, settings.width);
+    const int y1 = std::min(y0 + TILE_SIZE, settings.height);
+    const int samples = std::max(1, settings.samplesPerPixel);
+    RayCounters tileCounters; // Локальные счётчики: без записи в общую память на каждый луч
+
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            glm::vec3 color(0.0f);
+            for (int s = 0; s < samples; ++s)
+                color += traceSample(scene, bvh, basis, settings, x, y, s, tileCounters);
+            framebuffer.at(x, y) = color / static_cast<float>(samples);
+        }
+    }
+
+    counters += tileCounters;
+}
+
+inline float luminance(const glm::vec3& color) {
+    return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
+// Накопленные суммы адаптивной выборки: цвет и квадрат яркости каждого пикселя
+struct AdaptiveAccumulator {
+    std::vector<glm::vec3> sum;
+    std::vector<float> luminanceSquares;
+
+    explicit AdaptiveAccumulator(size_t pixels) : sum(pixels, glm::vec3(0.0f)), luminanceSquares(pixels, 0.0f) {}
+};
+
+// Добавление выборок [firstSample, firstSample + count) всем пикселям тайла.
+// Возвращает ошибку тайла: наибольшую по пикселям относительную стандартную
+// ошибку среднего яркости.
+inline float sampleTileAdaptive(const Scene& scene, const SceneBVH& bvh, const CameraBasis& basis,
+                                const RenderSettings& settings, AdaptiveAccumulator& accumulator, int tileX, int tileY,
+                                int firstSample, int count, RayCounters& counters) {
+    const int x0 = tileX * TILE_SIZE;
+    const int y0 = tileY * TILE_SIZE;
+    const int x1 = std::min(x0 + TILE_SIZE, settings.width);
+    const int y1 = std::min(y0 + TILE_SIZE, settings.height);
+    const int n = firstSample + count;
+    RayCounters tileCounters;
+    float tileError = 0.0f;
+
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            const size_t index = static_cast<size_t>(y) * settings.width + x;
+            glm::vec3 sum = accumulator.sum[index];
+            float squares = accumulator.luminanceSquares[index];
+            for (int s = firstSample; s < n; ++s) {
+                glm::vec3 color = traceSample(scene, bvh, basis, settings, x, y, s, tileCounters);
+                float l = luminance(color);
+                sum += color;
+                squares += l * l;
+            }
+            accumulator.sum[index] = sum;
+            accumulator.luminanceSquares[index] = squares;
+
+            if (n > 1) {
+                const float mean = luminance(sum) / n;
+                const float variance = std::max(0.0f, (squares / n - mean * mean) * n / (n - 1));
+                const float error = std::sqrt(variance / n) / (mean + ADAPTIVE_LUMINANCE_EPSILON);
+                tileError = std::max(tileError, error);
+            }
+        }
+    }
+
+    counters += tileCounters;
+    return tileError;
+}
+
+// Адаптивный рендеринг кадра раундами. В первом раунде каждый тайл получает
+// ADAPTIVE_MIN_SAMPLES выборок на пиксель. Дальше тайлы, ещё не прошедшие порог,
+// упорядочиваются по убыванию ошибки и получают по ADAPTIVE_BATCH выборок, пока
+// не кончится бюджет кадра (width * height * samplesPerPixel выборок) или не
+// сойдутся все тайлы. Ошибки и порядок не зависят от числа потоков, поэтому
+// изображение детерминировано.
+inline void renderImageAdaptive(const Scene& scene, const SceneBVH& bvh, const RenderSettings& settings,
+                                Framebuffer& framebuffer, WorkStealingPool& pool, RayCounters* counters,
+                                AdaptiveStats* stats) {
+    const CameraBasis basis = makeCameraBasis(scene.camera,
+                                              static_cast<float>(settings.width) / static_cast<float>(settings.height));
+    const int tilesX = (settings.width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (settings.height + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+    const int samplesPerPixel = std::max(1, settings.samplesPerPixel);
+    const int maxSamples = std::max(samplesPerPixel,
+                                    settings.adaptiveMaxSamples > 0 ? settings.adaptiveMaxSamples : 8 * samplesPerPixel);
+    const uint64_t budget = static_cast<uint64_t>(settings.width) * settings.height * samplesPerPixel;
+
+    AdaptiveAccumulator accumulator(static_cast<size_t>(settings.width) * settings.height);
+    std::vector<int> tileSamples(tileCount, 0);
+    std::vector<float> tileErrors(tileCount, 0.0f);
+    std::vector<RayCounters> workerCounters(pool.size());
+    std::vector<size_t> selected;
+    uint64_t used = 0;
+    int rounds = 0;
+
+    auto tilePixels = [&](size_t tile) {
+        const int tileX = static_cast<int>(tile % tilesX), tileY = static_cast<int>(tile / tilesX);
+        return static_cast<uint64_t>(std::min(TILE_SIZE, settings.width - tileX * TILE_SIZE)) *
+               std::min(TILE_SIZE, settings.height - tileY * TILE_SIZE);
+    };
+
+    for (;;) {
+        const int batch = rounds == 0 ? std::min(ADAPTIVE_MIN_SAMPLES, samplesPerPixel) : ADAPTIVE_BATCH;
+
+        // Выбор тайлов раунда: сначала самые шумные, пока хватает бюджета
+        selected.clear();
+        for (size_t tile = 0; tile < tileCount; ++tile) {
+            if (rounds == 0 || (tileErrors[tile] > settings.adaptiveThreshold && tileSamples[tile] < maxSamples))
+                selected.push_back(tile);
+        }
+        std::stable_sort(selected.begin(), selected.end(),
+                         [&](size_t a, size_t b) { return tileErrors[a] > tileErrors[b]; });
+        size_t taken = 0;
+        for (; taken < selected.size(); ++taken) {
+            const int count = std::min(batch, maxSamples - tileSamples[selected[taken]]);
+            const uint64_t cost = tilePixels(selected[taken]) * count;
+            if (rounds > 0 && used + cost > budget)
+                break;
+            used += cost;
+        }
+        selected.resize(taken);
+        if (selected.empty())
+            break;
+
+        pool.parallelFor(selected.size(), [&](size_t item, unsigned worker) {
+            const size_t tile = selected[item];
+            const int count = std::min(batch, maxSamples - tileSamples[tile]);
+            tileErrors[tile] = sampleTileAdaptive(scene, bvh, basis, settings, accumulator, static_cast<int>(tile % tilesX),
+                                                  static_cast<int>(tile / tilesX), tileSamples[tile], count,
+                                                  workerCounters[worker]);
+            tileSamples[tile] += count;
+        });
+        ++rounds;
+    }
+
+    // Итоговое изображение — среднее накопленных выборок
+    for (int y = 0; y < settings.height; ++y) {
+        for (int x = 0; x < settings.width; ++x) {
+            const size_t index = static_cast<size_t>(y) * settings.width + x;
+            framebuffer.pixels[index] = accumulator.sum[index] /
+                                        static_cast<float>(tileSamples[static_cast<size_t>(y / TILE_SIZE) * tilesX + x / TILE_SIZE]);
+        }
+    }
+
+    if (counters) {
+        for (const RayCounters& workerCounter : workerCounters)
+            *counters += workerCounter;
+    }
+    if (stats) {
+        stats->tilesX = tilesX;
+        stats->tilesY = tilesY;
+        stats->maxSamples = maxSamples;
+        stats->rounds = rounds;
+        stats->samples = used;
+        stats->convergedTiles = static_cast<size_t>(
+            std::count_if(tileErrors.begin(), tileErrors.end(), [&](float error) { return error <= settings.adaptiveThreshold; }));
+        stats->tileSamples.swap(tileSamples);
+    }
+}
+
+// Корзины отражённых лучей: октант направления и ячейка начала луча в сетке
+// 2^RAY_BIN_CELL_BITS по каждой оси (по коду Мортона, соседние ячейки рядом)
+const int RAY_BIN_CELL_BITS = 3;
+const uint32_t RAY_BIN_COUNT = 8u << (3 * RAY_BIN_CELL_BITS);
+
+// Лучей в одной задаче пула при раскладке по корзинам
+const size_t RAY_BIN_CHUNK = 65536;
+
+// Корзина луча: октант в старших битах, код Мортона ячейки начала — в младших.
+// Лучи одной корзины выходят из близких точек в одну сторону и обходят в
+// основном одни и те же узлы BVH.
+inline uint32_t rayBin(const Ray& ray, const AABB& bounds) {
+    const uint32_t octant = (ray.direction.x < 0.0f ? 1u : 0u) | (ray.direction.y < 0.0f ? 2u : 0u) |
+                            (ray.direction.z < 0.0f ? 4u : 0u);
+    const glm::vec3 extent = glm::max(bounds.bmax - bounds.bmin, glm::vec3(1e-6f));
+    const uint32_t cell = morton3D((ray.origin - bounds.bmin) / extent) >> (3 * (10 - RAY_BIN_CELL_BITS));
+    return (octant << (3 * RAY_BIN_CELL_BITS)) | cell;
+}
+
+// Порядок трассировки count лучей по корзинам: устойчивая сортировка подсчётом,
+// внутри корзины лучи остаются в исходном порядке (для отражённых лучей — в
+// порядке пикселей, который сам по себе связный). rayAt(i) возвращает i-й луч.
+template <class RayAt>
+std::vector<uint32_t> binnedRayOrder(size_t count, const RayAt& rayAt, WorkStealingPool& pool) {
+    const size_t chunks = (count + RAY_BIN_CHUNK - 1) / RAY_BIN_CHUNK;
+    std::vector<AABB> chunkBounds(chunks);
+    pool.parallelFor(chunks, [&](size_t chunk, unsigned) {
+        const size_t end = std::min(count, (chunk + 1) * RAY_BIN_CHUNK);
+        for (size_t i = chunk * RAY_BIN_CHUNK; i < end; ++i)
+            chunkBounds[chunk].grow(rayAt(i).origin);
+    });
+    AABB bounds;
+    for (const AABB& box : chunkBounds)
+        bounds.grow(box);
+
+    // Гистограммы корзин по кускам, затем смещения: корзина за корзиной, внутри
+    // корзины — куски по порядку
+    std::vector<uint16_t> bins(count);
+    std::vector<uint32_t> offsets(chunks * RAY_BIN_COUNT, 0);
+    pool.parallelFor(chunks, [&](size_t chunk, unsigned) {
+        uint32_t* histogram = &offsets[chunk * RAY_BIN_COUNT];
+        const size_t end = std::min(count, (chunk + 1) * RAY_BIN_CHUNK);
+        for (size_t i = chunk * RAY_BIN_CHUNK; i < end; ++i) {
+            bins[i] = static_cast<uint16_t>(rayBin(rayAt(i), bounds));
+            ++histogram[bins[i]];
+        }
+    });
+    uint32_t total = 0;
+    for (uint32_t bin = 0; bin < RAY_BIN_COUNT; ++bin) {
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            const uint32_t binCount = offsets[chunk * RAY_BIN_COUNT + bin];
+            offsets[chunk * RAY_BIN_COUNT + bin] = total;
+            total += binCount;
+        }
+    }
+
+    std::vector<uint32_t> order(count);
+    pool.parallelFor(chunks, [&](size_t chunk, unsigned) {
+        uint32_t* position = &offsets[chunk * RAY_BIN_COUNT];
+        const size_t end = std::min(count, (chunk + 1) * RAY_BIN_CHUNK);
+        for (size_t i = chunk * RAY_BIN_CHUNK; i < end; ++i)
+            order[position[bins[i]]++] = static_cast<uint32_t>(i);
+    });
+    return order;
+}
+
+// Строк кадра в одной полосе очередей лучей: не больше RAY_QUEUE_BATCH
+// выборок, но не меньше одной строки
+inline int rayQueueBatchRows(const RenderSettings& settings) {
+    const size_t rowSamples = static_cast<size_t>(settings.width) * std::max(1, settings.samplesPerPixel);
+    return static_cast<int>(std::min<size_t>(settings.height, std::max<size_t>(1, RAY_QUEUE_BATCH / rowSamples)));
+}
+
+// Рендеринг кадра очередями лучей (RayOrder::Queued и RayOrder::Binned).
+// Кадр обходится полосами строк (rayQueueBatchRows). Первичные лучи всех
+// выборок полосы трассируются одной очередью в порядке пикселей; на каждом
+// попадании сразу считается тень, а отражённый луч попадает в очередь
+// следующего отскока. Для RayOrder::Binned очередь перед отскоком
+// раскладывается по корзинам (binnedRayOrder). Задачи пула получают подряд
+// идущие куски очереди. Вклады отскоков складываются в цвет выборки в том же
+// порядке, что и в traceRay, поэтому изображение совпадает с RayOrder::Pixel
+// (побайтно, если компилятор не сливает умножение и сложение по-разному: -ffp-contract=off).
+inline void renderImageQueued(const Scene& scene, const SceneBVH& bvh, const RenderSettings& settings,
+                              Framebuffer& framebuffer, WorkStealingPool& pool, RayCounters* counters) {
+    struct QueuedRay {
+        Ray ray;
+        uint32_t sample;  // Номер выборки в полосе: (строка полосы * width + x) * samples + s
+        float reflection; // Накопленный коэффициент отражения
+    };
+
+    const CameraBasis basis = makeCameraBasis(scene.camera,
+                                              static_cast<float>(settings.width) / static_cast<float>(settings.height));
+    const int samples = std::max(1, settings.samplesPerPixel);
+    const int batchRows = rayQueueBatchRows(settings);
+    const size_t capacity = static_cast<size_t>(batchRows) * settings.width * samples;
+    std::vector<RayCounters> workerCounters(pool.size());
+
+    // Буферы полосы: отражённых лучей не больше, чем выборок, поэтому ёмкости
+    // хватает на все отскоки и все полосы
+    std::vector<glm::vec3> sampleColors(capacity);
+    std::vector<QueuedRay> queue, next;
+    queue.reserve(capacity);
+    next.reserve(capacity);
+    std::vector<std::vector<QueuedRay>> chunkOutputs;
+
+    for (int rowBegin = 0; rowBegin < settings.height; rowBegin += batchRows) {
+        const int rows = std::min(batchRows, settings.height - rowBegin);
+        const size_t batchSamples = static_cast<size_t>(rows) * settings.width * samples;
+        std::fill(sampleColors.begin(), sampleColors.begin() + batchSamples, glm::vec3(0.0f));
+
+        // Первичные лучи
+        queue.resize(batchSamples);
+        pool.parallelFor(static_cast<size_t>(rows), [&](size_t row, unsigned) {
+            const int y = rowBegin + static_cast<int>(row);
+            for (int x = 0; x < settings.width; ++x) {
+                for (int s = 0; s < samples; ++s) {
+                    const size_t sample = (row * settings.width + x) * samples + s;
+                    queue[sample].ray = sampleRay(basis, settings, x, y, s);
+                    queue[sample].sample = static_cast<uint32_t>(sample);
+                    queue[sample].reflection = 1.0f;
+                }
+            }
+        });
+
+        for (int depth = 0; depth < settings.maxDepth && !queue.empty(); ++depth) {
+            const size_t chunks = (queue.size() + RAY_QUEUE_CHUNK - 1) / RAY_QUEUE_CHUNK;
+            if (chunkOutputs.size() < chunks)
+                chunkOutputs.resize(chunks);
+            pool.parallelFor(chunks, [&](size_t chunk, unsigned worker) {
+                RayCounters& rayCounters = workerCounters[worker];
+                std::vector<QueuedRay>& output = chunkOutputs[chunk];
+                output.clear();
+                const size_t end = std::min(queue.size(), (chunk + 1) * RAY_QUEUE_CHUNK);
+                for (size_t i = chunk * RAY_QUEUE_CHUNK; i < end; ++i) {
+                    const QueuedRay& queued = queue[i];
+                    glm::vec3& color = sampleColors[queued.sample];
+                    float tMin = 1e20f;
+                    MeshHit meshHit;
+
+                    if (depth == 0)
+                        ++rayCounters.primary;
+                    else
+                        ++rayCounters.reflection;
+
+                    const int hitObject = intersectScene(scene, bvh, queued.ray, tMin, meshHit);
+                    if (hitObject == -1) {
+                        color += queued.reflection * SKY_COLOR;
+                        continue;
+                    }
+
+                    glm::vec3 hitPoint = queued.ray.origin + queued.ray.direction * tMin;
+                    glm::vec3 normal;
+                    Material textured;
+                    const Material& material = surfaceAt(scene, bvh, hitObject, meshHit, queued.ray, hitPoint, normal, textured);
+
+                    Ray shadowRay;
+                    shadowRay.origin = hitPoint + normal * 1e-4f;
+                    shadowRay.direction = glm::normalize(scene.light.position - hitPoint);
+                    bool inShadow = occluded(scene, bvh, shadowRay, hitObject);
+                    ++rayCounters.shadow;
+
+                    color += queued.reflection *
+                             getColor(material, hitPoint, normal, glm::normalize(-queued.ray.direction), scene.light, inShadow);
+
+                    if (material.reflection > 0.0f && depth + 1 < settings.maxDepth) {
+                        QueuedRay reflected;
+                        reflected.ray.direction = glm::reflect(queued.ray.direction, normal);
+                        reflected.ray.origin = hitPoint + reflected.ray.direction * 1e-4f;
+                        reflected.sample = queued.sample;
+                        reflected.reflection = queued.reflection * material.reflection;
+                        output.push_back(reflected);
+                    }
+                }
+            });
+
+            // Очередь следующего отскока: выходы кусков по порядку, для Binned — по корзинам
+            next.clear();
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+                next.insert(next.end(), chunkOutputs[chunk].begin(), chunkOutputs[chunk].end());
+            if (settings.rayOrder == RayOrder::Binned) {
+                const std::vector<uint32_t> order =
+                    binnedRayOrder(next.size(), [&](size_t i) -> const Ray& { return next[i].ray; }, pool);
+                queue.resize(next.size());
+                for (size_t i = 0; i < order.size(); ++i)
+                    queue[i] = next[order[i]];
+            }
+            else {
+                queue.swap(next);
+            }
+        }
+
+        // Среднее по выборкам пикселя (суммирование в порядке выборок, как в renderTile)
+        pool.parallelFor(static_cast<size_t>(rows), [&](size_t row, unsigned) {
+            for (int x = 0; x < settings.width; ++x) {
+                const size_t local = row * settings.width + x;
+                glm::vec3 color(0.0f);
+                for (int s = 0; s < samples; ++s)
+                    color += sampleColors[local * samples + s];
+                framebuffer.pixels[static_cast<size_t>(rowBegin) * settings.width + local] = color / static_cast<float>(samples);
+            }
+        });
+    }
+
+    if (counters) {
+        for (const RayCounters& workerCounter : workerCounters)
+            *counters += workerCounter;
+    }
+}
+
+// Рендеринг всего кадра: изображение разбивается на тайлы, тайлы раздаются пулу.
+// bvh должна быть построена по scene. Если counters задан, к нему
+// добавляется число лучей кадра. При settings.adaptiveThreshold > 0 выборка
+// адаптивная, и в adaptiveStats (если задан) записывается карта числа выборок;
+// порядок лучей Whitted задаёт settings.rayOrder.
+inline void renderImage(const Scene& scene, const SceneBVH& bvh, const RenderSettings& settings,
+                        Framebuffer& framebuffer, WorkStealingPool& pool, RayCounters* counters = nullptr,
+                        AdaptiveStats* adaptiveStats = nullptr) {
+    if (framebuffer.width != settings.width || framebuffer.height != settings.height)
+        framebuffer = Framebuffer(settings.width, settings.height);
+
+    if (settings.adaptiveThreshold > 0.0f) {
+        renderImageAdaptive(scene, bvh, settings, framebuffer, pool, counters, adaptiveStats);
+        return;
+    }
+    if (settings.rayOrder != RayOrder::Pixel && settings.integrator == Integrator::Whitted) {
+        renderImageQueued(scene, bvh, settings, framebuffer, pool, counters);
+        return;
+    }
+
+    const CameraBasis basis = makeCameraBasis(scene.camera,
+                                              static_cast<float>(settings.width) / static_cast<float>(settings.height));
+    const int tilesX = (settings.width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tilesY = (settings.height + TILE_SIZE - 1) / TILE_SIZE;
+
+    // Счётчики у каждого потока свои, суммируются после кадра
+    std::vector<RayCounters> workerCounters(pool.size());
+    pool.parallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t tile, unsigned worker) {
+        renderTile(scene, bvh, basis, settings, framebuffer, static_cast<int>(tile % tilesX), static_cast<int>(tile / tilesX),
+                   workerCounters[worker]);
+    });
+
+    if (counters) {
+        for (const RayCounters& workerCounter : workerCounters)
+            *counters += workerCounter;
+    }
+}
+
+// Применение гамма-коррекции и перевод в 8 бит (как при записи во фреймбуфер GL)
+inline std::vector<uint8_t> toRGB8(const Framebuffer& framebuffer) {
+    std::vector<uint8_t> rgb(framebuffer.pixels.size() * 3);
+    for (size_t i = 0; i < framebuffer.pixels.size(); ++i) {
+        for (int c = 0; c < 3; ++c) {
+            float value = std::pow(framebuffer.pixels[i][c], 1.0f / 2.2f);
+            value = std::min(std::max(value, 0.0f), 1.0f);
+            rgb[i * 3 + c] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+        }
+    }
+    return rgb;
+}
+
+// Тепловая карта числа выборок на пиксель: от синего (мало) через зелёный к красному
+// (предел adaptiveMaxSamples)
+inline std::vector<uint8_t> samplesHeatmapRGB8(const AdaptiveStats& stats, int width, int height) {
+    std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float t = static_cast<float>(stats.samplesAt(x, y)) / static_cast<float>(std::max(1, stats.maxSamples));
+            const glm::vec3 color(glm::clamp(2.0f * t - 1.0f, 0.0f, 1.0f), 1.0f - std::abs(2.0f * t - 1.0f),
+                                  glm::clamp(1.0f - 2.0f * t, 0.0f, 1.0f));
+            uint8_t* pixel = &rgb[(static_cast<size_t>(y) * width + x) * 3];
+            for (int c = 0; c < 3; ++c)
+                pixel[c] = static_cast<uint8_t>(color[c] * 255.0f + 0.5f);
+        }
+    }
+    return rgb;
+}
@@ -0,0 +1,547 @@
+// scene.h
+// Описание сцены для CPU-трассировщика (те же структуры, что и в шейдере lab5)
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Структура для материала
+struct Material {
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float shininess;
+    float reflection;          // Коэффициент отражения
+    int32_t texture = -1;      // Индекс в Scene::textures (-1 — без текстуры), умножает ambient и diffuse
+    float textureScale = 1.0f; // Множитель текстурных координат (повторы текстуры)
+    glm::vec4 textureRegion = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f); // Область атласа: начало (xy) и размер (zw)
+};
+
+inline bool operator==(const Material& a, const Material& b) {
+    return a.ambient == b.ambient && a.diffuse == b.diffuse && a.specular == b.specular &&
+           a.shininess == b.shininess && a.reflection == b.reflection &&
+           a.texture == b.texture && a.textureScale == b.textureScale && a.textureRegion == b.textureRegion;
+}
+
+// Таблица материалов без повторов: одинаковые материалы получают один индекс
+class MaterialTable {
+public:
+    uint32_t add(const Material& material) {
+        const size_t key = hashMaterial(material);
+        auto range = lookup_.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (items_[it->second] == material)
+                return it->second;
+        }
+        const uint32_t index = static_cast<uint32_t>(items_.size());
+        items_.push_back(material);
+        lookup_.emplace(key, index);
+        return index;
+    }
+
+    // Изменение материала на месте (например, коэффициента отражения с клавиатуры).
+    // Все сферы с этим индексом видят новое значение.
+    void set(uint32_t index, const Material& material) {
+        auto range = lookup_.equal_range(hashMaterial(items_[index]));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == index) {
+                lookup_.erase(it);
+                break;
+            }
+        }
+        items_[index] = material;
+        lookup_.emplace(hashMaterial(material), index);
+    }
+
+    const Material& operator[](uint32_t index) const { return items_[index]; }
+    size_t size() const { return items_.size(); }
+    const std::vector<Material>& items() const { return items_; }
+
+private:
+    static size_t hashMaterial(const Material& material) {
+        const float fields[] = {
+            material.ambient.x, material.ambient.y, material.ambient.z,
+            material.diffuse.x, material.diffuse.y, material.diffuse.z,
+            material.specular.x, material.specular.y, material.specular.z,
+            material.shininess, material.reflection,
+            static_cast<float>(material.texture), material.textureScale,
+            material.textureRegion.x, material.textureRegion.y, material.textureRegion.z, material.textureRegion.w
+        };
+        size_t hash = 0;
+        for (float field : fields) {
+            uint32_t bits;
+            std::memcpy(&bits, &field, sizeof(bits));
+            hash ^= std::hash<uint32_t>()(bits) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        }
+        return hash;
+    }
+
+    std::vector<Material> items_;
+    std::unordered_multimap<size_t, uint32_t> lookup_;
+};
+
+// Формат пикселей текстуры: RGBA8 или блоки 4x4 по 8 байт (texture_compress.h).
+// Сжатые форматы только для GPU: CPU-трассировщик читает RGBA8.
+enum class TextureFormat : uint32_t {
+    RGBA8 = 0,
+    BC1 = 1, // S3TC DXT1 (настольный GL)
+    ETC2 = 2 // ETC2 RGB8 (OpenGL ES 3.0, GL 4.3)
+};
+
+inline const char* textureFormatName(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::BC1:
+        return "BC1";
+    case TextureFormat::ETC2:
+        return "ETC2";
+    default:
+        return "RGBA8";
+    }
+}
+
+// Текстура: RGBA8 в sRGB, строки сверху вниз (как их отдаёт stb_image),
+// координата v = 0 соответствует верхней строке. В rgba подряд лежат levels
+// mip-уровней, начиная с полного (уровень 0); каждый следующий вдвое меньше.
+// У сжатой текстуры в rgba вместо текселов блоки (строки блоков сверху вниз).
+// Пиксели лежат либо в rgba, либо в отображённом в память файле кэша
+// (texture_cache.h) — тогда rgba пуст, а mapped указывает на уровень 0.
+struct Texture {
+    int width = 0;
+    int height = 0;
+    int levels = 1;
+    TextureFormat format = TextureFormat::RGBA8;
+    std::vector<uint8_t> rgba;
+    std::shared_ptr<const uint8_t> mapped; // Отображение освобождается с последней копией
+
+    const uint8_t* pixels() const { return mapped ? mapped.get() : rgba.data(); }
+
+    int levelWidth(int level) const { return std::max(1, width >> level); }
+    int levelHeight(int level) const { return std::max(1, height >> level); }
+    bool compressed() const { return format != TextureFormat::RGBA8; }
+
+    size_t levelSize(int level) const {
+        if (compressed())
+            return static_cast<size_t>((levelWidth(level) + 3) / 4) * ((levelHeight(level) + 3) / 4) * 8;
+        return static_cast<size_t>(levelWidth(level)) * levelHeight(level) * 4;
+    }
+
+    size_t levelOffset(int level) const {
+        size_t offset = 0;
+        for (int l = 0; l < level; ++l)
+            offset += levelSize(l);
+        return offset;
+    }
+};
+
+// Перевод sRGB (0..255) в линейный цвет по таблице
+struct SrgbToLinearTable {
+    float values[256];
+
+    SrgbToLinearTable() {
+        for (int i = 0; i < 256; ++i) {
+            const float c = static_cast<float>(i) / 255.0f;
+            values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+};
+
+inline const float* srgbToLinearTable() {
+    static const SrgbToLinearTable table; // Потокобезопасная инициализация (C++11)
+    return table.values;
+}
+
+// Структура для сферы (значение для добавления в сцену; хранятся сферы в SphereArray)
+struct Sphere {
+    glm::vec3 center;
+    float radius;
+    uint32_t materialIndex;
+};
+
+// Сферы сцены в виде структуры массивов: проходы пересечения читают только
+// координаты центров и радиусы, материалы лежат отдельно в MaterialTable
+struct SphereArray {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> radius;
+    std::vector<uint32_t> materialIndex;
+
+    size_t size() const { return radius.size(); }
+    bool empty() const { return radius.empty(); }
+
+    void reserve(size_t count) {
+        centerX.reserve(count);
+        centerY.reserve(count);
+        centerZ.reserve(count);
+        radius.reserve(count);
+        materialIndex.reserve(count);
+    }
+
+    void clear() {
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        radius.clear();
+        materialIndex.clear();
+    }
+
+    void push_back(const Sphere& sphere) {
+        centerX.push_back(sphere.center.x);
+        centerY.push_back(sphere.center.y);
+        centerZ.push_back(sphere.center.z);
+        radius.push_back(sphere.radius);
+        materialIndex.push_back(sphere.materialIndex);
+    }
+
+    glm::vec3 center(size_t i) const { return glm::vec3(centerX[i], centerY[i], centerZ[i]); }
+
+    void setCenter(size_t i, const glm::vec3& c) {
+        centerX[i] = c.x;
+        centerY[i] = c.y;
+        centerZ[i] = c.z;
+    }
+
+    Sphere operator[](size_t i) const {
+        Sphere sphere;
+        sphere.center = center(i);
+        sphere.radius = radius[i];
+        sphere.materialIndex = materialIndex[i];
+        return sphere;
+    }
+};
+
+// Структура для плоскости
+struct Plane {
+    glm::vec3 point;
+    glm::vec3 normal;
+    uint32_t materialIndex;
+};
+
+// Структура для источника света
+struct Light {
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+// Треугольная сетка в локальных координатах: по три вершины на треугольник
+// (без индексов, как cubeVertices в lab4). Хранится в сцене один раз,
+// сколько бы экземпляров её ни ссылалось.
+struct TriangleMesh {
+    std::vector<glm::vec3> positions;
+
+    size_t triangleCount() const { return positions.size() / 3; }
+};
+
+// Экземпляр сетки: матрица из локальных координат сетки в мировые и материал
+struct MeshInstance {
+    uint32_t mesh;
+    glm::mat4 transform;
+    uint32_t materialIndex;
+};
+
+// Параметры камеры (как uCameraPos / uFOV в шейдере, цель камеры фиксирована)
+struct Camera {
+    glm::vec3 position;
+    glm::vec3 target;
+    float fov;
+};
+
+// Сцена целиком
+struct Scene {
+    SphereArray spheres;
+    std::vector<TriangleMesh> meshes;
+    std::vector<MeshInstance> instances;
+    MaterialTable materials;
+    std::vector<Texture> textures;
+    Plane floorPlane;
+    Light light;
+    Camera camera;
+};
+
+// Добавление текстуры в сцену и назначение её материалу (с заданным числом
+// повторов). Материал меняется на месте, поэтому текстуру получают все
+// объекты с этим материалом.
+inline int32_t addTexture(Scene& scene, Texture texture) {
+    scene.textures.push_back(std::move(texture));
+    return static_cast<int32_t>(scene.textures.size() - 1);
+}
+
+inline void setMaterialTexture(Scene& scene, uint32_t materialIndex, int32_t texture, float scale) {
+    Material material = scene.materials[materialIndex];
+    material.texture = texture;
+    material.textureScale = scale;
+    scene.materials.set(materialIndex, material);
+}
+
+// Сцена из lab5/main.cpp: две сферы и пол
+inline Scene makeDefaultScene(float sphereReflection = 0.5f, float planeReflection = 0.3f) {
+    Scene scene;
+
+    // Первая сфера
+    Material red;
+    red.ambient = glm::vec3(0.1f, 0.0f, 0.0f);
+    red.diffuse = glm::vec3(0.6f, 0.0f, 0.0f);
+    red.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    red.shininess = 32.0f;
+    red.reflection = sphereReflection;
+
+    Sphere first;
+    first.center = glm::vec3(-1.0f, 1.0f, -3.0f);
+    first.radius = 1.0f;
+    first.materialIndex = scene.materials.add(red);
+    scene.spheres.push_back(first);
+
+    // Вторая сфера
+    Material blue;
+    blue.ambient = glm::vec3(0.0f, 0.0f, 0.1f);
+    blue.diffuse = glm::vec3(0.0f, 0.0f, 0.6f);
+    blue.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    blue.shininess = 32.0f;
+    blue.reflection = sphereReflection;
+
+    Sphere second;
+    second.center = glm::vec3(1.0f, 1.0f, -4.0f);
+    second.radius = 1.0f;
+    second.materialIndex = scene.materials.add(blue);
+    scene.spheres.push_back(second);
+
+    // Определение плоскости (пол)
+    Material floorMaterial;
+    floorMaterial.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
+    floorMaterial.diffuse = glm::vec3(0.6f, 0.6f, 0.6f);
+    floorMaterial.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    floorMaterial.shininess = 32.0f;
+    floorMaterial.reflection = planeReflection;
+
+    scene.floorPlane.point = glm::vec3(0.0f, 0.0f, 0.0f);
+    scene.floorPlane.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+    scene.floorPlane.materialIndex = scene.materials.add(floorMaterial);
+
+    // Определение источника света
+    scene.light.position = glm::vec3(2.0f, 4.0f, 2.0f);
+    scene.light.color = glm::vec3(1.0f, 1.0f, 1.0f); // Белый свет
+
+    // Определение параметров камеры
+    scene.camera.position = glm::vec3(0.0f, 2.0f, 5.0f);
+    scene.camera.target = glm::vec3(0.0f, 1.0f, -3.0f);
+    scene.camera.fov = 45.0f;
+
+    return scene;
+}
+
+// Небольшая палитра материалов для генерируемых объектов: одинаковые
+// материалы объединяются таблицей
+const size_t PALETTE_SIZE = 6;
+
+inline void addPaletteMaterials(Scene& scene, float reflection, uint32_t (&materials)[PALETTE_SIZE]) {
+    const glm::vec3 palette[PALETTE_SIZE] = {
+        glm::vec3(0.6f, 0.6f, 0.1f), glm::vec3(0.1f, 0.6f, 0.1f), glm::vec3(0.6f, 0.3f, 0.1f),
+        glm::vec3(0.5f, 0.1f, 0.6f), glm::vec3(0.6f, 0.6f, 0.6f), glm::vec3(0.1f, 0.5f, 0.6f)
+    };
+    for (size_t i = 0; i < PALETTE_SIZE; ++i) {
+        Material material;
+        material.ambient = palette[i] * 0.15f;
+        material.diffuse = palette[i];
+        material.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+        material.shininess = 32.0f;
+        material.reflection = reflection;
+        materials[i] = scene.materials.add(material);
+    }
+}
+
+// Добавление поля маленьких сфер на полу вокруг основных сфер сцены
+// (для проверки производительности на больших сценах). Сферы раскладываются
+// по сетке со случайным смещением и не пересекают уже имеющиеся сферы.
+inline void addSphereField(Scene& scene, size_t count, float reflection = 0.0f, uint32_t seed = 1) {
+    if (count == 0)
+        return;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    uint32_t materials[PALETTE_SIZE];
+    addPaletteMaterials(scene, reflection, materials);
+
+    // Квадратная сетка вокруг точки между основными сферами: размер поля растёт
+    // как корень из числа сфер, с запасом на клетки под основными сферами
+    const size_t existing = scene.spheres.size();
+    const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count) * 1.3 + 64.0)));
+    const float cell = 0.5f;
+    const float half = 0.5f * cell * static_cast<float>(side);
+    const glm::vec3 middle(0.0f, 0.0f, -3.5f);
+
+    scene.spheres.reserve(existing + count);
+    size_t added = 0;
+    for (size_t cellIndex = 0; cellIndex < side * side && added < count; ++cellIndex) {
+        Sphere sphere;
+        sphere.radius = cell * (0.15f + 0.2f * unit(rng));
+        sphere.center.x = middle.x - half + cell * (static_cast<float>(cellIndex % side) + 0.5f) + (unit(rng) - 0.5f) * (cell - 2.0f * sphere.radius);
+        sphere.center.z = middle.z - half + cell * (static_cast<float>(cellIndex / side) + 0.5f) + (unit(rng) - 0.5f) * (cell - 2.0f * sphere.radius);
+        sphere.center.y = sphere.radius;
+
+        bool overlaps = false;
+        for (size_t i = 0; i < existing && !overlaps; ++i) {
+            const float minDistance = scene.spheres.radius[i] + sphere.radius;
+            const glm::vec3 d = scene.spheres.center(i) - sphere.center;
+            overlaps = glm::dot(d, d) < minDistance * minDistance;
+        }
+        if (overlaps)
+            continue;
+
+        sphere.materialIndex = materials[rng() % PALETTE_SIZE];
+        scene.spheres.push_back(sphere);
+        ++added;
+    }
+}
+
+// Куб из lab4 (cubeVertices без нормалей и цветов): 12 треугольников, ребро 1
+inline TriangleMesh makeCubeMesh() {
+    static const float vertices[36][3] = {
+        // Front face
+        {-0.5f, -0.5f,  0.5f}, { 0.5f, -0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f},
+        {-0.5f, -0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f}, {-0.5f,  0.5f,  0.5f},
+        // Back face
+        {-0.5f, -0.5f, -0.5f}, { 0.5f, -0.5f, -0.5f}, { 0.5f,  0.5f, -0.5f},
+        {-0.5f, -0.5f, -0.5f}, { 0.5f,  0.5f, -0.5f}, {-0.5f,  0.5f, -0.5f},
+        // Left face
+        {-0.5f, -0.5f, -0.5f}, {-0.5f, -0.5f,  0.5f}, {-0.5f,  0.5f,  0.5f},
+        {-0.5f, -0.5f, -0.5f}, {-0.5f,  0.5f,  0.5f}, {-0.5f,  0.5f, -0.5f},
+        // Right face
+        { 0.5f, -0.5f, -0.5f}, { 0.5f, -0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f},
+        { 0.5f, -0.5f, -0.5f}, { 0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f, -0.5f},
+        // Top face
+        {-0.5f,  0.5f, -0.5f}, {-0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f,  0.5f},
+        {-0.5f,  0.5f, -0.5f}, { 0.5f,  0.5f,  0.5f}, { 0.5f,  0.5f, -0.5f},
+        // Bottom face
+        {-0.5f, -0.5f, -0.5f}, {-0.5f, -0.5f,  0.5f}, { 0.5f, -0.5f,  0.5f},
+        {-0.5f, -0.5f, -0.5f}, { 0.5f, -0.5f,  0.5f}, { 0.5f, -0.5f, -0.5f}
+    };
+    TriangleMesh mesh;
+    for (const auto& vertex : vertices)
+        mesh.positions.push_back(glm::vec3(vertex[0], vertex[1], vertex[2]));
+    return mesh;
+}
+
+// Загрузка сетки из OBJ: используются только вершины (v) и грани (f),
+// многоугольники разбиваются веером на треугольники
+inline bool loadObjMesh(const std::string& path, TriangleMesh& mesh) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::vector<glm::vec3> vertices;
+    mesh.positions.clear();
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if (keyword == "v") {
+            glm::vec3 v(0.0f);
+            stream >> v.x >> v.y >> v.z;
+            vertices.push_back(v);
+        }
+        else if (keyword == "f") {
+            // Элемент грани: "v", "v/vt", "v//vn" или "v/vt/vn"; отрицательный индекс — с конца
+            std::vector<int> face;
+            std::string element;
+            while (stream >> element) {
+                int index = std::atoi(element.c_str());
+                index = index < 0 ? static_cast<int>(vertices.size()) + index : index - 1;
+                if (index < 0 || index >= static_cast<int>(vertices.size()))
+                    return false;
+                face.push_back(index);
+            }
+            for (size_t i = 2; i < face.size(); ++i) {
+                mesh.positions.push_back(vertices[face[0]]);
+                mesh.positions.push_back(vertices[face[i - 1]]);
+                mesh.positions.push_back(vertices[face[i]]);
+            }
+        }
+    }
+    return !mesh.positions.empty();
+}
+
+// Перенос сетки в куб [-0.5, 0.5] с сохранением пропорций (как у makeCubeMesh)
+inline void normalizeMesh(TriangleMesh& mesh) {
+    if (mesh.positions.empty())
+        return;
+    glm::vec3 bmin = mesh.positions[0], bmax = mesh.positions[0];
+    for (const glm::vec3& p : mesh.positions) {
+        bmin = glm::min(bmin, p);
+        bmax = glm::max(bmax, p);
+    }
+    const glm::vec3 extent = bmax - bmin;
+    const float size = std::max(extent.x, std::max(extent.y, extent.z));
+    const glm::vec3 middle = (bmin + bmax) * 0.5f;
+    for (glm::vec3& p : mesh.positions)
+        p = (p - middle) / (size > 0.0f ? size : 1.0f);
+}
+
+// Добавление экземпляров сетки на пол вокруг основных сфер: случайный размер
+// и поворот вокруг вертикали, клетки под уже имеющимися сферами пропускаются.
+// Сетка добавляется в сцену один раз, экземпляры хранят только матрицы.
+inline void addMeshInstances(Scene& scene, const TriangleMesh& mesh, size_t count, float reflection = 0.0f, uint32_t seed = 2) {
+    if (count == 0 || mesh.positions.empty())
+        return;
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    uint32_t materials[PALETTE_SIZE];
+    addPaletteMaterials(scene, reflection, materials);
+
+    // Высота сетки над полом: нижняя точка сетки встаёт на пол
+    float minY = mesh.positions[0].y;
+    for (const glm::vec3& p : mesh.positions)
+        minY = std::min(minY, p.y);
+
+    const uint32_t meshIndex = static_cast<uint32_t>(scene.meshes.size());
+    scene.meshes.push_back(mesh);
+
+    const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count) * 1.3 + 64.0)));
+    const float cell = 0.8f;
+    const float half = 0.5f * cell * static_cast<float>(side);
+    const glm::vec3 middle(0.0f, 0.0f, -3.5f);
+
+    scene.instances.reserve(scene.instances.size() + count);
+    size_t added = 0;
+    for (size_t cellIndex = 0; cellIndex < side * side && added < count; ++cellIndex) {
+        const float size = cell * (0.3f + 0.3f * unit(rng));
+        glm::vec3 position;
+        position.x = middle.x - half + cell * (static_cast<float>(cellIndex % side) + 0.5f) + (unit(rng) - 0.5f) * (cell - size);
+        position.z = middle.z - half + cell * (static_cast<float>(cellIndex / side) + 0.5f) + (unit(rng) - 0.5f) * (cell - size);
+        position.y = -minY * size;
+        const float angle = 6.28318531f * unit(rng);
+
+        // Ограничивающая сфера экземпляра не должна задевать сферы сцены
+        bool overlaps = false;
+        for (size_t i = 0; i < scene.spheres.size() && !overlaps; ++i) {
+            const float minDistance = scene.spheres.radius[i] + size * 0.87f;
+            const glm::vec3 d = scene.spheres.center(i) - position;
+            overlaps = glm::dot(d, d) < minDistance * minDistance;
+        }
+        if (overlaps)
+            continue;
+
+        MeshInstance instance;
+        instance.mesh = meshIndex;
+        instance.transform = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), position), angle, glm::vec3(0.0f, 1.0f, 0.0f)),
+                                        glm::vec3(size));
+        instance.materialIndex = materials[rng() % PALETTE_SIZE];
+        scene.instances.push_back(instance);
+        ++added;
+    }
+}
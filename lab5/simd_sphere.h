@@ -0,0 +1,249 @@
+// simd_sphere.h
+// Векторное пересечение луча со сферами: один луч против 8 сфер.
+// AVX2, запасной путь SSE4.1, иначе скаляр.
+//
+// Лучи считаются нормализованными, поэтому a = dot(dir, dir) = 1 и квадратное
+// уравнение упрощается: b = dot(oc, dir), c = dot(oc, oc) - r^2, D = b^2 - c,
+// t = -b -+ sqrt(D).
+
+#pragma once
+
+#include "scene.h"
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#define RT_USE_AVX2 1
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#define RT_USE_SSE4 1
+#include <smmintrin.h>
+#endif
+
+// Ширина векторного блока и кратность, до которой дополняются массивы сфер
+const int SIMD_WIDTH = 8;
+
+// При меньшем числе сфер скалярный цикл быстрее: полосы блока простаивают
+const int SIMD_MIN_COUNT = 4;
+
+// Радиус^2 для фиктивных сфер в хвосте: D всегда отрицателен, попаданий нет
+const float PADDING_RADIUS2 = -1e30f;
+
+// Центры и квадраты радиусов сфер, разложенные по отдельным массивам.
+// count — число настоящих сфер, размер массивов кратен SIMD_WIDTH.
+struct SphereLanes {
+    const float* cx;
+    const float* cy;
+    const float* cz;
+    const float* radius2;
+    int count;
+};
+
+// Скалярная версия для одной сферы (та же формула, что в векторных ветках)
+inline bool intersectSphereNormalized(const glm::vec3& origin, const glm::vec3& dir,
+                                      float cx, float cy, float cz, float radius2, float& t) {
+    float ocx = origin.x - cx, ocy = origin.y - cy, ocz = origin.z - cz;
+    float b = ocx * dir.x + ocy * dir.y + ocz * dir.z;
+    float c = ocx * ocx + ocy * ocy + ocz * ocz - radius2;
+    float disc = b * b - c;
+    if (disc < 0.0f)
+        return false;
+    float sq = std::sqrt(disc);
+    t = -b - sq;
+    if (t < 0.0f) {
+        t = -b + sq;
+        if (t < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// Скалярный цикл по сферам: ближайшее пересечение
+inline bool intersectSpheresClosestScalar(const glm::vec3& origin, const glm::vec3& dir, const SphereLanes& spheres,
+                                          float& tNearest, int& index) {
+    bool found = false;
+    for (int i = 0; i < spheres.count; ++i) {
+        float t;
+        if (intersectSphereNormalized(origin, dir, spheres.cx[i], spheres.cy[i], spheres.cz[i], spheres.radius2[i], t) &&
+            t < tNearest) {
+            tNearest = t;
+            index = i;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Скалярный цикл по сферам: любое пересечение, кроме сферы exclude
+inline bool intersectSpheresAnyScalar(const glm::vec3& origin, const glm::vec3& dir, const SphereLanes& spheres,
+                                      int exclude) {
+    for (int i = 0; i < spheres.count; ++i) {
+        float t;
+        if (i != exclude &&
+            intersectSphereNormalized(origin, dir, spheres.cx[i], spheres.cy[i], spheres.cz[i], spheres.radius2[i], t))
+            return true;
+    }
+    return false;
+}
+
+// Ближайшее пересечение луча со сферами. tNearest — текущая граница (на входе и выходе),
+// index — номер сферы или -1. Возвращает true, если граница уменьшилась.
+inline bool intersectSpheresClosest(const glm::vec3& origin, const glm::vec3& dir, const SphereLanes& spheres,
+                                    float& tNearest, int& index) {
+#if !defined(RT_USE_AVX2) && !defined(RT_USE_SSE4)
+    return intersectSpheresClosestScalar(origin, dir, spheres, tNearest, index);
+#else
+    if (spheres.count < SIMD_MIN_COUNT)
+        return intersectSpheresClosestScalar(origin, dir, spheres, tNearest, index);
+
+    alignas(32) float tLanes[SIMD_WIDTH];
+    alignas(32) int32_t idxLanes[SIMD_WIDTH];
+
+    const int padded = (spheres.count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+#if defined(RT_USE_AVX2)
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 best = _mm256_set1_ps(tNearest);
+    __m256i bestIdx = _mm256_set1_epi32(-1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(SIMD_WIDTH);
+
+    for (int i = 0; i < padded; i += SIMD_WIDTH) {
+        __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(spheres.cx + i));
+        __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(spheres.cy + i));
+        __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(spheres.cz + i));
+        __m256 b = _mm256_fmadd_ps(ocz, dz, _mm256_fmadd_ps(ocy, dy, _mm256_mul_ps(ocx, dx)));
+        __m256 c = _mm256_sub_ps(_mm256_fmadd_ps(ocz, ocz, _mm256_fmadd_ps(ocy, ocy, _mm256_mul_ps(ocx, ocx))),
+                                 _mm256_loadu_ps(spheres.radius2 + i));
+        __m256 disc = _mm256_fmsub_ps(b, b, c);
+        // При D < 0 корень даёт NaN, и упорядоченные сравнения ниже отбрасывают такие полосы
+        __m256 sq = _mm256_sqrt_ps(disc);
+        __m256 negB = _mm256_sub_ps(zero, b);
+        __m256 t0 = _mm256_sub_ps(negB, sq);
+        __m256 t1 = _mm256_add_ps(negB, sq);
+        __m256 t = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, zero, _CMP_GE_OQ));
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(t, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, best, _CMP_LT_OQ));
+        best = _mm256_blendv_ps(best, t, hit);
+        bestIdx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIdx), _mm256_castsi256_ps(lane), hit));
+        lane = _mm256_add_epi32(lane, step);
+    }
+    _mm256_store_ps(tLanes, best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(idxLanes), bestIdx);
+#elif defined(RT_USE_SSE4)
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 best[2] = { _mm_set1_ps(tNearest), _mm_set1_ps(tNearest) };
+    __m128i bestIdx[2] = { _mm_set1_epi32(-1), _mm_set1_epi32(-1) };
+    __m128i lane[2] = { _mm_setr_epi32(0, 1, 2, 3), _mm_setr_epi32(4, 5, 6, 7) };
+    const __m128i step = _mm_set1_epi32(SIMD_WIDTH);
+
+    for (int i = 0; i < padded; i += SIMD_WIDTH) {
+        for (int h = 0; h < 2; ++h) {
+            const int j = i + h * 4;
+            __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(spheres.cx + j));
+            __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(spheres.cy + j));
+            __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(spheres.cz + j));
+            __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+            __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+                                  _mm_loadu_ps(spheres.radius2 + j));
+            __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+            __m128 sq = _mm_sqrt_ps(disc);
+            __m128 negB = _mm_sub_ps(zero, b);
+            __m128 t0 = _mm_sub_ps(negB, sq);
+            __m128 t1 = _mm_add_ps(negB, sq);
+            __m128 t = _mm_blendv_ps(t1, t0, _mm_cmpge_ps(t0, zero));
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, best[h]));
+            best[h] = _mm_blendv_ps(best[h], t, hit);
+            bestIdx[h] = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(bestIdx[h]), _mm_castsi128_ps(lane[h]), hit));
+            lane[h] = _mm_add_epi32(lane[h], step);
+        }
+    }
+    _mm_store_ps(tLanes, best[0]);
+    _mm_store_ps(tLanes + 4, best[1]);
+    _mm_store_si128(reinterpret_cast<__m128i*>(idxLanes), bestIdx[0]);
+    _mm_store_si128(reinterpret_cast<__m128i*>(idxLanes + 4), bestIdx[1]);
+#endif
+
+    // Горизонтальная редукция: минимальное t, при равенстве — меньший индекс
+    bool found = false;
+    for (int l = 0; l < SIMD_WIDTH; ++l) {
+        if (idxLanes[l] < 0)
+            continue;
+        if (tLanes[l] < tNearest || (found && tLanes[l] == tNearest && idxLanes[l] < index)) {
+            tNearest = tLanes[l];
+            index = idxLanes[l];
+            found = true;
+        }
+    }
+    return found;
+#endif
+}
+
+// Есть ли хоть одно пересечение (для теневых лучей). Сфера exclude пропускается.
+inline bool intersectSpheresAny(const glm::vec3& origin, const glm::vec3& dir, const SphereLanes& spheres, int exclude) {
+#if !defined(RT_USE_AVX2) && !defined(RT_USE_SSE4)
+    return intersectSpheresAnyScalar(origin, dir, spheres, exclude);
+#else
+    if (spheres.count < SIMD_MIN_COUNT)
+        return intersectSpheresAnyScalar(origin, dir, spheres, exclude);
+
+    const int padded = (spheres.count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+#if defined(RT_USE_AVX2)
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 dx = _mm256_set1_ps(dir.x), dy = _mm256_set1_ps(dir.y), dz = _mm256_set1_ps(dir.z);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i excluded = _mm256_set1_epi32(exclude);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(SIMD_WIDTH);
+
+    for (int i = 0; i < padded; i += SIMD_WIDTH) {
+        __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(spheres.cx + i));
+        __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(spheres.cy + i));
+        __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(spheres.cz + i));
+        __m256 b = _mm256_fmadd_ps(ocz, dz, _mm256_fmadd_ps(ocy, dy, _mm256_mul_ps(ocx, dx)));
+        __m256 c = _mm256_sub_ps(_mm256_fmadd_ps(ocz, ocz, _mm256_fmadd_ps(ocy, ocy, _mm256_mul_ps(ocx, ocx))),
+                                 _mm256_loadu_ps(spheres.radius2 + i));
+        __m256 disc = _mm256_fmsub_ps(b, b, c);
+        // Дальний корень -b + sqrt(D) >= 0 означает, что хотя бы одно t >= 0
+        __m256 t1 = _mm256_sub_ps(_mm256_sqrt_ps(_mm256_max_ps(disc, zero)), b);
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ), _mm256_cmp_ps(t1, zero, _CMP_GE_OQ));
+        hit = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(lane, excluded)), hit);
+        if (_mm256_movemask_ps(hit))
+            return true;
+        lane = _mm256_add_epi32(lane, step);
+    }
+    return false;
+#elif defined(RT_USE_SSE4)
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 dx = _mm_set1_ps(dir.x), dy = _mm_set1_ps(dir.y), dz = _mm_set1_ps(dir.z);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128i excluded = _mm_set1_epi32(exclude);
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+
+    for (int i = 0; i < padded; i += 4) {
+        __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(spheres.cx + i));
+        __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(spheres.cy + i));
+        __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(spheres.cz + i));
+        __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+                              _mm_loadu_ps(spheres.radius2 + i));
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+        __m128 t1 = _mm_sub_ps(_mm_sqrt_ps(_mm_max_ps(disc, zero)), b);
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmpge_ps(t1, zero));
+        hit = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lane, excluded)), hit);
+        if (_mm_movemask_ps(hit))
+            return true;
+        lane = _mm_add_epi32(lane, step);
+    }
+    return false;
+#endif
+#endif
+}
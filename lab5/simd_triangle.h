@@ -0,0 +1,312 @@
+// simd_triangle.h
+// Векторное пересечение луча с треугольниками (Мёллер — Трумбор): один луч
+// против 8 треугольников. AVX2, запасной путь SSE4.1, иначе скаляр.
+//
+// Рёбра e1 = v1 - v0 и e2 = v2 - v0 считаются один раз при построении BLAS,
+// ядро читает только v0, e1, e2. Направление луча не обязано быть нормированным
+// (лучи в локальных координатах экземпляра), t — параметр вдоль того же dir.
+
+#pragma once
+
+#include "simd_sphere.h"
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Порог |det|: луч почти параллелен плоскости треугольника. У заполнителей
+// e1 = e2 = 0, det = 0, поэтому они никогда не дают попадания.
+const float TRIANGLE_DET_EPSILON = 1e-12f;
+
+// Вершина v0 и рёбра треугольников, разложенные по отдельным массивам.
+// count — число настоящих треугольников, размер массивов кратен SIMD_WIDTH.
+struct TriangleLanes {
+    const float* v0x;
+    const float* v0y;
+    const float* v0z;
+    const float* e1x;
+    const float* e1y;
+    const float* e1z;
+    const float* e2x;
+    const float* e2y;
+    const float* e2z;
+    int count;
+};
+
+// Скалярная версия для одного треугольника (та же формула, что в векторных ветках)
+inline bool intersectTriangleEdges(const glm::vec3& origin, const glm::vec3& dir, const TriangleLanes& tris, int i, float& t) {
+    const glm::vec3 e1(tris.e1x[i], tris.e1y[i], tris.e1z[i]);
+    const glm::vec3 e2(tris.e2x[i], tris.e2y[i], tris.e2z[i]);
+    const glm::vec3 p = glm::cross(dir, e2);
+    const float det = glm::dot(e1, p);
+    if (std::fabs(det) < TRIANGLE_DET_EPSILON)
+        return false;
+    const float invDet = 1.0f / det;
+    const glm::vec3 s = origin - glm::vec3(tris.v0x[i], tris.v0y[i], tris.v0z[i]);
+    const float u = glm::dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    const glm::vec3 q = glm::cross(s, e1);
+    const float v = glm::dot(dir, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    t = glm::dot(e2, q) * invDet;
+    return t > 0.0f;
+}
+
+// Скалярный цикл по треугольникам: ближайшее пересечение
+inline bool intersectTrianglesClosestScalar(const glm::vec3& origin, const glm::vec3& dir, const TriangleLanes& tris,
+                                            float& tNearest, int& index) {
+    bool found = false;
+    for (int i = 0; i < tris.count; ++i) {
+        float t;
+        if (intersectTriangleEdges(origin, dir, tris, i, t) && t < tNearest) {
+            tNearest = t;
+            index = i;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Скалярный цикл по треугольникам: любое пересечение
+inline bool intersectTrianglesAnyScalar(const glm::vec3& origin, const glm::vec3& dir, const TriangleLanes& tris) {
+    for (int i = 0; i < tris.count; ++i) {
+        float t;
+        if (intersectTriangleEdges(origin, dir, tris, i, t))
+            return true;
+    }
+    return false;
+}
+
+#if defined(RT_USE_AVX2)
+// Маска полос с попаданием на (0, tMax) и t каждой полосы
+inline __m256 intersectTriangles8(const __m256 o[3], const __m256 d[3], const TriangleLanes& tris, int i, __m256 tMax,
+                                  __m256& t) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 e1x = _mm256_loadu_ps(tris.e1x + i), e1y = _mm256_loadu_ps(tris.e1y + i), e1z = _mm256_loadu_ps(tris.e1z + i);
+    const __m256 e2x = _mm256_loadu_ps(tris.e2x + i), e2y = _mm256_loadu_ps(tris.e2y + i), e2z = _mm256_loadu_ps(tris.e2z + i);
+
+    // p = dir x e2, det = e1 . p
+    const __m256 px = _mm256_fmsub_ps(d[1], e2z, _mm256_mul_ps(d[2], e2y));
+    const __m256 py = _mm256_fmsub_ps(d[2], e2x, _mm256_mul_ps(d[0], e2z));
+    const __m256 pz = _mm256_fmsub_ps(d[0], e2y, _mm256_mul_ps(d[1], e2x));
+    const __m256 det = _mm256_fmadd_ps(e1z, pz, _mm256_fmadd_ps(e1y, py, _mm256_mul_ps(e1x, px)));
+    const __m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+    const __m256 invDet = _mm256_div_ps(one, det);
+
+    // s = origin - v0, u = (s . p) / det
+    const __m256 sx = _mm256_sub_ps(o[0], _mm256_loadu_ps(tris.v0x + i));
+    const __m256 sy = _mm256_sub_ps(o[1], _mm256_loadu_ps(tris.v0y + i));
+    const __m256 sz = _mm256_sub_ps(o[2], _mm256_loadu_ps(tris.v0z + i));
+    const __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(sz, pz, _mm256_fmadd_ps(sy, py, _mm256_mul_ps(sx, px))), invDet);
+
+    // q = s x e1, v = (dir . q) / det, t = (e2 . q) / det
+    const __m256 qx = _mm256_fmsub_ps(sy, e1z, _mm256_mul_ps(sz, e1y));
+    const __m256 qy = _mm256_fmsub_ps(sz, e1x, _mm256_mul_ps(sx, e1z));
+    const __m256 qz = _mm256_fmsub_ps(sx, e1y, _mm256_mul_ps(sy, e1x));
+    const __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(d[2], qz, _mm256_fmadd_ps(d[1], qy, _mm256_mul_ps(d[0], qx))), invDet);
+    t = _mm256_mul_ps(_mm256_fmadd_ps(e2z, qz, _mm256_fmadd_ps(e2y, qy, _mm256_mul_ps(e2x, qx))), invDet);
+
+    // Упорядоченные сравнения отбрасывают NaN, возникающие при det = 0
+    __m256 hit = _mm256_cmp_ps(absDet, _mm256_set1_ps(TRIANGLE_DET_EPSILON), _CMP_GE_OQ);
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+    return _mm256_and_ps(hit, _mm256_cmp_ps(t, tMax, _CMP_LT_OQ));
+}
+#elif defined(RT_USE_SSE4)
+inline __m128 intersectTriangles4(const __m128 o[3], const __m128 d[3], const TriangleLanes& tris, int i, __m128 tMax,
+                                  __m128& t) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 e1x = _mm_loadu_ps(tris.e1x + i), e1y = _mm_loadu_ps(tris.e1y + i), e1z = _mm_loadu_ps(tris.e1z + i);
+    const __m128 e2x = _mm_loadu_ps(tris.e2x + i), e2y = _mm_loadu_ps(tris.e2y + i), e2z = _mm_loadu_ps(tris.e2z + i);
+
+    const __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2z), _mm_mul_ps(d[2], e2y));
+    const __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2x), _mm_mul_ps(d[0], e2z));
+    const __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2y), _mm_mul_ps(d[1], e2x));
+    const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+    const __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    const __m128 invDet = _mm_div_ps(one, det);
+
+    const __m128 sx = _mm_sub_ps(o[0], _mm_loadu_ps(tris.v0x + i));
+    const __m128 sy = _mm_sub_ps(o[1], _mm_loadu_ps(tris.v0y + i));
+    const __m128 sz = _mm_sub_ps(o[2], _mm_loadu_ps(tris.v0z + i));
+    const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+    const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+    const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+    const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+    const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)), invDet);
+    t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+    __m128 hit = _mm_cmpge_ps(absDet, _mm_set1_ps(TRIANGLE_DET_EPSILON));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(u, one));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+    return _mm_and_ps(hit, _mm_cmplt_ps(t, tMax));
+}
+#endif
+
+// Ближайшее пересечение луча с треугольниками. tNearest — текущая граница (на входе
+// и выходе), index — номер треугольника. Возвращает true, если граница уменьшилась.
+inline bool intersectTrianglesClosest(const glm::vec3& origin, const glm::vec3& dir, const TriangleLanes& tris,
+                                      float& tNearest, int& index) {
+#if !defined(RT_USE_AVX2) && !defined(RT_USE_SSE4)
+    return intersectTrianglesClosestScalar(origin, dir, tris, tNearest, index);
+#else
+    alignas(32) float tLanes[SIMD_WIDTH];
+    alignas(32) int32_t idxLanes[SIMD_WIDTH];
+
+    const int padded = (tris.count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+#if defined(RT_USE_AVX2)
+    const __m256 o[3] = { _mm256_set1_ps(origin.x), _mm256_set1_ps(origin.y), _mm256_set1_ps(origin.z) };
+    const __m256 d[3] = { _mm256_set1_ps(dir.x), _mm256_set1_ps(dir.y), _mm256_set1_ps(dir.z) };
+    __m256 best = _mm256_set1_ps(tNearest);
+    __m256i bestIdx = _mm256_set1_epi32(-1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(SIMD_WIDTH);
+
+    for (int i = 0; i < padded; i += SIMD_WIDTH) {
+        __m256 t;
+        const __m256 hit = intersectTriangles8(o, d, tris, i, best, t);
+        best = _mm256_blendv_ps(best, t, hit);
+        bestIdx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIdx), _mm256_castsi256_ps(lane), hit));
+        lane = _mm256_add_epi32(lane, step);
+    }
+    _mm256_store_ps(tLanes, best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(idxLanes), bestIdx);
+#elif defined(RT_USE_SSE4)
+    const __m128 o[3] = { _mm_set1_ps(origin.x), _mm_set1_ps(origin.y), _mm_set1_ps(origin.z) };
+    const __m128 d[3] = { _mm_set1_ps(dir.x), _mm_set1_ps(dir.y), _mm_set1_ps(dir.z) };
+    __m128 best[2] = { _mm_set1_ps(tNearest), _mm_set1_ps(tNearest) };
+    __m128i bestIdx[2] = { _mm_set1_epi32(-1), _mm_set1_epi32(-1) };
+    __m128i lane[2] = { _mm_setr_epi32(0, 1, 2, 3), _mm_setr_epi32(4, 5, 6, 7) };
+    const __m128i step = _mm_set1_epi32(SIMD_WIDTH);
+
+    for (int i = 0; i < padded; i += SIMD_WIDTH) {
+        for (int h = 0; h < 2; ++h) {
+            __m128 t;
+            const __m128 hit = intersectTriangles4(o, d, tris, i + h * 4, best[h], t);
+            best[h] = _mm_blendv_ps(best[h], t, hit);
+            bestIdx[h] = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(bestIdx[h]), _mm_castsi128_ps(lane[h]), hit));
+            lane[h] = _mm_add_epi32(lane[h], step);
+        }
+    }
+    _mm_store_ps(tLanes, best[0]);
+    _mm_store_ps(tLanes + 4, best[1]);
+    _mm_store_si128(reinterpret_cast<__m128i*>(idxLanes), bestIdx[0]);
+    _mm_store_si128(reinterpret_cast<__m128i*>(idxLanes + 4), bestIdx[1]);
+#endif
+
+    // Горизонтальная редукция: минимальное t, при равенстве — меньший индекс
+    bool found = false;
+    for (int l = 0; l < SIMD_WIDTH; ++l) {
+        if (idxLanes[l] < 0)
+            continue;
+        if (tLanes[l] < tNearest || (found && tLanes[l] == tNearest && idxLanes[l] < index)) {
+            tNearest = tLanes[l];
+            index = idxLanes[l];
+            found = true;
+        }
+    }
+    return found;
+#endif
+}
+
+// Есть ли хоть одно пересечение с треугольниками (для теневых лучей)
+inline bool intersectTrianglesAny(const glm::vec3& origin, const glm::vec3& dir, const TriangleLanes& tris) {
+#if !defined(RT_USE_AVX2) && !defined(RT_USE_SSE4)
+    return intersectTrianglesAnyScalar(origin, dir, tris);
+#else
+    const int padded = (tris.count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+
+#if defined(RT_USE_AVX2)
+    const __m256 o[3] = { _mm256_set1_ps(origin.x), _mm256_set1_ps(origin.y), _mm256_set1_ps(origin.z) };
+    const __m256 d[3] = { _mm256_set1_ps(dir.x), _mm256_set1_ps(dir.y), _mm256_set1_ps(dir.z) };
+    const __m256 tMax = _mm256_set1_ps(std::numeric_limits<float>::max());
+    for (int i = 0; i < padded; i += SIMD_WIDTH) {
+        __m256 t;
+        if (_mm256_movemask_ps(intersectTriangles8(o, d, tris, i, tMax, t)))
+            return true;
+    }
+    return false;
+#elif defined(RT_USE_SSE4)
+    const __m128 o[3] = { _mm_set1_ps(origin.x), _mm_set1_ps(origin.y), _mm_set1_ps(origin.z) };
+    const __m128 d[3] = { _mm_set1_ps(dir.x), _mm_set1_ps(dir.y), _mm_set1_ps(dir.z) };
+    const __m128 tMax = _mm_set1_ps(std::numeric_limits<float>::max());
+    for (int i = 0; i < padded; i += 4) {
+        __m128 t;
+        if (_mm_movemask_ps(intersectTriangles4(o, d, tris, i, tMax, t)))
+            return true;
+    }
+    return false;
+#endif
+#endif
+}
+
+// Треугольники, упакованные блоками по SIMD_WIDTH: v0 и рёбра e1, e2.
+// Хвост блока заполняется вырожденными треугольниками (e1 = e2 = 0).
+struct PackedTriangles {
+    std::vector<float> v0x, v0y, v0z, e1x, e1y, e1z, e2x, e2y, e2z;
+
+    size_t size() const { return v0x.size(); }
+
+    void clear() {
+        v0x.clear();
+        v0y.clear();
+        v0z.clear();
+        e1x.clear();
+        e1y.clear();
+        e1z.clear();
+        e2x.clear();
+        e2y.clear();
+        e2z.clear();
+    }
+
+    void push(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2) {
+        const glm::vec3 e1 = v1 - v0;
+        const glm::vec3 e2 = v2 - v0;
+        v0x.push_back(v0.x);
+        v0y.push_back(v0.y);
+        v0z.push_back(v0.z);
+        e1x.push_back(e1.x);
+        e1y.push_back(e1.y);
+        e1z.push_back(e1.z);
+        e2x.push_back(e2.x);
+        e2y.push_back(e2.y);
+        e2z.push_back(e2.z);
+    }
+
+    void pushPadding() { push(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)); }
+
+    // Рёбра треугольника в ячейке slot
+    glm::vec3 edge1(int slot) const { return glm::vec3(e1x[slot], e1y[slot], e1z[slot]); }
+    glm::vec3 edge2(int slot) const { return glm::vec3(e2x[slot], e2y[slot], e2z[slot]); }
+
+    // count треугольников начиная с ячейки first
+    TriangleLanes lanes(int first, int count) const {
+        TriangleLanes l;
+        l.v0x = v0x.data() + first;
+        l.v0y = v0y.data() + first;
+        l.v0z = v0z.data() + first;
+        l.e1x = e1x.data() + first;
+        l.e1y = e1y.data() + first;
+        l.e1z = e1z.data() + first;
+        l.e2x = e2x.data() + first;
+        l.e2y = e2y.data() + first;
+        l.e2z = e2z.data() + first;
+        l.count = count;
+        return l;
+    }
+};
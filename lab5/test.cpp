@@ -3,9 +3,16 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bvh.h"
+#include "program_reflection.h"
+#include "scene.h"
 
 const char* vertexShaderSource = R"(
     #version 330 core
@@ -35,18 +42,17 @@ const char* fragmentShaderSource = R"(
         float reflection; 
     };
 
-    // Структура для сферы
+    // Структура для сферы (материал хранится отдельно, по индексу)
     struct Sphere {
         vec3 center;
         float radius;
-        Material material;
     };
 
     // Структура для плоскости
     struct Plane {
         vec3 point;
         vec3 normal;
-        Material material;
+        int materialIndex;
     };
 
     // Структура для источника света
@@ -59,10 +65,21 @@ const char* fragmentShaderSource = R"(
     uniform vec3 uCameraPos;
     uniform Light uLight;
 
-    // Униформы для сфер
-    uniform Sphere uSpheres[2];
-    // Униформ для плоскости
-    uniform Plane uPlane;
+    // Данные сцены в буфере текстуры, по одному vec4 на тексел:
+    //   [0, uSphereCount)                 - центр и радиус сферы
+    //   [uSphereCount, 2 * uSphereCount)  - индекс материала сферы (в x)
+    //   [uMaterialOffset, uPlaneOffset)   - материалы по три тексела:
+    //                                       (ambient, shininess), (diffuse, reflection), (specular, 0)
+    //   [uPlaneOffset, uPlaneOffset + 2)  - плоскость: (point, индекс материала), (normal, 0)
+    //   [uNodeOffset, ...)                - узлы BVH по два тексела:
+    //                                       (bmin, leftFirst), (bmax, число сфер; 0 - внутренний узел)
+    //   [uLeafOffset, uLeafOffset + uSphereCount) - индексы сфер листов (в x), leftFirst листа указывает сюда
+    uniform samplerBuffer uScene;
+    uniform int uSphereCount;
+    uniform int uMaterialOffset;
+    uniform int uPlaneOffset;
+    uniform int uNodeOffset;
+    uniform int uLeafOffset;
 
     // Параметры окна
     uniform float uAspectRatio;
@@ -71,6 +88,11 @@ const char* fragmentShaderSource = R"(
     // Максимальная глубина итераций для отражений
     const int MAX_DEPTH = 5;
 
+    // Глубина стека обхода BVH (как BVH_STACK_SIZE в bvh.h: построение
+    // ограничивает глубину дерева так, что стек не переполняется; проверки
+    // перед записью в стек только страхуют массив)
+    const int BVH_STACK_SIZE = 64;
+
     // Класс для луча
     struct Ray {
         vec3 origin;
@@ -92,6 +114,46 @@ const char* fragmentShaderSource = R"(
         return r;
     }
 
+    Sphere fetchSphere(int index)
+    {
+        vec4 texel = texelFetch(uScene, index);
+        Sphere sphere;
+        sphere.center = texel.xyz;
+        sphere.radius = texel.w;
+        return sphere;
+    }
+
+    int fetchSphereMaterialIndex(int index)
+    {
+        return int(texelFetch(uScene, uSphereCount + index).x);
+    }
+
+    Material fetchMaterial(int index)
+    {
+        int base = uMaterialOffset + 3 * index;
+        vec4 first = texelFetch(uScene, base);
+        vec4 second = texelFetch(uScene, base + 1);
+        vec4 third = texelFetch(uScene, base + 2);
+        Material material;
+        material.ambient = first.xyz;
+        material.shininess = first.w;
+        material.diffuse = second.xyz;
+        material.reflection = second.w;
+        material.specular = third.xyz;
+        return material;
+    }
+
+    Plane fetchPlane()
+    {
+        vec4 first = texelFetch(uScene, uPlaneOffset);
+        vec4 second = texelFetch(uScene, uPlaneOffset + 1);
+        Plane plane;
+        plane.point = first.xyz;
+        plane.materialIndex = int(first.w);
+        plane.normal = second.xyz;
+        return plane;
+    }
+
     // Функция для пересечения луча со сферой
     bool intersectSphere(Ray ray, Sphere sphere, out float t)
     {
@@ -127,6 +189,113 @@ const char* fragmentShaderSource = R"(
         return false;
     }
 
+    vec3 safeInverse(vec3 dir)
+    {
+        return vec3(dir.x != 0.0 ? 1.0 / dir.x : 1e30,
+                    dir.y != 0.0 ? 1.0 / dir.y : 1e30,
+                    dir.z != 0.0 ? 1.0 / dir.z : 1e30);
+    }
+
+    // Пересечение луча с узлом BVH (метод плит), tEntry - расстояние входа
+    bool intersectNode(int node, Ray ray, vec3 invDir, float tMax, out float tEntry)
+    {
+        vec3 bmin = texelFetch(uScene, uNodeOffset + 2 * node).xyz;
+        vec3 bmax = texelFetch(uScene, uNodeOffset + 2 * node + 1).xyz;
+        vec3 t1 = (bmin - ray.origin) * invDir;
+        vec3 t2 = (bmax - ray.origin) * invDir;
+        vec3 tSmall = min(t1, t2);
+        vec3 tBig = max(t1, t2);
+        float tNear = max(max(tSmall.x, tSmall.y), tSmall.z);
+        float tFar = min(min(tBig.x, tBig.y), tBig.z);
+        tEntry = tNear;
+        return tFar >= max(tNear, 0.0) && tNear < tMax;
+    }
+
+    // Ближайшая сфера на луче: обход BVH, ближний потомок первым.
+    // Возвращает индекс сферы или -1, tMin уменьшается до найденного пересечения.
+    int closestSphere(Ray ray, inout float tMin)
+    {
+        vec3 invDir = safeInverse(ray.direction);
+        int stackNode[BVH_STACK_SIZE];
+        float stackEntry[BVH_STACK_SIZE];
+        int stackSize = 0;
+        int hit = -1;
+
+        float tEntry;
+        if (intersectNode(0, ray, invDir, tMin, tEntry)) {
+            stackNode[0] = 0;
+            stackEntry[0] = tEntry;
+            stackSize = 1;
+        }
+
+        while (stackSize > 0) {
+            --stackSize;
+            if (stackEntry[stackSize] >= tMin)
+                continue;
+            int node = stackNode[stackSize];
+            int leftFirst = int(texelFetch(uScene, uNodeOffset + 2 * node).w);
+            int count = int(texelFetch(uScene, uNodeOffset + 2 * node + 1).w);
+
+            if (count > 0) {
+                for (int i = 0; i < count; ++i) {
+                    int sphere = int(texelFetch(uScene, uLeafOffset + leftFirst + i).x);
+                    float t;
+                    if (intersectSphere(ray, fetchSphere(sphere), t) && t < tMin) {
+                        tMin = t;
+                        hit = sphere;
+                    }
+                }
+            }
+            else if (stackSize <= BVH_STACK_SIZE - 2) {
+                float tLeft, tRight;
+                bool hitLeft = intersectNode(leftFirst, ray, invDir, tMin, tLeft);
+                bool hitRight = intersectNode(leftFirst + 1, ray, invDir, tMin, tRight);
+                // Дальний потомок кладётся первым, чтобы ближний обошёлся раньше
+                if (hitLeft && hitRight && tLeft <= tRight) {
+                    stackNode[stackSize] = leftFirst + 1; stackEntry[stackSize++] = tRight;
+                    stackNode[stackSize] = leftFirst; stackEntry[stackSize++] = tLeft;
+                }
+                else {
+                    if (hitLeft) { stackNode[stackSize] = leftFirst; stackEntry[stackSize++] = tLeft; }
+                    if (hitRight) { stackNode[stackSize] = leftFirst + 1; stackEntry[stackSize++] = tRight; }
+                }
+            }
+        }
+        return hit;
+    }
+
+    // Есть ли на луче хоть одна сфера, кроме exclude (теневые лучи)
+    bool anySphere(Ray ray, int exclude)
+    {
+        vec3 invDir = safeInverse(ray.direction);
+        int stack[BVH_STACK_SIZE];
+        int stackSize = 1;
+        stack[0] = 0;
+
+        while (stackSize > 0) {
+            int node = stack[--stackSize];
+            float tEntry;
+            if (!intersectNode(node, ray, invDir, 1e20, tEntry))
+                continue;
+            int leftFirst = int(texelFetch(uScene, uNodeOffset + 2 * node).w);
+            int count = int(texelFetch(uScene, uNodeOffset + 2 * node + 1).w);
+
+            if (count > 0) {
+                for (int i = 0; i < count; ++i) {
+                    int sphere = int(texelFetch(uScene, uLeafOffset + leftFirst + i).x);
+                    float t;
+                    if (sphere != exclude && intersectSphere(ray, fetchSphere(sphere), t))
+                        return true;
+                }
+            }
+            else if (stackSize <= BVH_STACK_SIZE - 2) {
+                stack[stackSize++] = leftFirst + 1;
+                stack[stackSize++] = leftFirst;
+            }
+        }
+        return false;
+    }
+
     // Функция для получения цвета из материала
     vec3 getColor(Material mat, vec3 hitPoint, vec3 normal, vec3 viewDir, Light light, bool inShadow)
     {
@@ -162,30 +331,25 @@ const char* fragmentShaderSource = R"(
         // Генерация луча через пиксель
         Ray ray = generateRay(fragCoord, uCameraPos, cameraDir, cameraRight, cameraUp, uFOV, uAspectRatio);
 
+        Plane floorPlane = fetchPlane();
+
         vec3 finalColor = vec3(0.0);
         Ray currentRay = ray;
         float currentReflection = 1.0;
 
         for (int depth = 0; depth < MAX_DEPTH; ++depth) {
             float tMin = 1e20;
-            int hitObject = -1; // 0 или 1 для сфер, 2 для плоскости
+            int hitObject = -1; // Индекс сферы или uSphereCount для плоскости
             float t;
 
-            // Проверка пересечения с сферами
-            for (int i = 0; i < 2; ++i) {
-                if (intersectSphere(currentRay, uSpheres[i], t)) {
-                    if (t < tMin) {
-                        tMin = t;
-                        hitObject = i;
-                    }
-                }
-            }
+            // Проверка пересечения с сферами (обход BVH)
+            hitObject = closestSphere(currentRay, tMin);
 
             // Проверка пересечения с плоскостью
-            if (intersectPlane(currentRay, uPlane, t)) {
+            if (intersectPlane(currentRay, floorPlane, t)) {
                 if (t < tMin) {
                     tMin = t;
-                    hitObject = 2;
+                    hitObject = uSphereCount;
                 }
             }
 
@@ -200,16 +364,16 @@ const char* fragmentShaderSource = R"(
             vec3 normal;
             Material material;
 
-            if (hitObject == 0 || hitObject == 1) {
-                Sphere sphere = uSpheres[hitObject];
+            if (hitObject < uSphereCount) {
+                Sphere sphere = fetchSphere(hitObject);
                 hitPoint = currentRay.origin + currentRay.direction * tMin;
                 normal = normalize(hitPoint - sphere.center);
-                material = sphere.material;
+                material = fetchMaterial(fetchSphereMaterialIndex(hitObject));
             }
             else {
                 hitPoint = currentRay.origin + currentRay.direction * tMin;
-                normal = uPlane.normal;
-                material = uPlane.material;
+                normal = floorPlane.normal;
+                material = fetchMaterial(floorPlane.materialIndex);
             }
 
             vec3 viewDir = normalize(-currentRay.direction);
@@ -222,19 +386,11 @@ const char* fragmentShaderSource = R"(
             bool inShadow = false;
 
             // Проверка пересечений для теней
-            for (int i = 0; i < 2; ++i) {
-                if (i == hitObject)
-                    continue;
-                float tShadow;
-                if (intersectSphere(shadowRay, uSpheres[i], tShadow)) {
-                    inShadow = true;
-                    break;
-                }
-            }
+            inShadow = anySphere(shadowRay, hitObject);
 
-            if (!inShadow && hitObject != 2) {
+            if (!inShadow && hitObject != uSphereCount) {
                 float tShadow;
-                if (intersectPlane(shadowRay, uPlane, tShadow)) {
+                if (intersectPlane(shadowRay, floorPlane, tShadow)) {
                     inShadow = true;
                 }
             }
@@ -320,32 +476,128 @@ GLuint createProgram(const char* vertexSource, const char* fragmentSource) {
     return program;
 }
 
-struct Material {
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-    float shininess;
-    float reflection;
-};
+// Установка одинакового коэффициента отражения для материалов всех сфер
+void setSphereReflection(Scene& scene, float reflection) {
+    for (size_t i = 0; i < scene.spheres.size(); ++i) {
+        const uint32_t index = scene.spheres.materialIndex[i];
+        Material material = scene.materials[index];
+        material.reflection = reflection;
+        scene.materials.set(index, material);
+    }
+}
 
-struct Sphere {
-    glm::vec3 center;
-    float radius;
-    Material material;
+// Расположение данных сцены в буфере текстуры (смещения в текселах vec4)
+struct SceneBufferLayout {
+    int sphereCount;
+    int materialCount;
+    int materialOffset;
+    int planeOffset;
+    int nodeOffset;  // Узлы BVH, место под 2 * sphereCount узлов (больше их не бывает)
+    int leafOffset;  // Индексы сфер в порядке листов BVH
+    int texelCount;
 };
 
-struct Plane {
-    glm::vec3 point;
-    glm::vec3 normal;
-    Material material;
-};
+SceneBufferLayout makeSceneBufferLayout(const Scene& scene) {
+    SceneBufferLayout layout;
+    layout.sphereCount = static_cast<int>(scene.spheres.size());
+    layout.materialCount = static_cast<int>(scene.materials.size());
+    layout.materialOffset = 2 * layout.sphereCount;
+    layout.planeOffset = layout.materialOffset + 3 * layout.materialCount;
+    layout.nodeOffset = layout.planeOffset + 2;
+    layout.leafOffset = layout.nodeOffset + 2 * (2 * layout.sphereCount);
+    layout.texelCount = layout.leafOffset + layout.sphereCount;
+    return layout;
+}
 
-struct Light {
-    glm::vec3 position;
-    glm::vec3 color;
-};
+// Упаковка таблицы материалов: три тексела на материал
+void packMaterials(const MaterialTable& materials, glm::vec4* texels) {
+    for (size_t i = 0; i < materials.size(); ++i) {
+        const Material& material = materials[static_cast<uint32_t>(i)];
+        texels[3 * i + 0] = glm::vec4(material.ambient, material.shininess);
+        texels[3 * i + 1] = glm::vec4(material.diffuse, material.reflection);
+        texels[3 * i + 2] = glm::vec4(material.specular, 0.0f);
+    }
+}
+
+// Упаковка центров и радиусов сфер
+void packSpheres(const Scene& scene, glm::vec4* texels) {
+    for (size_t i = 0; i < scene.spheres.size(); ++i)
+        texels[i] = glm::vec4(scene.spheres.centerX[i], scene.spheres.centerY[i], scene.spheres.centerZ[i], scene.spheres.radius[i]);
+}
+
+// Упаковка всей сцены в массив текселов по схеме SceneBufferLayout (кроме BVH)
+void packScene(const Scene& scene, const SceneBufferLayout& layout, std::vector<glm::vec4>& texels) {
+    texels.resize(layout.texelCount);
+    packSpheres(scene, texels.data());
+    for (int i = 0; i < layout.sphereCount; ++i)
+        texels[layout.sphereCount + i] = glm::vec4(static_cast<float>(scene.spheres.materialIndex[i]), 0.0f, 0.0f, 0.0f);
+    packMaterials(scene.materials, &texels[layout.materialOffset]);
+    texels[layout.planeOffset] = glm::vec4(scene.floorPlane.point, static_cast<float>(scene.floorPlane.materialIndex));
+    texels[layout.planeOffset + 1] = glm::vec4(scene.floorPlane.normal, 0.0f);
+}
+
+// Упаковка BVH. Ячейки листов SphereBVH выровнены по блокам SIMD с заполнителями;
+// шейдеру они не нужны, поэтому индексы сфер листов пишутся подряд, а leftFirst
+// листа пересчитывается в смещение от uLeafOffset. Возвращает число узлов.
+int packBVH(const SphereBVH& bvh, const SceneBufferLayout& layout, std::vector<glm::vec4>& texels) {
+    int leafCursor = 0;
+    for (size_t i = 0; i < bvh.bvh.nodes.size(); ++i) {
+        const BVHNode& node = bvh.bvh.nodes[i];
+        int leftFirst = node.leftFirst;
+        if (node.isLeaf()) {
+            leftFirst = leafCursor;
+            for (int k = 0; k < node.count; ++k)
+                texels[layout.leafOffset + leafCursor++] = glm::vec4(static_cast<float>(bvh.slotSphere[node.leftFirst + k]), 0.0f, 0.0f, 0.0f);
+        }
+        texels[layout.nodeOffset + 2 * i] = glm::vec4(node.bmin, static_cast<float>(leftFirst));
+        texels[layout.nodeOffset + 2 * i + 1] = glm::vec4(node.bmax, static_cast<float>(node.count));
+    }
+    return static_cast<int>(bvh.bvh.nodes.size());
+}
+
+// Передача сфер и BVH после обновления дерева. Индексы листов меняются
+// только при перестроении, при уточнении границ передаются сферы и узлы.
+void uploadSpheresAndBVH(GLuint sceneBuffer, const SceneBufferLayout& layout, const std::vector<glm::vec4>& texels,
+                         int nodeCount, bool rebuilt) {
+    glBindBuffer(GL_TEXTURE_BUFFER, sceneBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, layout.sphereCount * sizeof(glm::vec4), texels.data());
+    glBufferSubData(GL_TEXTURE_BUFFER, layout.nodeOffset * sizeof(glm::vec4), 2 * nodeCount * sizeof(glm::vec4),
+                    &texels[layout.nodeOffset]);
+    if (rebuilt)
+        glBufferSubData(GL_TEXTURE_BUFFER, layout.leafOffset * sizeof(glm::vec4), layout.sphereCount * sizeof(glm::vec4),
+                        &texels[layout.leafOffset]);
+}
+
+// Анимация дополнительных сфер: вращение вокруг центра поля с угловой скоростью,
+// убывающей с расстоянием, и подпрыгивание. Соседние сферы постепенно расходятся,
+// поэтому дерево после уточнения границ со временем ухудшается.
+void animateSpheres(Scene& scene, const std::vector<glm::vec3>& basePositions, size_t first, float time) {
+    const glm::vec3 middle(0.0f, 0.0f, -3.5f);
+    for (size_t i = first; i < scene.spheres.size(); ++i) {
+        const glm::vec3 offset = basePositions[i - first] - middle;
+        const float distance = std::sqrt(offset.x * offset.x + offset.z * offset.z);
+        const float angle = time * 0.6f / (1.0f + distance);
+        const float c = std::cos(angle), s = std::sin(angle);
+        glm::vec3 center = middle + glm::vec3(offset.x * c - offset.z * s, offset.y, offset.x * s + offset.z * c);
+        center.y += 0.2f * std::abs(std::sin(3.0f * time + 0.7f * static_cast<float>(i)));
+        scene.spheres.setCenter(i, center);
+    }
+}
+
+// Обновление материалов в буфере сцены одним вызовом glBufferSubData
+void uploadMaterials(GLuint sceneBuffer, const Scene& scene, const SceneBufferLayout& layout, std::vector<glm::vec4>& texels) {
+    packMaterials(scene.materials, &texels[layout.materialOffset]);
+    glBindBuffer(GL_TEXTURE_BUFFER, sceneBuffer);
+    glBufferSubData(GL_TEXTURE_BUFFER, layout.materialOffset * sizeof(glm::vec4),
+                    3 * layout.materialCount * sizeof(glm::vec4), &texels[layout.materialOffset]);
+}
+
+int main(int argc, char** argv) {
+    // Необязательный аргумент: число дополнительных сфер на полу
+    size_t extraSpheres = 0;
+    if (argc > 1)
+        extraSpheres = static_cast<size_t>(std::max(0, std::atoi(argv[1])));
 
-int main() {
     if (!glfwInit()) {
         std::cerr << "Не удалось инициализировать GLFW" << std::endl;
         return -1;
@@ -412,97 +664,84 @@ int main() {
     glBindVertexArray(0);
 
     // Получение местоположений униформов
-    GLint cameraPosLoc = glGetUniformLocation(shaderProgram, "uCameraPos");
-    GLint lightPosLoc = glGetUniformLocation(shaderProgram, "uLight.position");
-    GLint lightColorLoc = glGetUniformLocation(shaderProgram, "uLight.color");
-    GLint aspectRatioLoc = glGetUniformLocation(shaderProgram, "uAspectRatio");
-    GLint fovLoc = glGetUniformLocation(shaderProgram, "uFOV");
-
-    GLint sphereCenterLoc[2];
-    GLint sphereRadiusLoc[2];
-    GLint sphereAmbientLoc[2];
-    GLint sphereDiffuseLoc[2];
-    GLint sphereSpecularLoc[2];
-    GLint sphereShininessLoc[2];
-    GLint sphereReflectionLoc[2];
-
-    for (int i = 0; i < 2; ++i) {
-        std::string index = std::to_string(i);
-        sphereCenterLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].center").c_str());
-        sphereRadiusLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].radius").c_str());
-        sphereAmbientLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].material.ambient").c_str());
-        sphereDiffuseLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].material.diffuse").c_str());
-        sphereSpecularLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].material.specular").c_str());
-        sphereShininessLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].material.shininess").c_str());
-        sphereReflectionLoc[i] = glGetUniformLocation(shaderProgram, ("uSpheres[" + index + "].material.reflection").c_str());
+    ProgramReflection reflection(shaderProgram);
+    Uniform cameraPosUniform = reflection.uniform("uCameraPos");
+    Uniform lightPosUniform = reflection.uniform("uLight.position");
+    Uniform lightColorUniform = reflection.uniform("uLight.color");
+    Uniform aspectRatioUniform = reflection.uniform("uAspectRatio");
+    Uniform fovUniform = reflection.uniform("uFOV");
+    Uniform sceneUniform = reflection.uniform("uScene");
+    Uniform sphereCountUniform = reflection.uniform("uSphereCount");
+    Uniform materialOffsetUniform = reflection.uniform("uMaterialOffset");
+    Uniform planeOffsetUniform = reflection.uniform("uPlaneOffset");
+    Uniform nodeOffsetUniform = reflection.uniform("uNodeOffset");
+    Uniform leafOffsetUniform = reflection.uniform("uLeafOffset");
+
+    // Параметры сцены: сферы хранятся структурой массивов, материалы — в общей таблице
+    Scene scene = makeDefaultScene();
+    const size_t animatedFirst = scene.spheres.size(); // Основные сферы неподвижны, поле движется
+    addSphereField(scene, extraSpheres);
+    std::vector<glm::vec3> basePositions;
+    for (size_t i = animatedFirst; i < scene.spheres.size(); ++i)
+        basePositions.push_back(scene.spheres.center(i));
+    float sphereReflection = scene.materials[scene.spheres.materialIndex[0]].reflection;
+    float planeReflection = scene.materials[scene.floorPlane.materialIndex].reflection;
+
+    // Упаковка сцены в буфер текстуры: размер сцены ограничен только
+    // GL_MAX_TEXTURE_BUFFER_SIZE, а не числом униформов
+    SceneBufferLayout layout = makeSceneBufferLayout(scene);
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if (layout.texelCount > maxTexels) {
+        std::cerr << "Сцена не помещается в буфер текстуры: " << layout.texelCount << " текселов, максимум " << maxTexels << std::endl;
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
     }
+    std::cout << "Сфер в сцене: " << layout.sphereCount << ", материалов: " << layout.materialCount << std::endl;
+
+    std::vector<glm::vec4> sceneTexels;
+    packScene(scene, layout, sceneTexels);
 
-    GLint planePointLoc = glGetUniformLocation(shaderProgram, "uPlane.point");
-    GLint planeNormalLoc = glGetUniformLocation(shaderProgram, "uPlane.normal");
-    GLint planeAmbientLoc = glGetUniformLocation(shaderProgram, "uPlane.material.ambient");
-    GLint planeDiffuseLoc = glGetUniformLocation(shaderProgram, "uPlane.material.diffuse");
-    GLint planeSpecularLoc = glGetUniformLocation(shaderProgram, "uPlane.material.specular");
-    GLint planeShininessLoc = glGetUniformLocation(shaderProgram, "uPlane.material.shininess");
-    GLint planeReflectionLoc = glGetUniformLocation(shaderProgram, "uPlane.material.reflection");
-
-    // Параметры сцены
-    glm::vec3 cameraPos = glm::vec3(0.0f, 2.0f, 5.0f);
-    Light light;
-    light.position = glm::vec3(2.0f, 4.0f, 2.0f);
-    light.color = glm::vec3(1.0f, 1.0f, 1.0f);
-    Sphere spheres[2];
-
-    // Первая сфера
-    spheres[0].center = glm::vec3(-1.0f, 1.0f, -3.0f);
-    spheres[0].radius = 1.0f;
-    spheres[0].material.ambient = glm::vec3(0.1f, 0.0f, 0.0f);
-    spheres[0].material.diffuse = glm::vec3(0.6f, 0.0f, 0.0f);
-    spheres[0].material.specular = glm::vec3(0.5f, 0.5f, 0.5f);
-    spheres[0].material.shininess = 32.0f;
-    spheres[0].material.reflection = 0.5f;
-
-    // Вторая сфера
-    spheres[1].center = glm::vec3(1.0f, 1.0f, -4.0f);
-    spheres[1].radius = 1.0f;
-    spheres[1].material.ambient = glm::vec3(0.0f, 0.0f, 0.1f);
-    spheres[1].material.diffuse = glm::vec3(0.0f, 0.0f, 0.6f);
-    spheres[1].material.specular = glm::vec3(0.5f, 0.5f, 0.5f);
-    spheres[1].material.shininess = 32.0f;
-    spheres[1].material.reflection = 0.5f;
-
-    // Создание плоскости
-    Plane plane;
-    plane.point = glm::vec3(0.0f, 0.0f, 0.0f);
-    plane.normal = glm::vec3(0.0f, 1.0f, 0.0f);
-    plane.material.ambient = glm::vec3(0.1f, 0.1f, 0.1f);
-    plane.material.diffuse = glm::vec3(0.6f, 0.6f, 0.6f);
-    plane.material.specular = glm::vec3(0.5f, 0.5f, 0.5f);
-    plane.material.shininess = 32.0f;
-    plane.material.reflection = 0.3f;
+    // BVH сфер: каждый кадр уточняется или перестраивается на пуле потоков
+    WorkStealingPool pool;
+    DynamicSphereBVH sceneBVH;
+    sceneBVH.update(scene.spheres, pool);
+    int nodeCount = packBVH(sceneBVH.bvh, layout, sceneTexels);
+
+    GLuint sceneBuffer, sceneTexture;
+    glGenBuffers(1, &sceneBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, sceneBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, sceneTexels.size() * sizeof(glm::vec4), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, sceneTexels.size() * sizeof(glm::vec4), sceneTexels.data());
+
+    glGenTextures(1, &sceneTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, sceneTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, sceneBuffer);
 
     glUseProgram(shaderProgram);
-    glUniform3fv(cameraPosLoc, 1, glm::value_ptr(cameraPos));
-    glUniform3fv(lightPosLoc, 1, glm::value_ptr(light.position));
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(light.color));
-    glUniform1f(aspectRatioLoc, static_cast<float>(width) / static_cast<float>(height));
-    glUniform1f(fovLoc, 45.0f);
-
-    for (int i = 0; i < 2; ++i) {
-        glUniform3fv(sphereCenterLoc[i], 1, glm::value_ptr(spheres[i].center));
-        glUniform1f(sphereRadiusLoc[i], spheres[i].radius);
-        glUniform3fv(sphereAmbientLoc[i], 1, glm::value_ptr(spheres[i].material.ambient));
-        glUniform3fv(sphereDiffuseLoc[i], 1, glm::value_ptr(spheres[i].material.diffuse));
-        glUniform3fv(sphereSpecularLoc[i], 1, glm::value_ptr(spheres[i].material.specular));
-        glUniform1f(sphereShininessLoc[i], spheres[i].material.shininess);
-        glUniform1f(sphereReflectionLoc[i], spheres[i].material.reflection);
-    }
-    glUniform3fv(planePointLoc, 1, glm::value_ptr(plane.point));
-    glUniform3fv(planeNormalLoc, 1, glm::value_ptr(plane.normal));
-    glUniform3fv(planeAmbientLoc, 1, glm::value_ptr(plane.material.ambient));
-    glUniform3fv(planeDiffuseLoc, 1, glm::value_ptr(plane.material.diffuse));
-    glUniform3fv(planeSpecularLoc, 1, glm::value_ptr(plane.material.specular));
-    glUniform1f(planeShininessLoc, plane.material.shininess);
-    glUniform1f(planeReflectionLoc, plane.material.reflection);
+    cameraPosUniform.set(scene.camera.position);
+    lightPosUniform.set(scene.light.position);
+    lightColorUniform.set(scene.light.color);
+    aspectRatioUniform.set(static_cast<float>(width) / static_cast<float>(height));
+    fovUniform.set(scene.camera.fov);
+    sceneUniform.set(0);
+    sphereCountUniform.set(layout.sphereCount);
+    materialOffsetUniform.set(layout.materialOffset);
+    planeOffsetUniform.set(layout.planeOffset);
+    nodeOffsetUniform.set(layout.nodeOffset);
+    leafOffsetUniform.set(layout.leafOffset);
+
+    // Время трассировки кадра (GL_TIME_ELAPSED) — замер стоимости обхода для
+    // выбора между уточнением и перестроением BVH. Запросов два: результат
+    // прошлого кадра читается, когда готов, без ожидания конвейера.
+    GLuint timerQueries[2];
+    bool timerPending[2] = { false, false };
+    size_t timerGeneration[2] = { 0, 0 }; // Поколение BVH, с которым рисовался кадр запроса
+    int timerIndex = 0;
+    glGenQueries(2, timerQueries);
+    double lastReportTime = 0.0;
 
     // Основной цикл рендеринга
     while (!glfwWindowShouldClose(window)) {
@@ -511,42 +750,37 @@ int main() {
             glfwSetWindowShouldClose(window, true);
 
         // Изменение коэффициента отражения сфер
-        if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
-            spheres[0].material.reflection += 0.5f * 0.016f;
-            spheres[0].material.reflection = glm::clamp(spheres[0].material.reflection, 0.0f, 1.0f);
-            spheres[1].material.reflection = spheres[0].material.reflection;
-            for (int i = 0; i < 2; ++i) {
-                glUniform1f(sphereReflectionLoc[i], spheres[i].material.reflection);
-            }
-            std::cout << "Коэффициент отражения сфер: " << spheres[0].material.reflection << std::endl;
-        }
-        if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
-            spheres[0].material.reflection -= 0.5f * 0.016f;
-            spheres[0].material.reflection = glm::clamp(spheres[0].material.reflection, 0.0f, 1.0f);
-            spheres[1].material.reflection = spheres[0].material.reflection;
-            for (int i = 0; i < 2; ++i) {
-                glUniform1f(sphereReflectionLoc[i], spheres[i].material.reflection);
-            }
-            std::cout << "Коэффициент отражения сфер: " << spheres[0].material.reflection << std::endl;
+        if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+            float step = glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS ? 0.5f * 0.016f : -0.5f * 0.016f;
+            sphereReflection = glm::clamp(sphereReflection + step, 0.0f, 1.0f);
+            setSphereReflection(scene, sphereReflection);
+            uploadMaterials(sceneBuffer, scene, layout, sceneTexels);
+            std::cout << "Коэффициент отражения сфер: " << sphereReflection << std::endl;
         }
 
         // Изменение коэффициента отражения пола
-        if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
-            plane.material.reflection += 0.3f * 0.016f;
-            plane.material.reflection = glm::clamp(plane.material.reflection, 0.0f, 1.0f);
-            glUniform1f(planeReflectionLoc, plane.material.reflection);
-            std::cout << "Коэффициент отражения пола: " << plane.material.reflection << std::endl;
+        if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
+            float step = glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS ? 0.3f * 0.016f : -0.3f * 0.016f;
+            planeReflection = glm::clamp(planeReflection + step, 0.0f, 1.0f);
+            Material material = scene.materials[scene.floorPlane.materialIndex];
+            material.reflection = planeReflection;
+            scene.materials.set(scene.floorPlane.materialIndex, material);
+            uploadMaterials(sceneBuffer, scene, layout, sceneTexels);
+            std::cout << "Коэффициент отражения пола: " << planeReflection << std::endl;
         }
-        if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
-            plane.material.reflection -= 0.3f * 0.016f;
-            plane.material.reflection = glm::clamp(plane.material.reflection, 0.0f, 1.0f);
-            glUniform1f(planeReflectionLoc, plane.material.reflection);
-            std::cout << "Коэффициент отражения пола: " << plane.material.reflection << std::endl;
+
+        // Движение сфер и обновление BVH
+        if (!basePositions.empty()) {
+            animateSpheres(scene, basePositions, animatedFirst, static_cast<float>(glfwGetTime()));
+            const bool rebuilt = sceneBVH.update(scene.spheres, pool) == DynamicSphereBVH::Update::Rebuild;
+            packSpheres(scene, sceneTexels.data());
+            nodeCount = packBVH(sceneBVH.bvh, layout, sceneTexels);
+            uploadSpheresAndBVH(sceneBuffer, layout, sceneTexels, nodeCount, rebuilt);
         }
 
         glfwGetFramebufferSize(window, &width, &height);
         glViewport(0, 0, width, height);
-        glUniform1f(aspectRatioLoc, static_cast<float>(width) / static_cast<float>(height));
+        aspectRatioUniform.set(static_cast<float>(width) / static_cast<float>(height));
 
         // Очистка буферов
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -555,8 +789,36 @@ int main() {
         // Отрисовка полноэкранного квадрата
         glUseProgram(shaderProgram);
         glBindVertexArray(VAO);
+        glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerIndex]);
         glDrawArrays(GL_TRIANGLES, 0, 6);
+        glEndQuery(GL_TIME_ELAPSED);
         glBindVertexArray(0);
+        timerPending[timerIndex] = true;
+        timerGeneration[timerIndex] = sceneBVH.generation();
+        timerIndex = 1 - timerIndex;
+
+        // Результат предыдущего кадра: стоимость обхода на пиксель
+        if (timerPending[timerIndex]) {
+            GLint available = 0;
+            glGetQueryObjectiv(timerQueries[timerIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 elapsedNs = 0;
+                glGetQueryObjectui64v(timerQueries[timerIndex], GL_QUERY_RESULT, &elapsedNs);
+                timerPending[timerIndex] = false;
+                sceneBVH.reportTraversal(static_cast<double>(elapsedNs) * 1e-6, static_cast<uint64_t>(width) * height,
+                                         timerGeneration[timerIndex]);
+            }
+        }
+
+        const double now = glfwGetTime();
+        if (now - lastReportTime >= 0.5) {
+            char title[160];
+            std::snprintf(title, sizeof(title), "Ray Tracing - BVH: %s %.2f мс, рост SAH %.2f, перестроений %zu, уточнений %zu",
+                          sceneBVH.lastUpdate() == DynamicSphereBVH::Update::Rebuild ? "перестроение" : "уточнение",
+                          sceneBVH.lastUpdateMs(), sceneBVH.sahGrowth(), sceneBVH.rebuilds(), sceneBVH.refits());
+            glfwSetWindowTitle(window, title);
+            lastReportTime = now;
+        }
 
         // Обмен буферов и обработка событий
         glfwSwapBuffers(window);
@@ -566,6 +828,9 @@ int main() {
     // Очистка ресурсов
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteQueries(2, timerQueries);
+    glDeleteTextures(1, &sceneTexture);
+    glDeleteBuffers(1, &sceneBuffer);
     glDeleteProgram(shaderProgram);
 
     // Завершение работы GLFW
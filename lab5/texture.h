@@ -0,0 +1,253 @@
+// texture.h
+// Загрузка текстур: чтение файла и декодирование stb_image (stbi_load_from_memory)
+// в пуле фоновых потоков, при необходимости — и построение mip-цепочки (mipmap.h).
+// С каталогом кэша (texture_cache.h) повторная загрузка того же файла
+// обходится без декодирования: пиксели берутся из отображённой записи, а
+// заранее сжатая запись (compress_main.cpp) заменяет RGBA8, если GPU понимает
+// её формат.
+// Готовые изображения складываются в очередь, которую поток рендеринга
+// (для GPU — поток GL) забирает без ожидания и сам выгружает.
+//
+// stb_image подключается со STB_IMAGE_STATIC: реализация получается своей в
+// каждой единице трансляции, а неиспользуемые функции не дают предупреждений.
+// Причина ошибки в stb_image хранится в thread_local, поэтому декодирование
+// из нескольких потоков безопасно.
+
+#pragma once
+
+#include "mipmap.h"
+#include "scene.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_NO_STDIO // Файлы читаются сами, stb получает только память
+#include "stb_image.h"
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+// Чтение файла целиком
+inline bool readFileBytes(const std::string& path, std::vector<uint8_t>& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return static_cast<bool>(file) || file.eof();
+}
+
+// Декодирование PNG/JPEG/... из памяти в RGBA8 (строки сверху вниз).
+// reserveMipmaps — память сразу под полную mip-цепочку, чтобы generateMipmaps
+// не перевыделял и не копировал уровень 0.
+inline bool decodeTexture(const uint8_t* data, size_t size, Texture& texture, std::string& error, bool reserveMipmaps = false) {
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, 4);
+    if (!pixels) {
+        error = stbi_failure_reason();
+        return false;
+    }
+    texture.width = width;
+    texture.height = height;
+    texture.levels = 1;
+    if (reserveMipmaps)
+        texture.rgba.reserve(mipChainSize(width, height));
+    texture.rgba.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+inline bool loadTexture(const std::string& path, Texture& texture, std::string& error, bool reserveMipmaps = false) {
+    std::vector<uint8_t> bytes;
+    if (!readFileBytes(path, bytes)) {
+        error = "не удалось прочитать файл";
+        return false;
+    }
+    return decodeTexture(bytes.data(), bytes.size(), texture, error, reserveMipmaps);
+}
+
+// Результат фоновой загрузки
+struct LoadedTexture {
+    uint32_t id = 0;   // Номер, выданный request()
+    std::string path;
+    bool ok = false;
+    bool cached = false; // Взята из кэша без декодирования
+    std::string error;   // Причина ошибки при ok == false
+    Texture texture;
+};
+
+// Пул потоков декодирования. request() ставит файл в очередь и сразу
+// возвращается; takeReady() забирает готовые текстуры, не дожидаясь остальных.
+// wait() нужен только там, где без текстур рендерить нельзя (CPU-кадр).
+// С mipmaps == true после декодирования строится mip-цепочка: цепочки строятся
+// по одной, строки уровня делятся между потоками отдельного пула.
+// Непустой cacheDirectory включает дисковый кэш: найденная запись заменяет
+// декодирование и mip-цепочку, новая текстура после них записывается.
+// compressedFormat != RGBA8 — сначала ищется запись в этом сжатом формате;
+// без неё текстура загружается как обычно, в RGBA8 (сжатие только заранее).
+class TextureLoader {
+public:
+    // threadCount == 0 — по числу аппаратных потоков без одного (он у рендеринга)
+    explicit TextureLoader(unsigned threadCount = 0, bool mipmaps = false, const std::string& cacheDirectory = std::string(),
+                           TextureFormat compressedFormat = TextureFormat::RGBA8)
+        : cacheDirectory_(cacheDirectory), compressedFormat_(compressedFormat) {
+        if (threadCount == 0) {
+            const unsigned hardware = std::thread::hardware_concurrency();
+            threadCount = hardware > 1 ? hardware - 1 : 1;
+        }
+        if (mipmaps)
+            mipPool_.reset(new WorkStealingPool(threadCount));
+        for (unsigned i = 0; i < threadCount; ++i)
+            threads_.emplace_back(&TextureLoader::run, this);
+    }
+
+    ~TextureLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            jobs_.clear(); // Незапущенные загрузки отменяются
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_)
+            thread.join();
+    }
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    uint32_t request(const std::string& path) {
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = nextId_++;
+            Job job;
+            job.id = id;
+            job.path = path;
+            jobs_.push_back(job);
+            ++pending_;
+        }
+        wake_.notify_one();
+        return id;
+    }
+
+    // Перенос в out не больше maxCount готовых текстур (в порядке готовности)
+    size_t takeReady(std::vector<LoadedTexture>& out, size_t maxCount = SIZE_MAX) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t taken = 0;
+        while (!ready_.empty() && taken < maxCount) {
+            out.push_back(std::move(ready_.front()));
+            ready_.pop_front();
+            ++taken;
+        }
+        return taken;
+    }
+
+    // Ожидание окончания всех поставленных загрузок
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    // Загрузки, ещё не попавшие в очередь готовых
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_;
+    }
+
+    // Нет ни идущих загрузок, ни не забранных результатов
+    bool idle() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_ == 0 && ready_.empty();
+    }
+
+private:
+    struct Job {
+        uint32_t id;
+        std::string path;
+    };
+
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+                if (stop_)
+                    return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+
+            // Чтение и декодирование — без блокировки
+            LoadedTexture result;
+            result.id = job.id;
+            result.path = job.path;
+            load(result);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ready_.push_back(std::move(result));
+                --pending_;
+            }
+            idle_.notify_all();
+        }
+    }
+
+    void load(LoadedTexture& result) {
+        std::vector<uint8_t> bytes;
+        if (!readFileBytes(result.path, bytes)) {
+            result.error = "не удалось прочитать файл";
+            return;
+        }
+        const bool useCache = !cacheDirectory_.empty();
+        const uint64_t hash = useCache ? hashTextureSource(bytes.data(), bytes.size()) : 0;
+        if (useCache && compressedFormat_ != TextureFormat::RGBA8 &&
+            openCachedTexture(cacheDirectory_, hash, bytes.size(), mipPool_ != nullptr, result.texture, compressedFormat_)) {
+            result.ok = result.cached = true;
+            return;
+        }
+        if (useCache && openCachedTexture(cacheDirectory_, hash, bytes.size(), mipPool_ != nullptr, result.texture)) {
+            result.ok = result.cached = true;
+            return;
+        }
+        result.ok = decodeTexture(bytes.data(), bytes.size(), result.texture, result.error, mipPool_ != nullptr);
+        if (!result.ok)
+            return;
+        if (mipPool_) {
+            std::lock_guard<std::mutex> lock(mipMutex_);
+            generateMipmaps(result.texture, mipPool_.get());
+        }
+        if (useCache)
+            writeCachedTexture(cacheDirectory_, hash, bytes.size(), result.texture);
+    }
+
+    const std::string cacheDirectory_;
+    const TextureFormat compressedFormat_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::deque<Job> jobs_;
+    std::deque<LoadedTexture> ready_;
+    size_t pending_ = 0;
+    uint32_t nextId_ = 0;
+    bool stop_ = false;
+    std::mutex mipMutex_; // Пул mip-уровней выполняет одну parallelFor за раз
+    std::unique_ptr<WorkStealingPool> mipPool_;
+    std::vector<std::thread> threads_;
+};
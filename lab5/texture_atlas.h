@@ -0,0 +1,227 @@
+// texture_atlas.h
+// Упаковка мелких текстур в один атлас. Все материалы с текстурами атласа
+// ссылаются на одну текстуру сцены (в GL — один объект и одна привязка на
+// все объекты), а свою часть выбирают через Material::textureRegion:
+// текстурные координаты переводятся в область атласа (regionTexCoord в
+// raytracer.h), повторы — внутри области.
+//
+// Упаковщик — skyline: верх занятой части атласа хранится ломаной из
+// горизонтальных отрезков, прямоугольник ставится туда, где его низ окажется
+// ниже всего (при равенстве — где под ним меньше пустого места).
+// Прямоугольники идут по убыванию высоты и не поворачиваются: поворот
+// пришлось бы повторять в текстурных координатах.
+//
+// Вокруг каждой текстуры — рамка из padding копий крайних текселов, чтобы
+// билинейная выборка у края области не захватывала соседнюю текстуру.
+// Для mip-цепочки атласа рамка спасает уровни до log2(padding).
+
+#pragma once
+
+#include "scene.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Рамка вокруг текстуры в текселах и наибольшая сторона атласа по умолчанию
+const int ATLAS_PADDING = 4;
+const int ATLAS_MAX_SIZE = 4096;
+
+// Skyline-упаковщик прямоугольников в область width x height
+class SkylinePacker {
+public:
+    SkylinePacker(int width, int height) : width_(width), height_(height) {
+        skyline_.push_back(Segment{ 0, 0, width });
+    }
+
+    // Левый верхний угол для прямоугольника width x height; false — не помещается
+    bool insert(int width, int height, int& x, int& y) {
+        int bestIndex = -1, bestTop = INT_MAX, bestWaste = INT_MAX;
+        for (size_t i = 0; i < skyline_.size(); ++i) {
+            int top, waste;
+            if (fit(i, width, height, top, waste) && (top < bestTop || (top == bestTop && waste < bestWaste))) {
+                bestIndex = static_cast<int>(i);
+                bestTop = top;
+                bestWaste = waste;
+            }
+        }
+        if (bestIndex < 0)
+            return false;
+        x = skyline_[bestIndex].x;
+        y = bestTop;
+        place(static_cast<size_t>(bestIndex), width, bestTop + height);
+        return true;
+    }
+
+private:
+    struct Segment {
+        int x, y, width; // Отрезок [x, x + width) на высоте y
+    };
+
+    // Прямоугольник с левым краем в начале отрезка index: низ — наибольшая
+    // высота отрезков под ним, waste — площадь пустот под низом
+    bool fit(size_t index, int width, int height, int& top, int& waste) const {
+        if (skyline_[index].x + width > width_)
+            return false;
+        top = 0;
+        for (int i = static_cast<int>(index), left = width; left > 0; left -= skyline_[i].width, ++i)
+            top = std::max(top, skyline_[i].y);
+        if (top + height > height_)
+            return false;
+        waste = 0;
+        for (int i = static_cast<int>(index), left = width; left > 0; left -= skyline_[i].width, ++i)
+            waste += (top - skyline_[i].y) * std::min(left, skyline_[i].width);
+        return true;
+    }
+
+    // Новый отрезок на высоте top поверх отрезков, которые он перекрывает
+    void place(size_t index, int width, int top) {
+        const int x = skyline_[index].x, right = x + width;
+        skyline_.insert(skyline_.begin() + index, Segment{ x, top, width });
+        size_t i = index + 1;
+        while (i < skyline_.size() && skyline_[i].x < right) {
+            const int end = skyline_[i].x + skyline_[i].width;
+            if (end <= right) {
+                skyline_.erase(skyline_.begin() + i);
+            }
+            else {
+                skyline_[i].x = right;
+                skyline_[i].width = end - right;
+                break;
+            }
+        }
+        // Соседние отрезки одной высоты сливаются
+        for (size_t j = 0; j + 1 < skyline_.size();) {
+            if (skyline_[j].y == skyline_[j + 1].y) {
+                skyline_[j].width += skyline_[j + 1].width;
+                skyline_.erase(skyline_.begin() + j + 1);
+            }
+            else {
+                ++j;
+            }
+        }
+    }
+
+    int width_, height_;
+    std::vector<Segment> skyline_;
+};
+
+// Место текстуры в атласе (без рамки)
+struct AtlasRegion {
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+    glm::vec4 uv; // Для Material::textureRegion: начало (xy) и размер (zw) в долях атласа
+};
+
+struct TextureAtlas {
+    Texture image;                    // Один уровень; mip-цепочку при необходимости строит generateMipmaps
+    std::vector<AtlasRegion> regions; // В порядке входных текстур
+};
+
+// Копия уровня 0 текстуры в атлас с рамкой из крайних текселов
+inline void blitPadded(const Texture& texture, int padding, Texture& atlas, int x, int y) {
+    const uint8_t* src = texture.pixels();
+    const size_t rowBytes = static_cast<size_t>(texture.width) * 4;
+    for (int row = -padding; row < texture.height + padding; ++row) {
+        const uint8_t* line = src + static_cast<size_t>(std::min(std::max(row, 0), texture.height - 1)) * rowBytes;
+        uint8_t* out = atlas.rgba.data() + (static_cast<size_t>(y + row) * atlas.width + x) * 4;
+        for (int i = -padding; i < 0; ++i)
+            std::memcpy(out + i * 4, line, 4);
+        std::memcpy(out, line, rowBytes);
+        for (int i = 0; i < padding; ++i)
+            std::memcpy(out + rowBytes + i * 4, line + rowBytes - 4, 4);
+    }
+}
+
+// Упаковка уровней 0 текстур в атлас со сторонами-степенями двойки не больше
+// maxSize. Ширина и высота подбираются независимо: каждая не меньше самой
+// широкой (высокой) текстуры, а пока площади не хватает, удваивается меньшая
+// сторона. Если текстуры не легли, так же удваивается меньшая сторона (или
+// единственная, которая ещё не достигла maxSize). false — не поместились.
+inline bool packTextureAtlas(const std::vector<Texture>& textures, int padding, int maxSize, TextureAtlas& atlas,
+                             std::string& error) {
+    atlas = TextureAtlas();
+    if (textures.empty()) {
+        error = "нет текстур для атласа";
+        return false;
+    }
+
+    // Порядок вставки: по убыванию высоты, затем ширины
+    std::vector<size_t> order(textures.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return textures[a].height != textures[b].height ? textures[a].height > textures[b].height
+                                                        : textures[a].width > textures[b].width;
+    });
+
+    double area = 0.0;
+    int widest = 1, tallest = 1;
+    for (const Texture& texture : textures) {
+        const int w = texture.width + 2 * padding, h = texture.height + 2 * padding;
+        area += static_cast<double>(w) * h;
+        widest = std::max(widest, w);
+        tallest = std::max(tallest, h);
+    }
+    int width = 1, height = 1;
+    while (width < widest)
+        width *= 2;
+    while (height < tallest)
+        height *= 2;
+
+    // Удвоение меньшей стороны, пока она не упрётся в maxSize; false — расти некуда
+    auto grow = [&]() {
+        const bool widthFirst = width <= height;
+        int& first = widthFirst ? width : height;
+        int& second = widthFirst ? height : width;
+        if (first < maxSize)
+            first *= 2;
+        else if (second < maxSize)
+            second *= 2;
+        else
+            return false;
+        return true;
+    };
+    bool fits = true;
+    while (fits && static_cast<double>(width) * height < area)
+        fits = grow();
+
+    std::vector<int> positions(2 * textures.size());
+    for (;;) {
+        if (!fits || width > maxSize || height > maxSize) {
+            error = "текстуры не помещаются в атлас " + std::to_string(maxSize) + "x" + std::to_string(maxSize);
+            return false;
+        }
+        SkylinePacker packer(width, height);
+        bool packed = true;
+        for (size_t i = 0; i < order.size() && packed; ++i) {
+            const Texture& texture = textures[order[i]];
+            packed = packer.insert(texture.width + 2 * padding, texture.height + 2 * padding, positions[2 * order[i]],
+                                   positions[2 * order[i] + 1]);
+        }
+        if (packed)
+            break;
+        fits = grow();
+    }
+
+    atlas.image.width = width;
+    atlas.image.height = height;
+    atlas.image.levels = 1;
+    atlas.image.rgba.assign(static_cast<size_t>(width) * height * 4, 0);
+    atlas.regions.resize(textures.size());
+    for (size_t i = 0; i < textures.size(); ++i) {
+        AtlasRegion& region = atlas.regions[i];
+        region.x = positions[2 * i] + padding;
+        region.y = positions[2 * i + 1] + padding;
+        region.width = textures[i].width;
+        region.height = textures[i].height;
+        region.uv = glm::vec4(static_cast<float>(region.x) / width, static_cast<float>(region.y) / height,
+                              static_cast<float>(region.width) / width, static_cast<float>(region.height) / height);
+        blitPadded(textures[i], padding, atlas.image, region.x, region.y);
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+// texture_cache.h
+// Дисковый кэш декодированных текстур: при повторном запуске PNG/JPEG не
+// декодируются, а готовая mip-цепочка отображается в память (mmap) и
+// выгружается в GL прямо из отображения, без промежуточной копии.
+//
+// Файл кэша — <каталог>/<хеш исходного файла>.<формат> (.rgba, .bc1, .etc2):
+//   [0, TEXTURE_CACHE_ALIGNMENT)  заголовок TextureCacheHeader, дополненный нулями;
+//   [TEXTURE_CACHE_ALIGNMENT, …)  уровни подряд, как в Texture::rgba.
+// Сжатые записи (texture_compress.h) готовит заранее утилита compress_main.cpp,
+// сама программа их только читает.
+// Пиксели начинаются с границы страницы, поэтому уровень 0 в отображении
+// выровнен так же, как выделенная системой память. Ключ — хеш содержимого
+// исходного файла, а не путь: изменённый файл получает новую запись, а
+// переименованный находит старую. Запись идёт во временный файл с
+// последующим rename(), поэтому прерванная запись не оставляет битых файлов.
+//
+// Отображение файлов есть только в POSIX; на других системах кэш отключён
+// (openCachedTexture и writeCachedTexture возвращают false).
+
+#pragma once
+
+#include "mipmap.h"
+#include "scene.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TEXTURE_CACHE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Каталог кэша по умолчанию (относительно рабочего каталога)
+const char* const TEXTURE_CACHE_DIR = ".texture_cache";
+
+// Смещение пикселей в файле: граница страницы (4 КБ) для любой поддерживаемой системы
+const size_t TEXTURE_CACHE_ALIGNMENT = 4096;
+
+// Версия формата в сигнатуре: меняется вместе с раскладкой или mip-фильтром,
+// тогда старые записи просто не находятся
+const char TEXTURE_CACHE_MAGIC[8] = { 'L', '5', 'T', 'E', 'X', '0', '0', '1' };
+
+struct TextureCacheHeader {
+    char magic[8];
+    uint64_t sourceHash;  // Хеш исходного файла (он же имя записи)
+    uint64_t sourceSize;  // Размер исходного файла — дополнительная проверка ключа
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;      // 1 — только уровень 0, иначе полная цепочка
+    uint32_t format;      // TextureFormat (0 — RGBA8, как в записях до сжатых форматов)
+    uint64_t pixelOffset; // TEXTURE_CACHE_ALIGNMENT
+    uint64_t pixelBytes;  // Texture::levelOffset(levels)
+};
+
+// 64-битный хеш содержимого файла: FNV-1a по 8-байтовым словам (а не по
+// байтам — так хеш исходника занимает единицы миллисекунд на мегабайты)
+// с перемешиванием в конце
+inline uint64_t hashTextureSource(const uint8_t* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ data[i]) * prime;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+inline const char* textureCacheExtension(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::BC1:
+        return "bc1";
+    case TextureFormat::ETC2:
+        return "etc2";
+    default:
+        return "rgba";
+    }
+}
+
+inline std::string textureCachePath(const std::string& directory, uint64_t sourceHash,
+                                    TextureFormat format = TextureFormat::RGBA8) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.%s", static_cast<unsigned long long>(sourceHash),
+                  textureCacheExtension(format));
+    return directory + "/" + name;
+}
+
+// Поиск записи в формате format и отображение её в память. mipmaps == true —
+// нужна полная цепочка (запись только с уровнем 0 не подходит). При успехе
+// texture.mapped указывает на уровень 0 внутри отображения, texture.rgba пуст.
+inline bool openCachedTexture(const std::string& directory, uint64_t sourceHash, uint64_t sourceSize, bool mipmaps,
+                              Texture& texture, TextureFormat format = TextureFormat::RGBA8) {
+#if defined(TEXTURE_CACHE_MMAP)
+    const int fd = ::open(textureCachePath(directory, sourceHash, format).c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    TextureCacheHeader header;
+    struct stat info;
+    const bool readable = ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) && ::fstat(fd, &info) == 0;
+    Texture layout;
+    layout.width = static_cast<int>(header.width);
+    layout.height = static_cast<int>(header.height);
+    layout.levels = static_cast<int>(header.levels);
+    layout.format = format;
+    const bool valid = readable && std::memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                       header.sourceHash == sourceHash && header.sourceSize == sourceSize &&
+                       header.format == static_cast<uint32_t>(format) &&
+                       header.width > 0 && header.height > 0 && header.width <= 65536 && header.height <= 65536 &&
+                       (header.levels == 1 || header.levels == static_cast<uint32_t>(mipLevelCount(layout.width, layout.height))) &&
+                       header.pixelOffset == TEXTURE_CACHE_ALIGNMENT && header.pixelBytes == layout.levelOffset(layout.levels) &&
+                       static_cast<uint64_t>(info.st_size) == header.pixelOffset + header.pixelBytes;
+    if (!valid || (mipmaps && header.levels == 1)) {
+        ::close(fd);
+        return false;
+    }
+    const size_t length = static_cast<size_t>(info.st_size);
+    void* base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // Отображение держит файл само
+    if (base == MAP_FAILED)
+        return false;
+    // Страницы подтягиваются с диска в фоне, пока пиксели ждут выгрузки
+    ::madvise(base, length, MADV_WILLNEED);
+    texture.width = layout.width;
+    texture.height = layout.height;
+    texture.levels = layout.levels;
+    texture.format = format;
+    texture.rgba.clear();
+    texture.mapped = std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(base) + header.pixelOffset,
+                                                    [base, length](const uint8_t*) { ::munmap(base, length); });
+    return true;
+#else
+    (void)directory, (void)sourceHash, (void)sourceSize, (void)mipmaps, (void)texture, (void)format;
+    return false;
+#endif
+}
+
+// Запись декодированной или сжатой текстуры (уровень 0 или вся цепочка) в кэш.
+// Каталог создаётся при необходимости; ошибка записи не мешает рендерингу,
+// поэтому о ней только сообщается результатом.
+inline bool writeCachedTexture(const std::string& directory, uint64_t sourceHash, uint64_t sourceSize, const Texture& texture) {
+#if defined(TEXTURE_CACHE_MMAP)
+    ::mkdir(directory.c_str(), 0755); // Уже существующий каталог — не ошибка
+    TextureCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.width = static_cast<uint32_t>(texture.width);
+    header.height = static_cast<uint32_t>(texture.height);
+    header.levels = static_cast<uint32_t>(texture.levels);
+    header.format = static_cast<uint32_t>(texture.format);
+    header.pixelOffset = TEXTURE_CACHE_ALIGNMENT;
+    header.pixelBytes = texture.levelOffset(texture.levels);
+    std::vector<uint8_t> block(TEXTURE_CACHE_ALIGNMENT, 0);
+    std::memcpy(block.data(), &header, sizeof(header));
+
+    // Имя временного файла уникально для потока: одну текстуру могут
+    // записывать сразу несколько процессов или потоков загрузки
+    const std::string path = textureCachePath(directory, sourceHash, texture.format);
+    char suffix[64];
+    std::snprintf(suffix, sizeof(suffix), ".%ld.%zx.tmp", static_cast<long>(::getpid()),
+                  std::hash<std::thread::id>()(std::this_thread::get_id()));
+    const std::string temporary = path + suffix;
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    auto writeAll = [fd](const uint8_t* data, size_t size) {
+        while (size > 0) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written <= 0)
+                return false;
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    };
+    const bool written = writeAll(block.data(), block.size()) && writeAll(texture.pixels(), header.pixelBytes);
+    if (::close(fd) != 0 || !written || ::rename(temporary.c_str(), path.c_str()) != 0) {
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+#else
+    (void)directory, (void)sourceHash, (void)sourceSize, (void)texture;
+    return false;
+#endif
+}
@@ -0,0 +1,441 @@
+// texture_compress.h
+// Сжатие mip-цепочки RGBA8 в блочные форматы GPU: 8 байт на блок 4x4, то есть
+// 0.5 байта на тексел вместо 4 — в 8 раз меньше видеопамяти и трафика.
+//   BC1 (S3TC DXT1) — для настольного GL. Две опорные точки RGB565 и по два
+//     бита на тексел: одна из четырёх точек отрезка между ними. Направление
+//     отрезка — главная компонента цветов блока, концы затем уточняются
+//     методом наименьших квадратов по выбранным индексам.
+//   ETC2 RGB8 — для OpenGL ES 3.0 (и GL 4.3). Кодируются только режимы,
+//     совместимые с ETC1 (раздельный и разностный): их понимает любой декодер
+//     ETC2. Блок делится на две половины 2x4 или 4x2, у каждой — базовый цвет
+//     (средний по половине) и таблица сдвигов яркости; тексел выбирает один из
+//     четырёх сдвигов таблицы.
+// Альфа не сохраняется (трассировщик её не использует). Цвет кодируется как
+// есть, в sRGB: текстура создаётся в sRGB-варианте формата, и GPU переводит
+// декодированный цвет в линейный так же, как у GL_SRGB8_ALPHA8.
+//
+// Строки блоков уровня делятся между потоками пула, как строки в mipmap.h.
+// Декодеры нужны для оценки качества; decodeETC2Block понимает только
+// режимы, которые выдаёт кодировщик.
+
+#pragma once
+
+#include "scene.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Строк блоков уровня в одной задаче пула
+const int COMPRESS_BLOCK_ROWS_PER_TASK = 4;
+
+// Блок 4x4 уровня RGBA8 (текселы по строкам), за краем уровня повторяются крайние текселы
+inline void loadBlock(const uint8_t* level, int width, int height, int blockX, int blockY, uint8_t block[16][3]) {
+    for (int y = 0; y < 4; ++y) {
+        const size_t row = static_cast<size_t>(std::min(blockY * 4 + y, height - 1)) * width;
+        for (int x = 0; x < 4; ++x) {
+            const uint8_t* texel = level + (row + std::min(blockX * 4 + x, width - 1)) * 4;
+            block[y * 4 + x][0] = texel[0];
+            block[y * 4 + x][1] = texel[1];
+            block[y * 4 + x][2] = texel[2];
+        }
+    }
+}
+
+namespace bc1_detail {
+
+inline uint16_t pack565(const float color[3]) {
+    const int r = static_cast<int>(std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * (31.0f / 255.0f)));
+    const int g = static_cast<int>(std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * (63.0f / 255.0f)));
+    const int b = static_cast<int>(std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * (31.0f / 255.0f)));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void unpack565(uint16_t value, int color[3]) {
+    const int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Палитра блока: при c0 > c1 — четыре точки отрезка, иначе три и чёрный
+inline void palette(uint16_t c0, uint16_t c1, int colors[4][3]) {
+    unpack565(c0, colors[0]);
+    unpack565(c1, colors[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (c0 > c1) {
+            colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+            colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+        }
+        else {
+            colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+            colors[3][c] = 0;
+        }
+    }
+}
+
+// Ближайшая точка палитры для каждого тексела; возвращает сумму квадратов ошибок
+inline int assignIndices(const uint8_t block[16][3], uint16_t c0, uint16_t c1, uint32_t& indices) {
+    int colors[4][3];
+    palette(c0, c1, colors);
+    int error = 0;
+    indices = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestError = INT_MAX;
+        for (int p = 0; p < 4; ++p) {
+            const int dr = colors[p][0] - block[i][0], dg = colors[p][1] - block[i][1], db = colors[p][2] - block[i][2];
+            const int e = dr * dr + dg * dg + db * db;
+            if (e < bestError) {
+                bestError = e;
+                best = p;
+            }
+        }
+        indices |= static_cast<uint32_t>(best) << (2 * i);
+        error += bestError;
+    }
+    return error;
+}
+
+// Концы отрезка по методу наименьших квадратов при заданных индексах
+// (4-цветный режим: вес c0 у индексов 0, 1, 2, 3 — 1, 0, 2/3, 1/3)
+inline bool refineEndpoints(const uint8_t block[16][3], uint32_t indices, uint16_t& c0, uint16_t& c1) {
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i) {
+        const float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; ++c) {
+            ax[c] += a * block[i][c];
+            bx[c] += b * block[i][c];
+        }
+    }
+    const float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false; // Все индексы одинаковы — уточнять нечего
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+    c0 = pack565(e0);
+    c1 = pack565(e1);
+    return true;
+}
+
+} // namespace bc1_detail
+
+inline void encodeBC1Block(const uint8_t block[16][3], uint8_t out[8]) {
+    using namespace bc1_detail;
+
+    // Среднее и ковариация цветов блока
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += block[i][c] * (1.0f / 16.0f);
+    float cov[3][3] = {};
+    for (int i = 0; i < 16; ++i) {
+        const float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c)
+                cov[r][c] += d[r] * d[c];
+    }
+
+    // Главная ось степенным методом (от диагонали куба цветов)
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[3];
+        for (int r = 0; r < 3; ++r)
+            next[r] = cov[r][0] * axis[0] + cov[r][1] * axis[1] + cov[r][2] * axis[2];
+        const float largest = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+        if (largest < 1e-6f)
+            break; // Блок одного цвета
+        for (int c = 0; c < 3; ++c)
+            axis[c] = next[c] / largest;
+    }
+    const float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float low = 0.0f, high = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        const float t = ((block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2]) / length;
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    float e0[3], e1[3];
+    for (int c = 0; c < 3; ++c) {
+        e0[c] = mean[c] + axis[c] / length * high;
+        e1[c] = mean[c] + axis[c] / length * low;
+    }
+    uint16_t c0 = pack565(e0), c1 = pack565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1);
+    uint32_t indices;
+    int error = assignIndices(block, c0, c1, indices);
+
+    // Уточнение концов, пока ошибка уменьшается
+    for (int iteration = 0; iteration < 2 && error > 0 && c0 != c1; ++iteration) {
+        uint16_t r0 = c0, r1 = c1;
+        if (!refineEndpoints(block, indices, r0, r1))
+            break;
+        if (r0 < r1)
+            std::swap(r0, r1);
+        uint32_t refined;
+        const int refinedError = r0 == r1 ? INT_MAX : assignIndices(block, r0, r1, refined);
+        if (refinedError >= error)
+            break;
+        c0 = r0;
+        c1 = r1;
+        indices = refined;
+        error = refinedError;
+    }
+    if (c0 == c1)
+        indices = 0; // Режим трёх цветов, все текселы — c0
+
+    out[0] = static_cast<uint8_t>(c0);
+    out[1] = static_cast<uint8_t>(c0 >> 8);
+    out[2] = static_cast<uint8_t>(c1);
+    out[3] = static_cast<uint8_t>(c1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+}
+
+inline void decodeBC1Block(const uint8_t in[8], uint8_t block[16][3]) {
+    const uint16_t c0 = static_cast<uint16_t>(in[0] | (in[1] << 8)), c1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+    const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+    int colors[4][3];
+    bc1_detail::palette(c0, c1, colors);
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            block[i][c] = static_cast<uint8_t>(colors[(indices >> (2 * i)) & 3][c]);
+}
+
+namespace etc_detail {
+
+// Таблицы сдвигов яркости ETC1: малый и большой сдвиг; индекс тексела
+// (старший бит, младший бит): 00 — +малый, 01 — +большой, 10 — −малый, 11 — −большой
+const int MODIFIERS[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+
+inline int modifier(int table, int index) {
+    const int value = MODIFIERS[table][index & 1];
+    return (index & 2) ? -value : value;
+}
+
+inline int clampByte(int value) { return std::min(std::max(value, 0), 255); }
+inline int expand4(int value) { return (value << 4) | value; }
+inline int expand5(int value) { return (value << 3) | (value >> 2); }
+
+// Текселы половины блока: flip == 0 — столбцы 0-1 и 2-3, flip == 1 — строки 0-1 и 2-3
+inline void subblockTexels(int flip, int half, int texels[8]) {
+    for (int k = 0; k < 8; ++k) {
+        const int x = flip ? k % 4 : half * 2 + k % 2;
+        const int y = flip ? half * 2 + k / 4 : k / 2;
+        texels[k] = y * 4 + x;
+    }
+}
+
+// Лучшая таблица и индексы половины блока при базовом цвете base;
+// возвращает сумму квадратов ошибок (не больше limit — иначе limit)
+inline int fitSubblock(const uint8_t block[16][3], const int texels[8], const int base[3], int limit, int& table, int indices[8]) {
+    int bestError = limit;
+    for (int t = 0; t < 8; ++t) {
+        int error = 0, chosen[8];
+        for (int k = 0; k < 8 && error < bestError; ++k) {
+            const uint8_t* texel = block[texels[k]];
+            int best = INT_MAX;
+            for (int index = 0; index < 4; ++index) {
+                const int m = modifier(t, index);
+                const int dr = clampByte(base[0] + m) - texel[0], dg = clampByte(base[1] + m) - texel[1],
+                          db = clampByte(base[2] + m) - texel[2];
+                const int e = dr * dr + dg * dg + db * db;
+                if (e < best) {
+                    best = e;
+                    chosen[k] = index;
+                }
+            }
+            error += best;
+        }
+        if (error < bestError) {
+            bestError = error;
+            table = t;
+            std::copy(chosen, chosen + 8, indices);
+        }
+    }
+    return bestError;
+}
+
+} // namespace etc_detail
+
+inline void encodeETC2Block(const uint8_t block[16][3], uint8_t out[8]) {
+    using namespace etc_detail;
+
+    int bestError = INT_MAX;
+    uint32_t bestHigh = 0, bestLow = 0;
+    for (int flip = 0; flip < 2; ++flip) {
+        int texels[2][8];
+        float average[2][3] = {};
+        for (int half = 0; half < 2; ++half) {
+            subblockTexels(flip, half, texels[half]);
+            for (int k = 0; k < 8; ++k)
+                for (int c = 0; c < 3; ++c)
+                    average[half][c] += block[texels[half][k]][c] * (1.0f / 8.0f);
+        }
+
+        // Разностный режим: базовые цвета RGB555, второй — первый плюс сдвиг
+        // из [-4, 3] (не помещающийся сдвиг ограничивается); раздельный — RGB444
+        for (int differential = 1; differential >= 0; --differential) {
+            const float levels = differential ? 31.0f : 15.0f;
+            int quantized[2][3], base[2][3];
+            for (int half = 0; half < 2; ++half)
+                for (int c = 0; c < 3; ++c)
+                    quantized[half][c] = static_cast<int>(std::lround(average[half][c] * levels / 255.0f));
+            for (int c = 0; c < 3; ++c) {
+                if (differential)
+                    quantized[1][c] = quantized[0][c] + std::min(std::max(quantized[1][c] - quantized[0][c], -4), 3);
+                for (int half = 0; half < 2; ++half)
+                    base[half][c] = differential ? expand5(quantized[half][c]) : expand4(quantized[half][c]);
+            }
+
+            int tables[2] = { 0, 0 }, indices[2][8];
+            const int error0 = fitSubblock(block, texels[0], base[0], bestError, tables[0], indices[0]);
+            if (error0 >= bestError)
+                continue;
+            const int error1 = fitSubblock(block, texels[1], base[1], bestError - error0, tables[1], indices[1]);
+            if (error0 + error1 >= bestError)
+                continue;
+            bestError = error0 + error1;
+
+            // Старшие 32 бита блока: цвета, таблицы, признаки режима и разбиения
+            uint32_t first[3], second[3];
+            for (int c = 0; c < 3; ++c) {
+                first[c] = static_cast<uint32_t>(quantized[0][c]);
+                second[c] = static_cast<uint32_t>(differential ? (quantized[1][c] - quantized[0][c]) & 7 : quantized[1][c]);
+            }
+            const int bits = differential ? 3 : 4;
+            bestHigh = 0;
+            for (int c = 0; c < 3; ++c)
+                bestHigh |= ((first[c] << bits) | second[c]) << (24 - 8 * c);
+            bestHigh |= static_cast<uint32_t>((tables[0] << 5) | (tables[1] << 2) | (differential << 1) | flip);
+
+            // Младшие 32 бита: текселы по столбцам, младшие биты индексов — в
+            // битах 0-15, старшие — в 16-31
+            bestLow = 0;
+            for (int half = 0; half < 2; ++half) {
+                for (int k = 0; k < 8; ++k) {
+                    const int texel = texels[half][k];
+                    const int bit = (texel % 4) * 4 + texel / 4;
+                    bestLow |= static_cast<uint32_t>(indices[half][k] & 1) << bit;
+                    bestLow |= static_cast<uint32_t>(indices[half][k] >> 1) << (bit + 16);
+                }
+            }
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<uint8_t>(bestHigh >> (24 - 8 * i));
+        out[4 + i] = static_cast<uint8_t>(bestLow >> (24 - 8 * i));
+    }
+}
+
+inline void decodeETC2Block(const uint8_t in[8], uint8_t block[16][3]) {
+    using namespace etc_detail;
+    const uint32_t high = (static_cast<uint32_t>(in[0]) << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+    const uint32_t low = (static_cast<uint32_t>(in[4]) << 24) | (in[5] << 16) | (in[6] << 8) | in[7];
+    const int flip = high & 1;
+    int base[2][3];
+    for (int c = 0; c < 3; ++c) {
+        const int shift = 24 - 8 * c;
+        if (high & 2) {
+            const int first = (high >> (shift + 3)) & 31;
+            const int delta = static_cast<int>((high >> shift) & 7) - (((high >> shift) & 4) ? 8 : 0);
+            base[0][c] = expand5(first);
+            base[1][c] = expand5(first + delta);
+        }
+        else {
+            base[0][c] = expand4((high >> (shift + 4)) & 15);
+            base[1][c] = expand4((high >> shift) & 15);
+        }
+    }
+    const int tables[2] = { static_cast<int>((high >> 5) & 7), static_cast<int>((high >> 2) & 7) };
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            const int half = flip ? y / 2 : x / 2;
+            const int bit = x * 4 + y;
+            const int index = static_cast<int>((((low >> (bit + 16)) & 1) << 1) | ((low >> bit) & 1));
+            for (int c = 0; c < 3; ++c)
+                block[y * 4 + x][c] = static_cast<uint8_t>(clampByte(base[half][c] + modifier(tables[half], index)));
+        }
+    }
+}
+
+inline void encodeBlock(TextureFormat format, const uint8_t block[16][3], uint8_t out[8]) {
+    if (format == TextureFormat::BC1)
+        encodeBC1Block(block, out);
+    else
+        encodeETC2Block(block, out);
+}
+
+inline void decodeBlock(TextureFormat format, const uint8_t in[8], uint8_t block[16][3]) {
+    if (format == TextureFormat::BC1)
+        decodeBC1Block(in, block);
+    else
+        decodeETC2Block(in, block);
+}
+
+// Сжатие всех уровней текстуры RGBA8 в format. pool == nullptr — в текущем потоке.
+inline Texture compressTexture(const Texture& source, TextureFormat format, WorkStealingPool* pool = nullptr) {
+    Texture result;
+    result.width = source.width;
+    result.height = source.height;
+    result.levels = source.levels;
+    result.format = format;
+    result.rgba.resize(result.levelOffset(result.levels));
+    for (int level = 0; level < result.levels; ++level) {
+        const uint8_t* src = source.pixels() + source.levelOffset(level);
+        uint8_t* dst = result.rgba.data() + result.levelOffset(level);
+        const int width = result.levelWidth(level), height = result.levelHeight(level);
+        const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        const size_t tasks = static_cast<size_t>((blocksY + COMPRESS_BLOCK_ROWS_PER_TASK - 1) / COMPRESS_BLOCK_ROWS_PER_TASK);
+        auto task = [&](size_t index, unsigned) {
+            const int first = static_cast<int>(index) * COMPRESS_BLOCK_ROWS_PER_TASK;
+            for (int by = first; by < std::min(blocksY, first + COMPRESS_BLOCK_ROWS_PER_TASK); ++by) {
+                for (int bx = 0; bx < blocksX; ++bx) {
+                    uint8_t block[16][3];
+                    loadBlock(src, width, height, bx, by, block);
+                    encodeBlock(format, block, dst + (static_cast<size_t>(by) * blocksX + bx) * 8);
+                }
+            }
+        };
+        if (pool && tasks > 1)
+            pool->parallelFor(tasks, task);
+        else
+            for (size_t i = 0; i < tasks; ++i)
+                task(i, 0);
+    }
+    return result;
+}
+
+// PSNR уровня 0 сжатой текстуры относительно исходной (RGB, дБ)
+inline double compressedPSNR(const Texture& source, const Texture& compressed) {
+    const int blocksX = (source.width + 3) / 4, blocksY = (source.height + 3) / 4;
+    double squared = 0.0;
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            uint8_t original[16][3], decoded[16][3];
+            loadBlock(source.pixels(), source.width, source.height, bx, by, original);
+            decodeBlock(compressed.format, compressed.pixels() + (static_cast<size_t>(by) * blocksX + bx) * 8, decoded);
+            for (int i = 0; i < 16; ++i) {
+                if (bx * 4 + i % 4 >= source.width || by * 4 + i / 4 >= source.height)
+                    continue; // Повтор крайних текселов за краем уровня
+                for (int c = 0; c < 3; ++c) {
+                    const double d = static_cast<double>(original[i][c]) - decoded[i][c];
+                    squared += d * d;
+                }
+            }
+        }
+    }
+    const double mse = squared / (3.0 * source.width * source.height);
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+}
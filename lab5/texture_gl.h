@@ -0,0 +1,153 @@
+// texture_gl.h
+// Выгрузка декодированных текстур (texture.h) в OpenGL. Вызывается только из
+// потока GL: декодирование и mip-цепочка готовятся в TextureLoader, сюда
+// попадают готовые пиксели.
+
+#pragma once
+
+#include "texture.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Постепенная выгрузка mip-цепочки: уровни идут от самого мелкого к уровню 0,
+// каждый — полосами строк (glTexSubImage2D), не больше бюджета байт за вызов
+// step(). Так даже текстура 4096x4096 не задерживает кадр. GL_TEXTURE_BASE_LEVEL
+// указывает на самый подробный полностью выгруженный уровень: текстура пригодна
+// к выборке после первого шага и с каждым уровнем становится чётче.
+// Формат GL_SRGB8_ALPHA8: выборка в шейдере возвращает линейный цвет.
+// Сжатые текстуры (texture_compress.h) идут тем же порядком, но полосами из
+// целых строк блоков (glCompressedTexSubImage2D), в sRGB-варианте своего формата.
+//
+// Для потоковой загрузки (texture_stream.h) выгрузка останавливается на
+// уровне setTarget(), а evict() освобождает подробные уровни; пиксели тогда
+// хранятся (keepPixels), чтобы уровни можно было выгрузить снова.
+class TextureUpload {
+public:
+    explicit TextureUpload(Texture texture, bool keepPixels = false)
+        : texture_(std::move(texture)), level_(texture_.levels - 1), keepPixels_(keepPixels) {
+        glGenTextures(1, &id_);
+        glBindTexture(GL_TEXTURE_2D, id_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture_.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture_.levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Объект текстуры; удаляет его владелец (TextureUpload только заполняет)
+    GLuint id() const { return id_; }
+    bool done() const { return level_ < target_; }
+    const Texture& texture() const { return texture_; }
+
+    // Самый подробный полностью выгруженный уровень (texture.levels — ещё ни одного)
+    int residentLevel() const { return residentLevel_; }
+
+    // Видеопамять под выгруженные и начатый уровни
+    size_t residentBytes() const {
+        const int first = row_ > 0 ? level_ : level_ + 1;
+        return texture_.levelOffset(texture_.levels) - texture_.levelOffset(first);
+    }
+
+    // Самый подробный уровень, до которого идёт выгрузка (по умолчанию 0)
+    void setTarget(int level) { target_ = std::min(std::max(level, 0), texture_.levels - 1); }
+
+    // Освобождение уровней подробнее level (level > residentLevel()): базовым
+    // становится level, память уровней отдаётся пересозданием их размером 0x0
+    void evict(int level) {
+        const int first = row_ > 0 ? level_ : level_ + 1;
+        if (level <= first || level >= texture_.levels)
+            return;
+        const GLenum format = internalFormat(texture_.format);
+        glBindTexture(GL_TEXTURE_2D, id_);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        for (int l = first; l < level; ++l) {
+            if (texture_.compressed())
+                glCompressedTexImage2D(GL_TEXTURE_2D, l, format, 0, 0, 0, 0, nullptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, l, format, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        level_ = level - 1;
+        row_ = 0;
+        residentLevel_ = level;
+    }
+
+    // Внутренний формат GL: sRGB-вариант формата текстуры
+    static GLenum internalFormat(TextureFormat format) {
+        switch (format) {
+        case TextureFormat::BC1:
+            return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case TextureFormat::ETC2:
+            return GL_COMPRESSED_SRGB8_ETC2;
+        default:
+            return GL_SRGB8_ALPHA8;
+        }
+    }
+
+    // Выгрузка следующих строк, не больше budget байт (но хотя бы одна строка
+    // текселов или блоков, иначе строка крупнее бюджета не выгрузилась бы
+    // никогда). Текстура привязывается к активному текстурному блоку и затем
+    // отвязывается.
+    // Возвращает число выгруженных байт.
+    size_t step(size_t budget) {
+        size_t uploaded = 0;
+        glBindTexture(GL_TEXTURE_2D, id_);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4); // Строка RGBA8 всегда кратна 4 байтам
+        const bool compressed = texture_.compressed();
+        const GLenum format = internalFormat(texture_.format);
+        const int bandRows = compressed ? 4 : 1; // Строк текселов в строке блоков
+        while (level_ >= target_ && (uploaded == 0 || uploaded < budget)) {
+            const int width = texture_.levelWidth(level_), height = texture_.levelHeight(level_);
+            const size_t bandBytes = compressed ? static_cast<size_t>((width + 3) / 4) * 8 : static_cast<size_t>(width) * 4;
+            const size_t left = budget > uploaded ? budget - uploaded : 0;
+            const int bands = (height - row_ + bandRows - 1) / bandRows;
+            const int count = std::min(bands, std::max(1, static_cast<int>(left / bandBytes)));
+            const int rows = std::min(height - row_, count * bandRows);
+            const uint8_t* data = texture_.pixels() + texture_.levelOffset(level_) + row_ / bandRows * bandBytes;
+            const GLsizei size = static_cast<GLsizei>(count * bandBytes);
+            if (!compressed) {
+                if (row_ == 0)
+                    glTexImage2D(GL_TEXTURE_2D, level_, format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glTexSubImage2D(GL_TEXTURE_2D, level_, 0, row_, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            }
+            else if (row_ == 0 && rows == height) { // Уровень целиком (и все уровни меньше блока)
+                glCompressedTexImage2D(GL_TEXTURE_2D, level_, format, width, height, 0, size, data);
+            }
+            else {
+                if (row_ == 0)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, level_, format, width, height, 0,
+                                           static_cast<GLsizei>(texture_.levelSize(level_)), nullptr);
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, level_, 0, row_, width, rows, format, size, data);
+            }
+            uploaded += size;
+            row_ += rows;
+            if (row_ == height) {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level_);
+                residentLevel_ = level_;
+                --level_;
+                row_ = 0;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (done() && target_ == 0 && !keepPixels_) { // Пиксели больше не нужны
+            std::vector<uint8_t>().swap(texture_.rgba);
+            texture_.mapped.reset();
+        }
+        return uploaded;
+    }
+
+private:
+    Texture texture_;
+    GLuint id_ = 0;
+    int level_;              // Выгружаемый уровень (-1 — все выгружены)
+    int row_ = 0;            // Следующая строка уровня level_
+    int residentLevel_ = texture_.levels;
+    int target_ = 0;         // Выгрузка идёт до этого уровня включительно
+    bool keepPixels_;
+};
@@ -0,0 +1,184 @@
+// texture_stream.h
+// Потоковая загрузка текстур в видеопамять с общим бюджетом. Декодирование
+// и mip-цепочки остаются за TextureLoader (stb_image в фоновых потоках), сюда
+// попадают готовые цепочки, а в GL уходят только нужные уровни:
+//   - сразу — «хвост» цепочки (уровни не больше STREAM_TAIL_SIZE), он мал и
+//     не вытесняется: текстура пригодна к выборке с первого кадра;
+//   - дальше — по отзыву LOD (requestLevel): рендеринг сообщает, какой самый
+//     подробный уровень понадобился текстуре на экране, и уровни до него
+//     выгружаются от мелких к крупным, не больше бюджета байт за кадр;
+//   - при нехватке бюджета видеопамяти освобождаются подробные уровни,
+//     которые дольше всех не требовались (LRU по номеру отзыва). Уровни,
+//     нужные по последнему отзыву, не вытесняются: текстура тогда ждёт
+//     места на более грубом уровне, и загрузки не гоняют друг друга.
+// Цепочки хранятся в оперативной памяти (или в отображении кэша), чтобы
+// вытесненный уровень можно было выгрузить снова без декодирования.
+
+#pragma once
+
+#include "texture_gl.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Уровни не больше этого размера (по большей стороне) выгружаются сразу и не вытесняются
+const int STREAM_TAIL_SIZE = 64;
+
+class TextureStreamer {
+public:
+    // budgetBytes — видеопамять под все текстуры
+    explicit TextureStreamer(size_t budgetBytes) : budget_(budgetBytes) {}
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // Новая текстура; возвращает её номер
+    size_t add(Texture texture) {
+        Entry entry(std::move(texture));
+        const Texture& chain = entry.upload.texture();
+        entry.tail = chain.levels - 1;
+        while (entry.tail > 0 && std::max(chain.levelWidth(entry.tail - 1), chain.levelHeight(entry.tail - 1)) <= STREAM_TAIL_SIZE)
+            --entry.tail;
+        entry.wanted = entry.tail;
+        entry.lastUsed.assign(chain.levels, 0);
+        entry.upload.setTarget(entry.tail);
+        entries_.push_back(std::move(entry));
+        return entries_.size() - 1;
+    }
+
+    size_t size() const { return entries_.size(); }
+    GLuint id(size_t index) const { return entries_[index].upload.id(); }
+    int residentLevel(size_t index) const { return entries_[index].upload.residentLevel(); }
+    int wantedLevel(size_t index) const { return entries_[index].wanted; }
+    const Texture& texture(size_t index) const { return entries_[index].upload.texture(); }
+
+    size_t residentBytes() const {
+        size_t bytes = 0;
+        for (const Entry& entry : entries_)
+            bytes += entry.upload.residentBytes();
+        return bytes;
+    }
+
+    // Начало очередного отзыва LOD: номера отзывов — часы LRU
+    void beginFeedback() { ++clock_; }
+
+    // Отзыв: текстуре на экране нужен уровень level (и все грубее).
+    // Текстуры без отзыва не догружаются и стареют для LRU.
+    void requestLevel(size_t index, int level) {
+        Entry& entry = entries_[index];
+        entry.wanted = std::min(std::max(level, 0), entry.tail);
+        for (int l = entry.wanted; l < entry.tail; ++l)
+            entry.lastUsed[l] = clock_;
+    }
+
+    // Выгрузка недостающих уровней, не больше uploadBudget байт за вызов.
+    // Из всех текстур сначала выгружается самый мелкий недостающий уровень.
+    // Возвращает число выгруженных байт.
+    size_t update(size_t uploadBudget) {
+        size_t uploaded = 0;
+        for (Entry& entry : entries_)
+            entry.blocked = false;
+        while (uploaded < uploadBudget) {
+            Entry* next = nullptr;
+            size_t nextSize = 0;
+            for (Entry& entry : entries_) {
+                const int level = nextLevel(entry);
+                if (level < 0 || entry.blocked)
+                    continue;
+                const size_t size = entry.upload.texture().levelSize(level);
+                if (!next || size < nextSize) {
+                    next = &entry;
+                    nextSize = size;
+                }
+            }
+            if (!next)
+                break;
+            const int level = nextLevel(*next);
+            next->upload.setTarget(level);
+            if (!makeRoom(*next, level)) {
+                next->upload.setTarget(next->upload.residentLevel());
+                next->blocked = true; // Ждёт, пока вытеснять станет что
+                continue;
+            }
+            uploaded += next->upload.step(uploadBudget - uploaded);
+        }
+        return uploaded;
+    }
+
+    // Все нужные уровни выгружены (или ждут места в бюджете)
+    bool idle() const {
+        for (const Entry& entry : entries_)
+            if (nextLevel(entry) >= 0 && !entry.blocked)
+                return false;
+        return true;
+    }
+
+    // Удаление всех текстур (пока контекст OpenGL ещё существует)
+    void clear() {
+        for (Entry& entry : entries_) {
+            const GLuint id = entry.upload.id();
+            glDeleteTextures(1, &id);
+        }
+        entries_.clear();
+    }
+
+private:
+    struct Entry {
+        explicit Entry(Texture texture) : upload(std::move(texture), true) {}
+
+        TextureUpload upload;
+        int tail = 0;                   // Самый подробный уровень хвоста
+        int wanted = 0;                 // Самый подробный нужный уровень по отзыву
+        std::vector<uint64_t> lastUsed; // Номер последнего отзыва, которому уровень был нужен
+        bool blocked = false;           // В этом кадре уровню не нашлось места
+    };
+
+    // Следующий выгружаемый уровень текстуры (-1 — выгружать нечего). Уровни
+    // хвоста нужны всегда, остальные — только по последнему отзыву: текстура,
+    // пропавшая из кадра, не догружается, и её уровни постепенно вытесняются.
+    int nextLevel(const Entry& entry) const {
+        const int level = entry.upload.residentLevel() - 1;
+        if (level < entry.wanted)
+            return -1;
+        return level >= entry.tail || entry.lastUsed[level] == clock_ ? level : -1;
+    }
+
+    // Освобождение бюджета под уровень level текстуры target: вытесняются
+    // самые подробные уровни текстур (только они — цепочка должна оставаться
+    // сплошной), давно не нужные по отзыву. false — места нет.
+    bool makeRoom(Entry& target, int level) {
+        const Texture& chain = target.upload.texture();
+        const size_t needed = target.upload.residentBytes() > chain.levelOffset(chain.levels) - chain.levelOffset(level + 1)
+                                  ? 0 // Уровень уже начат
+                                  : chain.levelSize(level);
+        size_t resident = residentBytes();
+        while (resident + needed > budget_) {
+            Entry* victim = nullptr;
+            int victimLevel = 0;
+            for (Entry& entry : entries_) {
+                const int finest = entry.upload.residentLevel();
+                if (&entry == &target || finest >= entry.tail || entry.lastUsed[finest] >= clock_)
+                    continue;
+                if (!victim || entry.lastUsed[finest] < victim->lastUsed[victimLevel]) {
+                    victim = &entry;
+                    victimLevel = finest;
+                }
+            }
+            if (!victim)
+                return false;
+            const size_t before = victim->upload.residentBytes();
+            victim->upload.evict(victimLevel + 1);
+            victim->upload.setTarget(victimLevel + 1);
+            resident -= before - victim->upload.residentBytes();
+        }
+        return true;
+    }
+
+    size_t budget_;
+    uint64_t clock_ = 1; // Уровни хвоста и ещё не запрошенные имеют lastUsed = 0
+    std::vector<Entry> entries_;
+};
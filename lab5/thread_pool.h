@@ -0,0 +1,176 @@
+// thread_pool.h
+// Пул потоков с перехватом задач (work stealing) для CPU-трассировщика
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+    // threadCount == 0 — по числу аппаратных потоков
+    explicit WorkStealingPool(unsigned threadCount = 0) {
+        if (threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned i = 0; i < threadCount; ++i)
+            queues_.emplace_back(new WorkerQueue());
+
+        // Поток-вызывающий сам работает как исполнитель с номером 0
+        for (unsigned i = 1; i < threadCount; ++i)
+            threads_.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_)
+            thread.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+    // Выполняет task(item, worker) для всех item из [0, count) и ждёт завершения.
+    // Каждый поток получает непрерывный диапазон задач и берёт их с начала своей
+    // очереди; освободившиеся потоки забирают задачи с конца чужих очередей.
+    void parallelFor(size_t count, const std::function<void(size_t, unsigned)>& task) {
+        if (count == 0)
+            return;
+
+        const size_t workers = queues_.size();
+        for (size_t w = 0; w < workers; ++w) {
+            size_t begin = count * w / workers;
+            size_t end = count * (w + 1) / workers;
+            std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+            for (size_t i = begin; i < end; ++i)
+                queues_[w]->items.push_back(i);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            busyWorkers_ = static_cast<unsigned>(threads_.size());
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        runWorker(0);
+
+        // Ждём, пока все потоки выйдут из runWorker, чтобы task_ можно было сменить
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busyWorkers_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    void workerLoop(unsigned index) {
+        uint64_t seenGeneration = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seenGeneration; });
+                if (stop_)
+                    return;
+                seenGeneration = generation_;
+            }
+
+            runWorker(index);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busyWorkers_ == 0)
+                done_.notify_all();
+        }
+    }
+
+    void runWorker(unsigned index) {
+        size_t item;
+        while (popLocal(index, item) || steal(index, item))
+            (*task_)(item, index);
+    }
+
+    bool popLocal(unsigned index, size_t& item) {
+        WorkerQueue& queue = *queues_[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.items.empty())
+            return false;
+        item = queue.items.front();
+        queue.items.pop_front();
+        return true;
+    }
+
+    bool steal(unsigned thief, size_t& item) {
+        const unsigned workers = size();
+        for (unsigned offset = 1; offset < workers; ++offset) {
+            WorkerQueue& victim = *queues_[(thief + offset) % workers];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.items.empty()) {
+                item = victim.items.back();
+                victim.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t, unsigned)>* task_ = nullptr;
+    uint64_t generation_ = 0;
+    unsigned busyWorkers_ = 0;
+    bool stop_ = false;
+};
+
+// Параллельная сортировка: куски по числу потоков сортируются независимо,
+// затем сливаются попарно раундами (слияния одного раунда идут параллельно)
+template <class T>
+void parallelSort(std::vector<T>& values, WorkStealingPool& pool) {
+    const size_t chunks = std::min<size_t>(pool.size(), std::max<size_t>(1, values.size() / 4096));
+    if (chunks <= 1) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t i = 0; i <= chunks; ++i)
+        bounds[i] = values.size() * i / chunks;
+    pool.parallelFor(chunks, [&](size_t chunk, unsigned) {
+        std::sort(values.begin() + bounds[chunk], values.begin() + bounds[chunk + 1]);
+    });
+
+    std::vector<T> merged(values.size());
+    for (size_t width = 1; width < chunks; width *= 2) {
+        const size_t pairs = (chunks + 2 * width - 1) / (2 * width);
+        pool.parallelFor(pairs, [&](size_t pair, unsigned) {
+            const size_t begin = bounds[pair * 2 * width];
+            const size_t middle = bounds[std::min(chunks, pair * 2 * width + width)];
+            const size_t end = bounds[std::min(chunks, pair * 2 * width + 2 * width)];
+            std::merge(values.begin() + begin, values.begin() + middle, values.begin() + middle, values.begin() + end,
+                       merged.begin() + begin);
+        });
+        values.swap(merged);
+    }
+}
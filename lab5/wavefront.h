@@ -0,0 +1,361 @@
+// wavefront.h
+// Волновой (wavefront) конвейер для Integrator::Whitted. Вместо цикла по
+// отскокам внутри одного пикселя (traceRay) полоса строк кадра (не больше
+// RAY_QUEUE_BATCH выборок, см. rayQueueBatchRows) проходит стадии, и каждая
+// стадия обрабатывает сразу все живые лучи полосы:
+//   generate — первичные лучи всех выборок;
+//   extend   — ближайшее пересечение: плоскость векторным циклом по очереди,
+//              затем BVH сфер и экземпляров сеток;
+//   shade    — точка, нормаль, материал; небо для промахов, теневой луч и
+//              отражённый луч для попаданий;
+//   shadow   — теневые лучи (сначала дешёвая плоскость, затем BVH) и сложение
+//              вклада отскока в цвет выборки.
+// Очереди хранятся по полям (SoA). Стадии раздаются пулу кусками по
+// RAY_QUEUE_CHUNK, и кусок пишет свои выходные лучи подряд от начала куска.
+// Теневые лучи проверяются прямо там (кусок shadow — плотный префикс куска
+// shade), а отражённые по префиксным суммам переносятся в плотную очередь
+// следующего отскока.
+// Векторизован по лучам только цикл плоскости; обход BVH остаётся скалярным
+// для каждого луча (векторные ядра работают внутри листа, по сферам и
+// треугольникам), так что выигрыш конвейера — в плотных очередях и
+// согласованном доступе к памяти, а не в SIMD по лучам.
+// Вклады отскоков складываются в том же порядке, что и в traceRay.
+
+#pragma once
+
+#include "raytracer.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Очередь лучей: начало, направление, номер выборки в полосе и вес
+// (накопленный коэффициент отражения)
+struct RayQueue {
+    std::vector<float> ox, oy, oz, dx, dy, dz;
+    std::vector<uint32_t> sample;
+    std::vector<float> weight;
+    size_t count = 0;
+
+    void reserve(size_t capacity) {
+        if (ox.size() >= capacity)
+            return;
+        ox.resize(capacity);
+        oy.resize(capacity);
+        oz.resize(capacity);
+        dx.resize(capacity);
+        dy.resize(capacity);
+        dz.resize(capacity);
+        sample.resize(capacity);
+        weight.resize(capacity);
+    }
+
+    Ray ray(size_t i) const {
+        Ray r;
+        r.origin = glm::vec3(ox[i], oy[i], oz[i]);
+        r.direction = glm::vec3(dx[i], dy[i], dz[i]);
+        return r;
+    }
+
+    void set(size_t i, const Ray& r, uint32_t sampleIndex, float rayWeight) {
+        ox[i] = r.origin.x;
+        oy[i] = r.origin.y;
+        oz[i] = r.origin.z;
+        dx[i] = r.direction.x;
+        dy[i] = r.direction.y;
+        dz[i] = r.direction.z;
+        sample[i] = sampleIndex;
+        weight[i] = rayWeight;
+    }
+
+    void copy(const RayQueue& from, size_t src, size_t dst) {
+        set(dst, from.ray(src), from.sample[src], from.weight[src]);
+    }
+};
+
+// Результаты extend: расстояние, объект (как в intersectScene) и попадание в сетку
+struct HitQueue {
+    std::vector<float> t;
+    std::vector<int32_t> object;
+    std::vector<MeshHit> mesh;
+
+    void reserve(size_t capacity) {
+        if (t.size() >= capacity)
+            return;
+        t.resize(capacity);
+        object.resize(capacity);
+        mesh.resize(capacity);
+    }
+};
+
+// Теневые лучи с цветом точки: фоновая часть (getAmbient) и прямой свет
+// (getDirect), который добавляется, только если луч не закрыт; вес — вес луча
+struct ShadowQueue {
+    std::vector<float> ox, oy, oz, dx, dy, dz;
+    std::vector<int32_t> object; // Объект, из которого вышел луч (для исключения)
+    std::vector<uint32_t> sample;
+    std::vector<glm::vec3> ambient, direct;
+    std::vector<float> weight;
+    std::vector<uint8_t> occluded;
+
+    void reserve(size_t capacity) {
+        if (ox.size() >= capacity)
+            return;
+        ox.resize(capacity);
+        oy.resize(capacity);
+        oz.resize(capacity);
+        dx.resize(capacity);
+        dy.resize(capacity);
+        dz.resize(capacity);
+        object.resize(capacity);
+        sample.resize(capacity);
+        ambient.resize(capacity);
+        direct.resize(capacity);
+        weight.resize(capacity);
+        occluded.resize(capacity);
+    }
+};
+
+// Уплотнение: кусок c записал chunkCounts[c] элементов подряд с позиции
+// c * RAY_QUEUE_CHUNK в sparse; элементы переносятся подряд в dense.
+// Возвращает итоговое число элементов.
+template <class Queue>
+size_t compactQueue(const Queue& sparse, const std::vector<size_t>& chunkCounts, Queue& dense, WorkStealingPool& pool) {
+    std::vector<size_t> offsets(chunkCounts.size() + 1, 0);
+    for (size_t c = 0; c < chunkCounts.size(); ++c)
+        offsets[c + 1] = offsets[c] + chunkCounts[c];
+    dense.reserve(offsets.back());
+    pool.parallelFor(chunkCounts.size(), [&](size_t chunk, unsigned) {
+        const size_t src = chunk * RAY_QUEUE_CHUNK;
+        for (size_t i = 0; i < chunkCounts[chunk]; ++i)
+            dense.copy(sparse, src + i, offsets[chunk] + i);
+    });
+    dense.count = offsets.back();
+    return dense.count;
+}
+
+// Пересечение отрезка очереди с плоскостью (та же формула, что в intersectPlane).
+// Цикл без ветвлений, компилятор векторизует его по лучам. tPlane = -1 при промахе.
+template <class Queue>
+void intersectPlaneQueue(const Plane& plane, const Queue& queue, size_t begin, size_t end, float* tPlane) {
+    const float nx = plane.normal.x, ny = plane.normal.y, nz = plane.normal.z;
+    const float px = plane.point.x, py = plane.point.y, pz = plane.point.z;
+    for (size_t i = begin; i < end; ++i) {
+        const float denom = nx * queue.dx[i] + ny * queue.dy[i] + nz * queue.dz[i];
+        const float t = ((px - queue.ox[i]) * nx + (py - queue.oy[i]) * ny + (pz - queue.oz[i]) * nz) / denom;
+        tPlane[i - begin] = std::fabs(denom) > 1e-6f && t >= 0.0f ? t : -1.0f;
+    }
+}
+
+// Волновой конвейер. Очереди рассчитаны на одну полосу строк и живут между
+// полосами и кадрами: буферы выделяются при первом кадре (или росте полосы)
+// и дальше переиспользуются.
+class WavefrontRenderer {
+public:
+    // Рендеринг кадра (Integrator::Whitted, без адаптивной выборки). При
+    // settings.rayOrder == RayOrder::Binned отражённые лучи перед каждым отскоком
+    // раскладываются по корзинам. Изображение совпадает с renderImage
+    // (побайтно при -ffp-contract=off).
+    void render(const Scene& scene, const SceneBVH& bvh, const RenderSettings& settings, Framebuffer& framebuffer,
+                WorkStealingPool& pool, RayCounters* counters = nullptr) {
+        if (framebuffer.width != settings.width || framebuffer.height != settings.height)
+            framebuffer = Framebuffer(settings.width, settings.height);
+
+        const CameraBasis basis = makeCameraBasis(scene.camera,
+                                                  static_cast<float>(settings.width) / static_cast<float>(settings.height));
+        const int samples = std::max(1, settings.samplesPerPixel);
+        const int batchRows = rayQueueBatchRows(settings);
+        const size_t capacity = static_cast<size_t>(batchRows) * settings.width * samples;
+        std::vector<RayCounters> workerCounters(pool.size());
+
+        // Отражённых и теневых лучей не больше, чем выборок полосы, поэтому
+        // буферов этой ёмкости хватает на все отскоки и все полосы
+        if (sampleColors.size() < capacity)
+            sampleColors.resize(capacity);
+        rays.reserve(capacity);
+        hits.reserve(capacity);
+        shadows.reserve(capacity);
+        reflected.reserve(capacity);
+        if (settings.rayOrder == RayOrder::Binned)
+            binned.reserve(capacity);
+
+        for (int rowBegin = 0; rowBegin < settings.height; rowBegin += batchRows) {
+            const int rows = std::min(batchRows, settings.height - rowBegin);
+            const size_t batchSamples = static_cast<size_t>(rows) * settings.width * samples;
+            std::fill(sampleColors.begin(), sampleColors.begin() + batchSamples, glm::vec3(0.0f));
+            renderBatch(scene, bvh, basis, settings, rowBegin, rows, pool, workerCounters);
+
+            // Среднее по выборкам пикселя (суммирование в порядке выборок, как в renderTile)
+            pool.parallelFor(static_cast<size_t>(rows), [&](size_t row, unsigned) {
+                for (int x = 0; x < settings.width; ++x) {
+                    const size_t local = row * settings.width + x;
+                    glm::vec3 color(0.0f);
+                    for (int s = 0; s < samples; ++s)
+                        color += sampleColors[local * samples + s];
+                    framebuffer.pixels[static_cast<size_t>(rowBegin) * settings.width + local] =
+                        color / static_cast<float>(samples);
+                }
+            });
+        }
+
+        if (counters) {
+            for (const RayCounters& workerCounter : workerCounters)
+                *counters += workerCounter;
+        }
+    }
+
+private:
+    // Стадии для строк [rowBegin, rowBegin + rows): цвета выборок полосы
+    // складываются в sampleColors
+    void renderBatch(const Scene& scene, const SceneBVH& bvh, const CameraBasis& basis, const RenderSettings& settings,
+                     int rowBegin, int rows, WorkStealingPool& pool, std::vector<RayCounters>& workerCounters) {
+        const int planeObject = static_cast<int>(scene.spheres.size());
+        const int samples = std::max(1, settings.samplesPerPixel);
+
+        // generate: первичные лучи всех выборок полосы по строкам
+        pool.parallelFor(static_cast<size_t>(rows), [&](size_t row, unsigned) {
+            const int y = rowBegin + static_cast<int>(row);
+            for (int x = 0; x < settings.width; ++x) {
+                for (int s = 0; s < samples; ++s) {
+                    const size_t index = (row * settings.width + x) * samples + s;
+                    rays.set(index, sampleRay(basis, settings, x, y, s), static_cast<uint32_t>(index), 1.0f);
+                }
+            }
+        });
+        rays.count = static_cast<size_t>(rows) * settings.width * samples;
+
+        for (int depth = 0; depth < settings.maxDepth && rays.count > 0; ++depth) {
+            const size_t chunks = (rays.count + RAY_QUEUE_CHUNK - 1) / RAY_QUEUE_CHUNK;
+            std::vector<size_t> shadowCounts(chunks), reflectedCounts(chunks);
+
+            // extend: плоскость по всему куску, затем BVH сфер и экземпляров
+            pool.parallelFor(chunks, [&](size_t chunk, unsigned worker) {
+                const size_t begin = chunk * RAY_QUEUE_CHUNK;
+                const size_t end = std::min(rays.count, begin + RAY_QUEUE_CHUNK);
+                float tPlane[RAY_QUEUE_CHUNK];
+                intersectPlaneQueue(scene.floorPlane, rays, begin, end, tPlane);
+                for (size_t i = begin; i < end; ++i) {
+                    const glm::vec3 origin(rays.ox[i], rays.oy[i], rays.oz[i]);
+                    const glm::vec3 dir(rays.dx[i], rays.dy[i], rays.dz[i]);
+                    float tMin = 1e20f;
+                    int hitObject = -1;
+                    MeshHit meshHit;
+                    bvh.spheres.intersectClosest(origin, dir, tMin, hitObject);
+                    const float t = tPlane[i - begin];
+                    if (t >= 0.0f && t < tMin) {
+                        tMin = t;
+                        hitObject = planeObject;
+                    }
+                    if (!bvh.instances.empty() && bvh.instances.intersectClosest(origin, dir, tMin, meshHit))
+                        hitObject = planeObject + 1;
+                    hits.t[i] = tMin;
+                    hits.object[i] = hitObject;
+                    hits.mesh[i] = meshHit;
+                }
+                if (depth == 0)
+                    workerCounters[worker].primary += end - begin;
+                else
+                    workerCounters[worker].reflection += end - begin;
+            });
+
+            // shade: небо для промахов; теневой и отражённый лучи для попаданий
+            // (каждый кусок пишет свои лучи подряд от начала куска)
+            pool.parallelFor(chunks, [&](size_t chunk, unsigned) {
+                const size_t begin = chunk * RAY_QUEUE_CHUNK;
+                const size_t end = std::min(rays.count, begin + RAY_QUEUE_CHUNK);
+                size_t shadowOut = begin, reflectedOut = begin;
+                for (size_t i = begin; i < end; ++i) {
+                    const Ray ray = rays.ray(i);
+                    const float weight = rays.weight[i];
+                    const int hitObject = hits.object[i];
+                    if (hitObject == -1) {
+                        sampleColors[rays.sample[i]] += weight * SKY_COLOR;
+                        continue;
+                    }
+
+                    const glm::vec3 hitPoint = ray.origin + ray.direction * hits.t[i];
+                    glm::vec3 normal;
+                    Material textured;
+                    const Material& material = surfaceAt(scene, bvh, hitObject, hits.mesh[i], ray, hitPoint, normal, textured);
+                    const glm::vec3 viewDir = glm::normalize(-ray.direction);
+                    const glm::vec3 shadowOrigin = hitPoint + normal * 1e-4f;
+                    const glm::vec3 shadowDir = glm::normalize(scene.light.position - hitPoint);
+
+                    shadows.ox[shadowOut] = shadowOrigin.x;
+                    shadows.oy[shadowOut] = shadowOrigin.y;
+                    shadows.oz[shadowOut] = shadowOrigin.z;
+                    shadows.dx[shadowOut] = shadowDir.x;
+                    shadows.dy[shadowOut] = shadowDir.y;
+                    shadows.dz[shadowOut] = shadowDir.z;
+                    shadows.object[shadowOut] = hitObject;
+                    shadows.sample[shadowOut] = rays.sample[i];
+                    shadows.ambient[shadowOut] = getAmbient(material, scene.light);
+                    shadows.direct[shadowOut] = getDirect(material, hitPoint, normal, viewDir, scene.light);
+                    shadows.weight[shadowOut] = weight;
+                    ++shadowOut;
+
+                    if (material.reflection > 0.0f && depth + 1 < settings.maxDepth) {
+                        Ray next;
+                        next.direction = glm::reflect(ray.direction, normal);
+                        next.origin = hitPoint + next.direction * 1e-4f;
+                        reflected.set(reflectedOut++, next, rays.sample[i], weight * material.reflection);
+                    }
+                }
+                shadowCounts[chunk] = shadowOut - begin;
+                reflectedCounts[chunk] = reflectedOut - begin;
+            });
+
+            // shadow: плоскость векторным циклом, затем BVH для ещё не закрытых лучей;
+            // вклад отскока добавляется к цвету выборки
+            pool.parallelFor(chunks, [&](size_t chunk, unsigned worker) {
+                const size_t begin = chunk * RAY_QUEUE_CHUNK;
+                const size_t end = begin + shadowCounts[chunk];
+                float tPlane[RAY_QUEUE_CHUNK];
+                intersectPlaneQueue(scene.floorPlane, shadows, begin, end, tPlane);
+                for (size_t i = begin; i < end; ++i)
+                    shadows.occluded[i] = shadows.object[i] != planeObject && tPlane[i - begin] >= 0.0f;
+                for (size_t i = begin; i < end; ++i) {
+                    if (shadows.occluded[i])
+                        continue;
+                    const glm::vec3 origin(shadows.ox[i], shadows.oy[i], shadows.oz[i]);
+                    const glm::vec3 dir(shadows.dx[i], shadows.dy[i], shadows.dz[i]);
+                    shadows.occluded[i] = bvh.spheres.intersectAny(origin, dir, shadows.object[i]) ||
+                                          (!bvh.instances.empty() && bvh.instances.intersectAny(origin, dir));
+                }
+                for (size_t i = begin; i < end; ++i) {
+                    const glm::vec3 color = shadows.occluded[i] ? shadows.ambient[i] : shadows.ambient[i] + shadows.direct[i];
+                    sampleColors[shadows.sample[i]] += shadows.weight[i] * color;
+                }
+                workerCounters[worker].shadow += end - begin;
+            });
+
+            // Очередь следующего отскока, для RayOrder::Binned — по корзинам
+            compactQueue(reflected, reflectedCounts, rays, pool);
+            if (settings.rayOrder == RayOrder::Binned && rays.count > 0) {
+                const std::vector<uint32_t> order = binnedRayOrder(rays.count, [&](size_t i) { return rays.ray(i); }, pool);
+                const size_t orderChunks = (rays.count + RAY_QUEUE_CHUNK - 1) / RAY_QUEUE_CHUNK;
+                pool.parallelFor(orderChunks, [&](size_t chunk, unsigned) {
+                    const size_t end = std::min(rays.count, (chunk + 1) * RAY_QUEUE_CHUNK);
+                    for (size_t i = chunk * RAY_QUEUE_CHUNK; i < end; ++i)
+                        binned.copy(rays, order[i], i);
+                });
+                binned.count = rays.count;
+                std::swap(rays, binned);
+            }
+        }
+    }
+
+    std::vector<glm::vec3> sampleColors; // Цвет каждой выборки полосы
+    RayQueue rays, reflected, binned;
+    HitQueue hits;
+    ShadowQueue shadows;
+};
+
+// Кадр волновым конвейером без сохранения очередей между кадрами
+inline void renderImageWavefront(const Scene& scene, const SceneBVH& bvh, const RenderSettings& settings,
+                                 Framebuffer& framebuffer, WorkStealingPool& pool, RayCounters* counters = nullptr) {
+    WavefrontRenderer renderer;
+    renderer.render(scene, bvh, settings, framebuffer, pool, counters);
+}